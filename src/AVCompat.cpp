@@ -414,40 +414,6 @@ enum AVMediaType avfilter_pad_get_type(const AVFilterPad *pads, int pad_idx)
 #endif
 #endif //QTAV_HAVE(AVFILTER)
 
-int compat_decode(AVCodecContext* avctx, AVFrame* frame, int* got_frame, const AVPacket* pkt)
-{
-    int ret = 0;
-    *got_frame = 0;
-
-    ret = avcodec_send_packet(avctx, pkt);
-    if (ret == AVERROR_EOF)
-        ret = 0;
-    else if (ret == AVERROR(EAGAIN)) {
-        /* we fully drain all the output in each decode call, so this should not
-         * ever happen */
-        ret = AVERROR_BUG;
-        return ret;
-    }
-    else if (ret < 0)
-        return ret;
-
-
-    ret = avcodec_receive_frame(avctx, frame);
-    if (ret == 0) {
-        *got_frame = 1;
-        return pkt->size;
-    }
-    else {
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
-        {
-            ret = 0;
-            return pkt->size;
-        }
-        return ret;
-    }
-
-}
-
 int compat_encode(AVCodecContext* avctx, AVPacket* avpkt,
     int* got_packet, const AVFrame* frame)
 {
@@ -24,12 +24,14 @@
 #include "QtAV/AVClock.h"
 #include "QtAV/AVDemuxer.h"
 #include "QtAV/AVDecoder.h"
+#include "QtAV/Statistics.h"
 #include "VideoThread.h"
 #include "AudioThread.h"
 #include <QtCore/QTime>
 #include "utils/Logger.h"
 #include <QTimer>
-#include "SPSCQueue.h"
+#include "utils/BlockingSPSCQueue.h"
+#include "utils/RealtimeDecodeTask.h"
 #include <thread>
 #include <libavcodec/packet.h>
 #include "AVPlayer.h"
@@ -49,6 +51,180 @@ public:
     }
 };
 
+/*
+ * realtime decode mode: keeps the duration of packets queued before decoding around a target
+ * by presenting slightly faster or slower than the stream rate.
+ */
+class LatencyController {
+public:
+    LatencyController() : m_target(0.15), m_latency(-1), m_rate(1.0) {}
+    void setTarget(qreal seconds) { m_target = qMax<qreal>(seconds, 0.001); }
+    qreal target() const { return m_target; }
+    qreal latency() const { return qMax<qreal>(m_latency, 0); }
+    qreal rate() const { return m_rate; }
+    // value: measured latency in seconds. return the presentation rate
+    qreal update(qreal value) {
+        static const qreal kSmooth = 0.1;
+        static const qreal kDeadBand = 0.1; // relative error without correction
+        static const qreal kGain = 0.1;
+        static const qreal kMaxCorrection = 0.05;
+        static const qreal kMaxStep = 0.002; // rate change per packet, avoid audible/visible steps
+        m_latency = m_latency < 0 ? value : m_latency + (value - m_latency)*kSmooth;
+        const qreal err = (m_latency - m_target)/m_target;
+        qreal want = 1.0;
+        if (qAbs(err) > kDeadBand)
+            want += qBound(-kMaxCorrection, err*kGain, kMaxCorrection);
+        m_rate += qBound(-kMaxStep, want - m_rate, kMaxStep);
+        return m_rate;
+    }
+    // rate correction can not converge in a reasonable time
+    bool isTooLate() const { return m_latency > qMax(m_target*4.0, m_target + 1.0); }
+    void reset() {
+        m_latency = -1;
+        m_rate = 1.0;
+    }
+private:
+    qreal m_target; // s
+    qreal m_latency; // s, smoothed. <0: no value
+    qreal m_rate;
+};
+
+/*
+ * realtime decode mode: decodes the queued packets and paces presentation by the stream of the master decoder.
+ * clockPacketRead() is called by the reader, decodeNext() by the decode loop or RealtimeDecodeTask.
+ * decodePacket() of AVThreads delivers in WorkPool::Blocking scopes.
+ */
+class RealtimeDecoder {
+public:
+    typedef BlockingSPSCQueue<Packet>::Clock Clock;
+    RealtimeDecoder(BlockingSPSCQueue<Packet> *packets, AVDemuxer *demuxer, AVThread *athread, AVThread *vthread, AVPlayer *player, Statistics *statistics)
+        : m_packets(packets)
+        , m_demuxer(demuxer)
+        , m_athread(athread)
+        , m_vthread(vthread)
+        , m_player(player)
+        , m_statistics(statistics)
+        , m_clock_stream(vthread ? demuxer->videoStream() : demuxer->audioStream())
+        , m_fps(demuxer->frameRate())
+        , m_read_pts(0)
+        , m_frames(0)
+        , m_last_frames(0)
+        , m_deadline(Clock::now())
+        , m_skip_to_key(false)
+        , m_flushes(0)
+        , m_full_count(0)
+    {
+        if (m_fps <= 0 || m_fps > 1000 || std::isnan(m_fps.load()))
+            m_fps = 20;
+        m_elapsed.start();
+    }
+    int clockStream() const { return m_clock_stream; }
+    // reader: a packet of clock stream is read
+    void clockPacketRead(qreal pts) {
+        // calculate fps using exponential moving average
+        const qint64 elapsed = m_elapsed.elapsed();
+        if (elapsed > 1000) {
+            const double alpha = m_frames > 0 ? 0.333 : 1.0;
+            const double val = (double(m_frames - m_last_frames)/elapsed)*1000;
+            m_last_frames = m_frames;
+            m_fps = qMax((alpha * val) + (1.0 - alpha) * m_fps, 1.0);
+            m_elapsed.start();
+        }
+        ++m_frames;
+        m_read_pts = pts;
+    }
+    /*
+     * Decode the front packet and pop it. Return false if no packet is queued.
+     * wait is set to true if the next packet should be decoded at deadline()
+     */
+    bool decodeNext(bool *wait);
+    Clock::time_point deadline() const { return m_deadline; }
+private:
+    BlockingSPSCQueue<Packet> *m_packets;
+    AVDemuxer *m_demuxer;
+    AVThread *m_athread, *m_vthread;
+    AVPlayer *m_player;
+    Statistics *m_statistics;
+    const int m_clock_stream;
+    std::atomic<double> m_fps;
+    std::atomic<double> m_read_pts; // pts of the latest clock stream packet read
+    qint64 m_frames, m_last_frames; // reader only
+    QElapsedTimer m_elapsed;
+    // presentation deadline of the next decoded packet. decoding time is included, so the rate does not drift
+    Clock::time_point m_deadline;
+    LatencyController m_latency;
+    // last resort if the rate correction is not enough: drop packets until a video key frame,
+    // so that the decoder does not have to be reset
+    bool m_skip_to_key;
+    qint64 m_flushes;
+    int m_full_count;
+};
+
+bool RealtimeDecoder::decodeNext(bool *wait)
+{
+    *wait = false;
+    Packet *front = m_packets->tryFront();
+    if (!front)
+        return false;
+    const size_t psize = m_packets->size();
+    if (psize > m_packets->capacity()*0.9)
+        ++m_full_count;
+    else
+        m_full_count = 0;
+    Packet pkt(std::move(*front));
+    m_packets->pop();
+    const bool is_clock = pkt.asAVPacket()->stream_index == m_clock_stream;
+    qreal delay = 0; // s, duration of queued packets
+    if (is_clock) {
+        m_latency.setTarget(qreal(m_player->realtimeTargetLatency())/1000.0);
+        delay = m_read_pts - pkt.pts;
+        if (delay < 0 || delay > 30.0) // timestamp discontinuity
+            delay = qreal(psize)/m_fps;
+    }
+    if (m_skip_to_key) {
+        const bool resume = is_clock && (m_vthread ? pkt.hasKeyFrame : delay <= m_latency.target());
+        if (!resume)
+            return true;
+        m_skip_to_key = false;
+        m_full_count = 0;
+        m_latency.reset();
+        m_deadline = Clock::now();
+    }
+    if (is_clock) {
+        m_latency.update(delay);
+        if (m_latency.isTooLate() || m_full_count > 10) {
+            qDebug("realtime latency %.3fs is too large. skip to the next key frame", m_latency.latency());
+            m_skip_to_key = true;
+            ++m_flushes;
+        }
+        if (m_statistics) {
+            QMutexLocker lock(&m_statistics->mutex);
+            Q_UNUSED(lock);
+            m_statistics->latency = m_latency.latency()*1000.0;
+            m_statistics->targetLatency = m_latency.target()*1000.0;
+            m_statistics->latencyRate = m_latency.rate();
+            m_statistics->latencyFlushes = m_flushes;
+        }
+        if (m_skip_to_key)
+            return true;
+    }
+    bool ret = false;
+    if (m_vthread && m_demuxer->videoStream() == pkt.asAVPacket()->stream_index)
+        ret = static_cast<VideoThread*>(m_vthread)->decodePacket(pkt);
+    else if (m_athread && m_demuxer->audioStream() == pkt.asAVPacket()->stream_index)
+        ret = static_cast<AudioThread*>(m_athread)->decodePacket(pkt);
+    if (ret && is_clock) {
+        qint64 wait_us = qint64(1000000.0/(m_fps*m_latency.rate()));
+        wait_us = qMin<qint64>(qMax<qint64>(wait_us, 0), 1000000);
+        const Clock::time_point now = Clock::now();
+        if (m_deadline < now - std::chrono::microseconds(wait_us)) // too late, do not burst to catch up
+            m_deadline = now;
+        m_deadline += std::chrono::microseconds(wait_us);
+        *wait = true;
+    }
+    return true;
+}
+
 class QueueEmptyCall : public PacketBuffer::StateChangeCallback
 {
 public:
@@ -121,6 +297,11 @@ void AVDemuxThread::setDemuxer(AVDemuxer *dmx)
     demuxer = dmx;
 }
 
+void AVDemuxThread::setStatistics(Statistics *s)
+{
+    statistics = s;
+}
+
 void AVDemuxThread::setAudioDemuxer(AVDemuxer *demuxer)
 {
     //QMutexLocker locker(&buffer_mutex);
@@ -442,6 +623,10 @@ void AVDemuxThread::stop()
     cond.wakeAll();
     qDebug("all avthread finished. try to exit demux thread<<<<<<");
     end = true;
+    QMutexLocker lock(&realtime_mutex);
+    Q_UNUSED(lock);
+    if (realtime_queue)
+        realtime_queue->close(); // wake up realtime reader and decode loop
 }
 
 void AVDemuxThread::pause(bool p, bool wait)
@@ -642,79 +827,60 @@ void AVDemuxThread::run()
     AutoSem as(&sem);
     Q_UNUSED(as);
 
-    bool realtimeDecode = qobject_cast<AVPlayer*>(parent())->realtimeDecode();
+    AVPlayer *player = qobject_cast<AVPlayer*>(parent());
+    bool realtimeDecode = player->realtimeDecode();
 
     if(realtimeDecode) {
-        rigtorp::SPSCQueue<Packet> packets(audio_thread ? 100 : 30);
+        BlockingSPSCQueue<Packet> packets(audio_thread ? 100 : 30);
+        {
+            QMutexLocker lock(&realtime_mutex);
+            Q_UNUSED(lock);
+            realtime_queue = &packets;
+            if (end)
+                packets.close();
+        }
         Q_EMIT mediaStatusChanged(QtAV::BufferedMedia);
         Q_EMIT bufferProgressChanged(1);
 
-        std::atomic<double> fps = demuxer->frameRate();
-        if(fps<=0 || fps>1000 || std::isnan(fps.load()))
-            fps = 20;
-        qint64 totalFrames = 0;
-        qint64 lastTotalFrames = 0;
-        QElapsedTimer elapsedTimer;
-        elapsedTimer.start();
-        auto t = std::thread([&] {
+        RealtimeDecoder decoder(&packets, demuxer, audio_thread, video_thread, player, statistics);
+        QScopedPointer<RealtimeDecodeTask<RealtimeDecoder, Packet> > task;
+        if (player->sharedThreadPool())
+            task.reset(new RealtimeDecodeTask<RealtimeDecoder, Packet>(&decoder, &packets));
+        auto read = [&] {
           while (!end) {
               if (!demuxer->readFrame()) {
-                  QThread::msleep(10);
+                  packets.waitUntil(BlockingSPSCQueue<Packet>::Clock::now() + std::chrono::milliseconds(10));
                   continue;
               }
-
-              // calculate fps using exponential moving average
-              auto elapsed = elapsedTimer.elapsed();
-              if(elapsed>1000) {
-                  double alpha = totalFrames>0 ? 0.333 : 1.0;
-                  auto val = (static_cast<double>(totalFrames-lastTotalFrames)/elapsed)*1000;
-                  lastTotalFrames = totalFrames;
-                  fps = qMax((alpha * val) + (1.0 - alpha) * fps, 1.0);
-                  elapsedTimer.start();
-              }
-
-              ++totalFrames;
-
-              while(!end && !packets.try_push(demuxer->packet()))
-                QThread::msleep(1);
+              const Packet p(demuxer->packet());
+              if (demuxer->stream() == decoder.clockStream())
+                  decoder.clockPacketRead(p.pts);
+              if (!packets.push(p)) // blocks until the decode loop takes a packet
+                  break;
+              if (task)
+                  task->wake();
           }
-        });
-
-        int bufFullCount = 0;
-        while (!end) {
-            while (!end && !packets.front())
-                QThread::msleep(1);
-            if(!packets.front())
-                continue;
-            auto psize = packets.size();
-            if(psize>(packets.capacity()*0.9))
-                ++bufFullCount;
-            else
-                bufFullCount = 0;
-            if(bufFullCount>10) {
-                while (packets.front())
-                    packets.pop();
-                bufFullCount = 0;
-                Packet p;
-                if(video_thread)
-                    static_cast<VideoThread*>(video_thread)->decodePacket(p);
-                continue;
-            }
-            pkt = *packets.front();
-            bool ret = false;
-            if(video_thread && demuxer->videoStream()==pkt.asAVPacket()->stream_index)
-                ret = static_cast<VideoThread*>(video_thread)->decodePacket(pkt);
-            else if(audio_thread && demuxer->audioStream()==pkt.asAVPacket()->stream_index)
-                ret = static_cast<AudioThread*>(audio_thread)->decodePacket(pkt);
-            if(ret) {
-                int wait = int((1000-psize*5)/fps);
-                wait = qMin(qMax(wait , 0), 1000);
-                QThread::msleep(wait);
+          packets.close();
+        };
+        if (task) {
+            // this thread only reads. decoding and presentation run on the shared pool
+            read();
+            task->finish();
+        } else {
+            auto t = std::thread(read);
+            bool wait = false;
+            while (!end) {
+                if (!packets.front()) // blocks until a packet is read
+                    break;
+                if (decoder.decodeNext(&wait) && wait)
+                    packets.waitUntil(decoder.deadline());
             }
-            packets.pop();
+            packets.close();
+            t.join();
         }
-
-        t.join();
+        QMutexLocker lock(&realtime_mutex);
+        Q_UNUSED(lock);
+        realtime_queue = nullptr;
     }
 
     while (!end) {
@@ -846,7 +1012,7 @@ void AVDemuxThread::run()
                 aqueue->blockFull(!video_thread || !video_thread->isRunning() || !vqueue || audio_has_pic);
                 // external audio: a_ext < 0, stream = audio_idx=>put invalid packet
                 if (a_ext >= 0)
-                    aqueue->put(apkt); //affect video_thread
+                    aqueue->put(std::move(apkt)); //affect video_thread
             }
         }
         // always check video stream if use external audio
@@ -857,8 +1023,8 @@ void AVDemuxThread::run()
                     continue;
                 }
                 vqueue->blockFull(!audio_thread || !audio_thread->isRunning() || !aqueue || aqueue->isEnough());
-                vqueue->put(pkt); //affect audio_thread
                 last_vpts = pkt.pts;
+                vqueue->put(std::move(pkt)); //affect audio_thread
             }
         } else if (demuxer->subtitleStreams().contains(stream)) { //subtitle
             Q_EMIT internalSubtitlePacketRead(demuxer->subtitleStreams().indexOf(stream), pkt);
@@ -25,11 +25,14 @@
 #include <QtCore/QMutex>
 #include <QtCore/QSemaphore>
 #include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
 #include <QtCore/QRunnable>
 #include "PacketBuffer.h"
 #include <QTimer>
 
 namespace QtAV {
+template<typename T> class BlockingSPSCQueue;
+class Statistics;
 
 class AVDemuxer;
 class AVThread;
@@ -41,6 +44,8 @@ public:
     explicit AVDemuxThread(AVDemuxer *dmx, QObject *parent = 0);
     void setDemuxer(AVDemuxer *dmx);
     void setAudioDemuxer(AVDemuxer *demuxer); //not thread safe
+    // realtime decode latency is reported to s
+    void setStatistics(Statistics *s);
     void setAudioThread(AVThread *thread);
     AVThread* audioThread();
     void setVideoThread(AVThread *thread);
@@ -113,6 +118,10 @@ private:
         
     QSemaphore sem;
     QMutex next_frame_mutex;
+    // realtime decode mode: packets from reader thread to decode loop. closed by stop()
+    QMutex realtime_mutex;
+    BlockingSPSCQueue<Packet> *realtime_queue = nullptr;
+    Statistics *statistics = nullptr;
     int clock_type; // change happens in different threads(direct connection)
     friend class SeekTask;
     friend class stepBackwardTask;
@@ -26,15 +26,23 @@
 #include <QtCore/QIODevice>
 #if QT_VERSION >= QT_VERSION_CHECK(4, 7, 0)
 #include <QtCore/QElapsedTimer>
+#include <QtCore/QFileInfo>
 #else
 #include <QtCore/QTime>
 typedef QTime QElapsedTimer;
 #endif
 #include "utils/internal.h"
 #include "utils/Logger.h"
+#include "utils/seqlock.h"
 #include "AVWrapper.h"
-#include <QUrl>
-#include <set>
+#include "KeyFrameIndex.h"
+#include "PreRecordBuffer.h"
+#include "RecordWriter.h"
+#include "StreamInfoCache.h"
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace QtAV {
 static const char kFileScheme[] = "file:";
@@ -294,6 +302,7 @@ public:
     bool media_changed;
     mutable qptrdiff buf_pos; // detect eof for dynamic size (growing) stream even if detectDynamicStreamInterval() is not set
     Packet pkt;
+    QtAV::Wrapper::AVPacketWrapper read_pkt; // av_read_frame() output
     int stream;
     QList<int> audio_streams, video_streams, subtitle_streams;
     AVFormatContext *format_ctx;
@@ -326,24 +335,101 @@ public:
     AVDemuxer::InterruptHandler *interrupt_hanlder;
     QMutex mutex; //TODO: remove if load, read, seek is called in 1 thread
 
+    /*
+     * create writers for new recordings, move finished ones to finished. recordMutex must be locked.
+     * finished writers must be destroyed (joined) after recordMutex is unlocked, their threads may still be
+     * emitting recordFinished() and a directly connected slot can call recordings() etc.
+     */
+    void updateRecorders(AVDemuxer* q, std::vector<std::unique_ptr<RecordWriter>>* finished);
+    void applyRecordOptions(RecordWriter* w) {
+        w->setQueueLimit(record_max_packets, record_max_bytes);
+        w->setOverflowPolicy(record_policy);
+        w->setBlockTimeout(record_block_timeout);
+    }
+
     // for recording stream
-    std::map<QString,AVFormatContext*> oc;
-    std::map<QString,AVStream*> ostreamVideo;
-    std::map<QString,AVStream*> ostreamAudio;
-    std::map<QString,int64_t> videoFirstPts;
-    std::map<QString,int64_t> audioFirstPts;
-    std::map<QString,QElapsedTimer> elapsed;
-    std::map<QString,quint64> recordPacketCount;
-    std::map<QString,quint64> recordTryCount;
-    std::map<QString,QString> recordFormat;
-    std::map<QString,int> records; // <path, duration>
-    std::map<QString,bool> restream;
+    std::map<QString,AVDemuxer::RecordOptions> records; // requested recordings
+    std::vector<std::unique_ptr<RecordWriter>> recorders; // running and stopping writers
     QMutex recordMutex;
-    Wrapper::AVPacketWrapper lastKeyFrame;
-    QList<Wrapper::AVPacketWrapper> lastNonKeyFrames;
-
+    int record_max_packets = 1024;
+    qint64 record_max_bytes = 64*1024*1024;
+    int record_block_timeout = 500;
+    AVDemuxer::RecordOverflowPolicy record_policy = AVDemuxer::RecordDropNewest;
+    int pre_record_max = 0; // s
+    qint64 pre_record_max_bytes = 16*1024*1024;
+    PreRecordBuffer prerecord; // demuxer thread only
+    qint64 prerecord_ts = 0; // us, used if a packet has no timestamp
+
+    // traffic counters. written by demuxer thread only, published to other threads by traffic_pub
+    AVDemuxer::TrafficStatistics traffic;
+    seqlock<AVDemuxer::TrafficStatistics> traffic_pub;
+    mutable QMutex info_mutex;
+    QString container_format; // protected by info_mutex
     qint64 lastPts = -1;
     qreal averagePtsDiff = 0;
+
+    // key frame index of local files without a container index. loaded or built in kf_thread
+    void startKeyFrameIndex() {
+        const QString path(file);
+        kf_stop = false;
+        kf_thread = std::thread([this, path] {
+            KeyFrameIndex index;
+            if (!index.load(path) || !index.isComplete()) {
+                const bool ok = index.build(path, kf_stop);
+                // a partial index is saved too, the next load() continues the scan instead of starting again
+                if (!index.isEmpty())
+                    index.save(path);
+                if (!ok)
+                    return;
+                qDebug("KeyFrameIndex: %d key frames indexed for %s", index.size(), qPrintable(path));
+            }
+            std::lock_guard<std::mutex> lock(kf_mutex);
+            kf_index = std::move(index);
+        });
+    }
+    void stopKeyFrameIndex() {
+        kf_stop = true;
+        if (kf_thread.joinable())
+            kf_thread.join();
+        std::lock_guard<std::mutex> lock(kf_mutex);
+        kf_index.clear();
+        kf_injected = false;
+    }
+    // return false if not sought by the index
+    // flags: av_seek_frame() flags. AVSEEK_FLAG_ANY is not supported by the index
+    bool seekKeyFrame(int videoStream, qint64 upos, int flags, int* ret) {
+        if (flags & AVSEEK_FLAG_ANY)
+            return false;
+        std::lock_guard<std::mutex> lock(kf_mutex);
+        if (kf_index.isEmpty() || videoStream < 0)
+            return false;
+        if (format_ctx->iformat->flags & AVFMT_NOTIMESTAMPS) {
+            // timestamps are generated by the parser and a byte seek loses them. the generic index seek
+            // restores them, so feed it once and let av_seek_frame binary search it
+            if (!kf_injected) {
+                AVStream *st = format_ctx->streams[videoStream];
+                for (const KeyFrameIndex::Entry& e : kf_index.entries())
+                    av_add_index_entry(st, e.pos, av_rescale_q(e.ts, av_get_time_base_q(), st->time_base), 0, 0, AVINDEX_KEYFRAME);
+                kf_injected = true;
+            }
+            return false;
+        }
+        const KeyFrameIndex::Entry *e = kf_index.find(upos, flags & AVSEEK_FLAG_BACKWARD);
+        if (!e)
+            return false;
+        *ret = av_seek_frame(format_ctx, -1, e->pos, AVSEEK_FLAG_BYTE);
+        return *ret >= 0;
+    }
+    std::atomic<bool> kf_enabled{false}; // set by user thread
+    std::atomic<bool> kf_stop{false};
+    std::thread kf_thread;
+    std::mutex kf_mutex;
+    KeyFrameIndex kf_index; // protected by kf_mutex
+    bool kf_injected = false; // entries are added to the stream index. demuxer thread only
+
+    std::atomic<bool> stream_cache{false}; // set by user thread
+    QString stream_cache_key; // url of the cache entry used by the current context
+    int stream_cache_check = 0; // packets left to validate the cached parameters
 };
 
 AVDemuxer::AVDemuxer(QObject *parent)
@@ -377,6 +463,16 @@ AVDemuxer::AVDemuxer(QObject *parent)
 AVDemuxer::~AVDemuxer()
 {
     unload();
+    std::vector<std::unique_ptr<RecordWriter>> writers;
+    {
+        QMutexLocker lock(&d->recordMutex);
+        Q_UNUSED(lock);
+        d->records.clear();
+        writers.swap(d->recorders);
+    }
+    for (auto& w : writers)
+        w->stop(true);
+    writers.clear(); // join writer threads without recordMutex, they may emit signals
 }
 
 static void getFFmpegInputFormats(QStringList* formats, QStringList* extensions)
@@ -472,7 +568,9 @@ bool AVDemuxer::readFrame()
         return false;
     d->pkt = Packet();
     // no lock required because in AVDemuxThread read and seek are in the same thread
-    QtAV::Wrapper::AVPacketWrapper packet;
+    // the shell is reused. the payload is moved to d->pkt or released here
+    QtAV::Wrapper::AVPacketWrapper &packet = d->read_pkt;
+    av_packet_unref(&packet);
 
     d->interrupt_hanlder->begin(InterruptHandler::Read);
     int ret = av_read_frame(d->format_ctx, &packet); //0: ok, <0: error/end
@@ -512,229 +610,82 @@ bool AVDemuxer::readFrame()
         return false;
     }
 
-    if(resetValues.load()) {
-        mutex.lock();
-        totalBandwidth = 0;
-        totalVideoBandwidth = 0;
-        totalAudioBandwidth = 0;
-        totalKeyFrameSize = 0;
-        totalPFrameSize = 0;
-        totalPackets = 0;
-        totalVideoPackets = 0;
-        totalAudioPackets = 0;
-        lostFrames = 0;
+    if (d->stream_cache_check > 0) {
+        --d->stream_cache_check;
+        // decoders follow in-band parameter changes. the next load() probes again
+        if (!StreamInfoCache::instance().validate(d->stream_cache_key, &packet))
+            d->stream_cache_check = 0;
+    }
+
+    AVDemuxer::TrafficStatistics &traffic = d->traffic;
+    if(resetValues.load(std::memory_order_relaxed) && resetValues.exchange(false)) {
+        traffic = TrafficStatistics();
         d->averagePtsDiff = 0;
-        mutex.unlock();
-        resetValues.store(false);
     }
 
     auto packetSize = packet.calculatePacketSize();
 
-    mutex.lock();
-    totalBandwidth+=static_cast<quint64>(packetSize);
-    totalPackets++;
-    mutex.unlock();
+    traffic.totalBandwidth+=static_cast<quint64>(packetSize);
+    traffic.totalPackets++;
     if( packet->stream_index==videoStream())
     {
-        mutex.lock();
-        totalVideoBandwidth+=static_cast<quint64>(packetSize);
-        totalVideoPackets++;
+        traffic.totalVideoBandwidth+=static_cast<quint64>(packetSize);
+        traffic.totalVideoPackets++;
 
         if(packet->flags & AV_PKT_FLAG_KEY)
-            totalKeyFrameSize += static_cast<quint64>(packetSize);
+            traffic.totalKeyFrameSize += static_cast<quint64>(packetSize);
         else
-            totalPFrameSize += static_cast<quint64>(packetSize);
+            traffic.totalPFrameSize += static_cast<quint64>(packetSize);
 
         //auto time = packet.pts* av_q2d(d->format_ctx->streams[videoStream()]->time_base);
         if(packet->pts > d->lastPts) {
             qint64 ptsDiff = packet->pts-d->lastPts;
-            if(totalVideoPackets>1000 && ptsDiff>(10*d->averagePtsDiff)
+            if(traffic.totalVideoPackets>1000 && ptsDiff>(10*d->averagePtsDiff)
                     && d->averagePtsDiff>0 && (ptsDiff/d->averagePtsDiff)<10000 )
-                lostFrames+=(ptsDiff/d->averagePtsDiff);
+                traffic.lostFrames+=(ptsDiff/d->averagePtsDiff);
             else
-                d->averagePtsDiff += static_cast<double>(ptsDiff-d->averagePtsDiff)/totalVideoPackets;
+                d->averagePtsDiff += static_cast<double>(ptsDiff-d->averagePtsDiff)/traffic.totalVideoPackets;
         }
-        mutex.unlock();
 
         d->lastPts = packet->pts;
     }
-    else if( packet->stream_index==audioStream() || packet->stream_index==audioStreamIndex)
+    else if( packet->stream_index==audioStream() || packet->stream_index==audioStreamIndex.load(std::memory_order_relaxed))
     {
-        mutex.lock();
-        totalAudioBandwidth+=static_cast<quint64>(packetSize);
-        totalAudioPackets++;
-        mutex.unlock();
+        traffic.totalAudioBandwidth+=static_cast<quint64>(packetSize);
+        traffic.totalAudioPackets++;
     }
+    d->traffic_pub.store(traffic);
 
+    std::vector<std::unique_ptr<RecordWriter>> finished;
     d->recordMutex.lock();
-    if(d->records.size()!=d->oc.size()) {
-        for(const auto& [k,v]: d->records)
-            if(d->oc.find(k)==d->oc.end()) {
-                d->oc.insert({k, nullptr});
-                d->ostreamVideo.insert({k, nullptr});
-                d->ostreamAudio.insert({k, nullptr});
-                d->restream.insert({k, (QUrl(k).scheme().toLower()=="udp")});
-                d->elapsed.insert({k, QElapsedTimer{}});
-                d->recordPacketCount.insert({k, 0});
-                d->recordTryCount.insert({k, 0});
-                d->recordFormat.insert({k,videoStream()>=0 ?"mkv":"wav"});
-                d->videoFirstPts.insert({k, -1});
-                d->audioFirstPts.insert({k, -1});
-            }
-        for(auto it =  d->oc.cbegin(); it!=d->oc.cend();) {
-            auto k = it->first;
-            if(d->records.find(k)==d->records.end()) {
-                if(d->ostreamVideo[k] != nullptr || d->ostreamAudio[k] != nullptr) {
-                    if(d->elapsed[k].isValid())
-                        av_write_trailer(d->oc[k]);
-                    avio_close(d->oc[k]->pb);
-                    d->oc[k]->pb = nullptr;
-                }
-                if(d->oc[k]!=nullptr)
-                    avformat_free_context(d->oc[k]);
-
-                emit recordFinished(true, d->recordFormat[k]);
-
-                d->ostreamVideo.erase(k);
-                d->ostreamAudio.erase(k);
-                d->videoFirstPts.erase(k);
-                d->audioFirstPts.erase(k);
-                d->restream.erase(k);
-                d->elapsed.erase(k);
-                d->recordPacketCount.erase(k);
-                d->recordTryCount.erase(k);
-                d->recordFormat.erase(k);
-                it = d->oc.erase(it);
-            }
-            else
-                ++it;
-        }
-    }
+    d->updateRecorders(this, &finished);
     d->recordMutex.unlock();
-
-    for(const auto& [k,v]: d->oc) {
-        if(!d->elapsed[k].isValid()){
-            if(!d->restream[k] && d->recordTryCount[k]>20) {
-                if(d->oc[k]!=nullptr)
-                    avformat_free_context(d->oc[k]);
-                d->oc[k] = nullptr;
-                d->ostreamVideo[k] = nullptr;
-                d->ostreamAudio[k] = nullptr;
-                if(d->recordFormat[k]=="mkv")
-                    d->recordFormat[k]="mp4";
-                else if(d->recordFormat[k]=="mp4")
-                    d->recordFormat[k]="avi";
-                else if(d->recordFormat[k]=="avi")
-                    d->recordFormat[k]="mov";
-                else if(d->recordFormat[k]=="mov")
-                    d->recordFormat[k]="flv";
-                else {
-                    emit recordFinished(false, "");
-                    d->recordMutex.lock();
-                    stopRecording(k);
-                    d->recordMutex.unlock();
-                }
-                d->recordTryCount[k] = 0;
-            }
-            if(d->oc[k]==nullptr) {
-                auto ret = -1;
-                if(d->restream[k])
-                    ret = avformat_alloc_output_context2(&d->oc[k],nullptr,/*d->format_ctx->iformat->name*/"mpegts",nullptr);
-                else
-                    ret = avformat_alloc_output_context2(&d->oc[k],nullptr,nullptr,(k+"."+d->recordFormat[k]).toLatin1());
-                if(ret>=0 && d->oc[k]!=nullptr && !(d->oc[k]->oformat->flags & AVFMT_NOFILE))
-                    avio_open(&d->oc[k]->pb, (k+(d->restream[k] ? "" : "."+d->recordFormat[k])).toLatin1(), AVIO_FLAG_WRITE);
-            }
-            if(d->oc[k]!=nullptr && d->ostreamVideo[k] == nullptr && videoStream()>=0) {
-                d->ostreamVideo[k] = avformat_new_stream(d->oc[k], nullptr);
-                if(d->ostreamVideo[k]!=nullptr) {
-                    avcodec_parameters_copy(d->ostreamVideo[k]->codecpar, d->format_ctx->streams[videoStream()]->codecpar);
-                    d->ostreamVideo[k]->codecpar->codec_tag = 0;
-                    d->ostreamVideo[k]->start_time          = 0;
-                }
-            }
-            if(d->oc[k]!=nullptr && d->ostreamAudio[k] == nullptr && audioStream()>=0) {
-                d->ostreamAudio[k] = avformat_new_stream(d->oc[k], nullptr);
-                if(d->ostreamAudio[k]!=nullptr) {
-                    avcodec_parameters_copy(d->ostreamAudio[k]->codecpar, d->format_ctx->streams[audioStream()]->codecpar);
-                    d->ostreamAudio[k]->codecpar->codec_tag = 0;
-                    d->ostreamAudio[k]->start_time          = 0;
-                }
-            }
-            if((d->ostreamVideo[k]!=nullptr || videoStream()<0) && (d->ostreamAudio[k]!=nullptr || audioStream()<0) && !d->elapsed[k].isValid()) {
-                auto ret = avformat_write_header(d->oc[k],nullptr);
-                if(ret>=0)
-                    d->elapsed[k].start();
-            }
-            if(!d->elapsed[k].isValid())
-                ++(d->recordTryCount[k]);
-        }
-        auto & is = d->format_ctx->streams[packet->stream_index];
-        auto & os = packet->stream_index==videoStream() ? d->ostreamVideo[k] : d->ostreamAudio[k];
-        if(os != nullptr && d->elapsed[k].isValid()){
-            QList<Wrapper::AVPacketWrapper> packets = {packet};
-            auto writePrevFrames = d->recordPacketCount[k]==0 && !(packet->flags & AV_PKT_FLAG_KEY) && d->lastKeyFrame->data!=nullptr;
-            if(writePrevFrames) {
-                packets = {d->lastKeyFrame};
-                packets.append(d->lastNonKeyFrames);
-                packets.append(packet);
-                auto i = 0;
-                for(auto& p: packets) {
-                    if(i<packets.length()-1) {
-                        p->pts = AV_NOPTS_VALUE;
-                        p->dts = AV_NOPTS_VALUE;
-                        p->duration = 0;
-                    }
-                    ++i;
-                }
-            }
-            for(auto & p: packets) {
-                auto t1 = p->pts;
-                auto t2 = p->dts;
-                auto t3 = p->duration;
-                if(p->pts!=AV_NOPTS_VALUE) {
-                    av_packet_rescale_ts(&p, is->time_base, os->time_base);
-                    if(p->stream_index==videoStream()) {
-                        if(d->videoFirstPts[k]<0)
-                            d->videoFirstPts[k] = p->pts;
-                        p->pts -= d->videoFirstPts[k];
-                    }
-                    else {
-                        if(d->audioFirstPts[k]<0)
-                            d->audioFirstPts[k] = p->pts;
-                        p->pts -= d->audioFirstPts[k];
-                    }
-                }
-                else {
-                    auto elapsed = writePrevFrames ? 0 : d->elapsed[k].nsecsElapsed();
-                    p->pts = av_rescale_q(elapsed, {1,1000000000} , os->time_base);
-                    p->duration = 0;
-                }
-                p->dts = AV_NOPTS_VALUE;
-                av_write_frame(d->oc[k],&p);
-                p->pts = t1;
-                p->dts = t2;
-                p->duration = t3;
-                ++(d->recordPacketCount[k]);
-            }
-        }
-        d->recordMutex.lock();
-        auto stop = (d->records[k]>0 && (d->elapsed[k].elapsed()/1000)>=d->records[k]);
-        d->recordMutex.unlock();
-        if(stop)
-            stopRecording(k);
+    finished.clear(); // join
+    // recorders is only modified in this thread, no lock is required to push.
+    // a writer may block here only if RecordBlock policy is used
+    for (auto& w : d->recorders) {
+        if (!w->isStopping())
+            w->push(&packet);
+    }
+    if (packet->stream_index == videoStream() || packet->stream_index == audioStream()) {
+        // keep whole gops for the next recordings. pushed after writers so that a new writer gets it only once
+        qint64 ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+        if (ts != AV_NOPTS_VALUE)
+            d->prerecord_ts = av_rescale_q(ts, d->format_ctx->streams[packet->stream_index]->time_base, av_get_time_base_q());
+        d->prerecord.setKeyStream(videoStream());
+        d->prerecord.push(&packet, d->prerecord_ts);
     }
 
     d->stream = packet->stream_index;
     //check whether the 1st frame is alreay got. emit only once
     if (!d->started) {
-        mutex.lock();
+        d->info_mutex.lock();
         if(d->format_ctx && d->format_ctx->iformat && d->format_ctx->iformat->name) {
-            containerFormat =  d->format_ctx->iformat->name;
+            d->container_format =  d->format_ctx->iformat->name;
         }
         else
-            containerFormat = "";
-        mutex.unlock();
+            d->container_format = "";
+        d->info_mutex.unlock();
 
         d->started = true;
         Q_EMIT started();
@@ -744,16 +695,7 @@ bool AVDemuxer::readFrame()
         return false;
     }
     // TODO: v4l2 copy
-    d->pkt = Packet::fromAVPacket(&packet, av_q2d(d->format_ctx->streams[d->stream]->time_base));
-    if(packet->flags & AV_PKT_FLAG_KEY) {
-        if(d->lastKeyFrame->data!=nullptr) {
-            d->lastNonKeyFrames.clear();
-        }
-        d->lastKeyFrame = packet;
-    }
-    else if(d->lastKeyFrame->data!=nullptr) {
-        d->lastNonKeyFrames.append(packet);
-    }
+    d->pkt = Packet::takeAVPacket(&packet, av_q2d(d->format_ctx->streams[d->stream]->time_base));
 
     d->eof = false;
     if (d->pkt.pts > qreal(duration())/1000.0) {
@@ -830,6 +772,7 @@ bool AVDemuxer::seek(qint64 pos)
         }
     }
     d->eof = false;
+    d->prerecord.clear(); // packets before seeking are not continuous with the new ones
     // no lock required because in AVDemuxThread read and seek are in the same thread
 #if 0
     //t: unit is s
@@ -856,7 +799,10 @@ bool AVDemuxer::seek(qint64 pos)
     }
     //qDebug("seek flag: %d", seek_flag);
     //bool seek_bytes = !!(d->format_ctx->iformat->flags & AVFMT_TS_DISCONT) && strcmp("ogg", d->format_ctx->iformat->name);
-    int ret = av_seek_frame(d->format_ctx, -1, upos, seek_flag);
+    int ret = 0;
+    // the key frame before (backward) or after upos. AccurateSeek decodes from there
+    if (!d->seekKeyFrame(videoStream(), upos, seek_flag, &ret))
+        ret = av_seek_frame(d->format_ctx, -1, upos, seek_flag);
     //int ret = avformat_seek_file(d->format_ctx, -1, INT64_MIN, upos, upos, seek_flag);
     //avformat_seek_file()
     if (ret < 0 && (seek_flag & AVSEEK_FLAG_BACKWARD)) {
@@ -1084,9 +1030,23 @@ bool AVDemuxer::load()
     //deprecated
     //if(av_find_stread->inputfo(d->format_ctx)<0) {
     //TODO: avformat_find_stread->inputfo is too slow, only useful for some video format
+    d->stream_cache_key = d->stream_cache && !d->input ? d->file : QString();
+    const bool cached = !d->stream_cache_key.isEmpty() && StreamInfoCache::instance().apply(d->stream_cache_key, d->format_ctx);
+    if (cached) {
+        // codec parameters and frame rates are known. only read the first packets for timestamps
+        d->format_ctx->max_analyze_duration = 200000;
+        qDebug("stream info of %s is from cache", qPrintable(d->stream_cache_key));
+    }
+    d->stream_cache_check = cached ? 64 : 0;
     d->interrupt_hanlder->begin(InterruptHandler::FindStreamInfo);
     ret = avformat_find_stream_info(d->format_ctx, NULL);
     d->interrupt_hanlder->end();
+    if (!d->stream_cache_key.isEmpty()) {
+        if (ret < 0)
+            StreamInfoCache::instance().remove(d->stream_cache_key);
+        else if (!cached)
+            StreamInfoCache::instance().store(d->stream_cache_key, d->format_ctx);
+    }
 
     if (ret < 0) {
         setMediaStatus(InvalidMedia);
@@ -1112,6 +1072,9 @@ bool AVDemuxer::load()
     d->seekable = d->checkSeekable();
     if (was_seekable != d->seekable)
         Q_EMIT seekableChanged();
+    if (d->kf_enabled && d->seekable && !d->input && !d->network
+            && KeyFrameIndex::isRequired(d->format_ctx->iformat) && QFileInfo(d->file).isFile())
+        d->startKeyFrameIndex();
     qDebug("avfmtctx.flags: %d, iformat.flags", d->format_ctx->flags, d->format_ctx->iformat->flags);
     if (getInterruptStatus() < 0) {
         QString msg;
@@ -1139,6 +1102,10 @@ bool AVDemuxer::unload()
     d->buf_pos = 0;
     d->started = false;
     d->max_pts = 0.0;
+    // packets of the previous session must not be written as preroll after reopening
+    d->prerecord.clear();
+    d->prerecord_ts = 0;
+    d->stopKeyFrameIndex();
     d->resetStreams();
     d->interrupt_hanlder->setStatus(0);
     //av_close_input_file(d->format_ctx); //deprecated
@@ -1478,28 +1445,197 @@ void AVDemuxer::handleError(int averr, AVError::ErrorCode *errorCode, QString &m
     *errorCode = ec;
 }
 
-bool AVDemuxer::startRecording(const QString &filePath, int duration)
+bool AVDemuxer::startRecording(const QString &filePath, int duration, int preRecord)
 {
-    QMutexLocker(&d->recordMutex);
+    RecordOptions opt;
+    opt.duration = duration;
+    opt.preRecord = preRecord;
+    return startRecording(filePath, opt);
+}
+
+bool AVDemuxer::startRecording(const QString &filePath, const RecordOptions &options)
+{
+    QMutexLocker lock(&d->recordMutex);
+    Q_UNUSED(lock);
     if(d->records.find(filePath)!=d->records.end())
         return false;
-    d->records.insert({filePath, duration});
+    d->records.insert({filePath, options});
     return true;
 }
 
 bool AVDemuxer::stopRecording(const QString &filePath)
 {
-    QMutexLocker(&d->recordMutex);
+    QMutexLocker lock(&d->recordMutex);
+    Q_UNUSED(lock);
     if(d->records.find(filePath)==d->records.end() && filePath!="")
         return false;
-    std::set<QString> stops;
     if(filePath!="")
         d->records.erase(filePath);
     else
         d->records.clear();
+    // writers finish in their own threads and emit recordFinished(). removed in readFrame()
+    for (auto& w : d->recorders) {
+        if (filePath.isEmpty() || w->path() == filePath)
+            w->stop();
+    }
     return true;
 }
 
+QStringList AVDemuxer::recordings() const
+{
+    QMutexLocker lock(&d->recordMutex);
+    Q_UNUSED(lock);
+    QStringList paths;
+    for (const auto& r : d->records)
+        paths.append(r.first);
+    return paths;
+}
+
+AVDemuxer::RecordStatistics AVDemuxer::recordStatistics(const QString &filePath) const
+{
+    QMutexLocker lock(&d->recordMutex);
+    Q_UNUSED(lock);
+    for (const auto& w : d->recorders) {
+        if (w->path() == filePath && !w->isStopping())
+            return w->statistics();
+    }
+    return RecordStatistics();
+}
+
+void AVDemuxer::setRecordQueueLimit(int packets, qint64 bytes)
+{
+    QMutexLocker lock(&d->recordMutex);
+    Q_UNUSED(lock);
+    d->record_max_packets = packets;
+    d->record_max_bytes = bytes;
+    for (auto& w : d->recorders)
+        d->applyRecordOptions(w.get());
+}
+
+void AVDemuxer::setRecordOverflowPolicy(RecordOverflowPolicy policy)
+{
+    QMutexLocker lock(&d->recordMutex);
+    Q_UNUSED(lock);
+    d->record_policy = policy;
+    for (auto& w : d->recorders)
+        d->applyRecordOptions(w.get());
+}
+
+AVDemuxer::RecordOverflowPolicy AVDemuxer::recordOverflowPolicy() const
+{
+    return d->record_policy;
+}
+
+void AVDemuxer::setRecordBlockTimeout(int ms)
+{
+    QMutexLocker lock(&d->recordMutex);
+    Q_UNUSED(lock);
+    d->record_block_timeout = ms;
+    for (auto& w : d->recorders)
+        d->applyRecordOptions(w.get());
+}
+
+void AVDemuxer::setPreRecordBuffer(int seconds, qint64 bytes)
+{
+    QMutexLocker lock(&d->recordMutex);
+    Q_UNUSED(lock);
+    d->pre_record_max = qMax(0, seconds);
+    d->pre_record_max_bytes = bytes;
+}
+
+int AVDemuxer::preRecordBufferDuration() const
+{
+    QMutexLocker lock(&d->recordMutex);
+    Q_UNUSED(lock);
+    return d->pre_record_max;
+}
+
+void AVDemuxer::setKeyFrameIndexEnabled(bool value)
+{
+    d->kf_enabled = value;
+}
+
+bool AVDemuxer::isKeyFrameIndexEnabled() const
+{
+    return d->kf_enabled;
+}
+
+void AVDemuxer::setStreamInfoCacheEnabled(bool value)
+{
+    d->stream_cache = value;
+}
+
+bool AVDemuxer::isStreamInfoCacheEnabled() const
+{
+    return d->stream_cache;
+}
+
+void AVDemuxer::clearStreamInfoCache(const QString &url)
+{
+    if (url.isEmpty())
+        StreamInfoCache::instance().clear();
+    else
+        StreamInfoCache::instance().remove(url);
+}
+
+void AVDemuxer::Private::updateRecorders(AVDemuxer *q, std::vector<std::unique_ptr<RecordWriter>>* finished)
+{
+    prerecord.setLimits(pre_record_max*1000LL, pre_record_max_bytes);
+    for (auto it = recorders.begin(); it != recorders.end();) {
+        if (!(*it)->isFinished()) {
+            ++it;
+            continue;
+        }
+        // finished by duration or error
+        const QString path = (*it)->path();
+        if (!(*it)->isStopping())
+            records.erase(path);
+        finished->push_back(std::move(*it)); // joined by the caller, the thread may still be in the callback
+        it = recorders.erase(it);
+    }
+    for (const auto& r : records) {
+        bool running = false;
+        for (const auto& w : recorders) {
+            if (w->path() == r.first && !w->isStopping()) {
+                running = true;
+                break;
+            }
+        }
+        if (running)
+            continue;
+        std::unique_ptr<RecordWriter> w(new RecordWriter(r.first, r.second, format_ctx, q->videoStream(), q->audioStream()));
+        applyRecordOptions(w.get());
+        // 0: only the current gop, written if the recording does not start at a key frame
+        const int pre = qMin(r.second.preRecord, pre_record_max);
+        w->setPreRollGopOnly(pre <= 0);
+        prerecord.forEach(pre*1000LL, [&w](const AVPacket* p) {
+            if (w->accepts(p->stream_index))
+                w->addPreRoll(p);
+        });
+        w->setFinishedCallback([q](bool success, const QString& fmt) {
+            Q_EMIT q->recordFinished(success, fmt);
+        });
+        const QString path = r.first;
+        w->setSegmentCallback([q, path](const QString& file) {
+            Q_EMIT q->recordSegmentFinished(path, file);
+        });
+        w->start();
+        recorders.push_back(std::move(w));
+    }
+}
+
+AVDemuxer::TrafficStatistics AVDemuxer::trafficStatistics() const
+{
+    return d->traffic_pub.load();
+}
+
+QString AVDemuxer::containerFormat() const
+{
+    QMutexLocker lock(&d->info_mutex);
+    Q_UNUSED(lock);
+    return d->container_format;
+}
+
 AVCodecContext* AVDemuxer::playAudioCodecContext() const
 {
     return &d->astream.avctx;
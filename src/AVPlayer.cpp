@@ -42,6 +42,7 @@
 #include "AudioThread.h"
 #include "VideoThread.h"
 #include "AVDemuxThread.h"
+#include "codec/video/DecoderThreadBudget.h"
 #include "QtAV/private/AVCompat.h"
 #include "utils/internal.h"
 #include "utils/Logger.h"
@@ -89,6 +90,7 @@ AVPlayer::AVPlayer(QObject *parent) :
     connect(&d->demuxer, SIGNAL(seekableChanged()), this, SIGNAL(seekableChanged()));
     d->read_thread = new AVDemuxThread(this);
     d->read_thread->setDemuxer(&d->demuxer);
+    d->read_thread->setStatistics(&d->statistics);
     //direct connection can not sure slot order?
     connect(d->read_thread, SIGNAL(finished()), this, SLOT(stopFromDemuxerThread()), Qt::DirectConnection);
     connect(d->read_thread, SIGNAL(requestClockPause(bool)), masterClock(), SLOT(pause(bool)), Qt::DirectConnection);
@@ -113,9 +115,7 @@ AVPlayer::AVPlayer(QObject *parent) :
        d->statistics.mutex.lock();
        auto frameCount = d->statistics.totalFrames;
        d->statistics.mutex.unlock();
-       d->demuxer.mutex.lock();
-       auto audioCount = d->demuxer.totalAudioPackets;
-       d->demuxer.mutex.unlock();
+       auto audioCount = d->demuxer.trafficStatistics().totalAudioPackets;
        if(frameCount == lastFrameCount && audioCount == lastAudioCount) {
            if(d->receivingFrames) {
               ++(d->checkReceivingCounter);
@@ -146,6 +146,7 @@ AVPlayer::AVPlayer(QObject *parent) :
      });
 
     connect(&d->demuxer,&AVDemuxer::recordFinished,this,&AVPlayer::recordFinished);
+    connect(&d->demuxer,&AVDemuxer::recordSegmentFinished,this,&AVPlayer::recordSegmentFinished);
 
 
     loaderThreadPool->setMaxThreadCount(300);
@@ -329,6 +330,46 @@ bool AVPlayer::realtimeDecode() const
     return d->realtimeDecode;
 }
 
+void AVPlayer::setRealtimeTargetLatency(int ms)
+{
+    d->realtime_target_latency = qMax(ms, 1);
+}
+
+int AVPlayer::realtimeTargetLatency() const
+{
+    return d->realtime_target_latency;
+}
+
+void AVPlayer::setSharedThreadPool(bool value)
+{
+    d->shared_thread_pool = value;
+}
+
+bool AVPlayer::sharedThreadPool() const
+{
+    return d->shared_thread_pool;
+}
+
+void AVPlayer::setDecodedFrameQueueDepth(int value)
+{
+    d->decoded_frame_queue_depth = qMax(value, 0);
+}
+
+int AVPlayer::decodedFrameQueueDepth() const
+{
+    return d->decoded_frame_queue_depth;
+}
+
+void AVPlayer::setDecodeAhead(int ms)
+{
+    d->decode_ahead = qBound(0, ms, 500);
+}
+
+int AVPlayer::decodeAhead() const
+{
+    return d->decode_ahead;
+}
+
 const Statistics& AVPlayer::statistics() const
 {
     return d->statistics;
@@ -542,6 +583,28 @@ QVariantHash AVPlayer::optionsForVideoCodec() const
     return d->vc_opt;
 }
 
+void AVPlayer::setVideoDecoderThreadBudget(int threads)
+{
+    DecoderThreadBudget::instance().setTotalThreads(threads);
+}
+
+int AVPlayer::videoDecoderThreadBudget()
+{
+    return DecoderThreadBudget::instance().totalThreads();
+}
+
+void AVPlayer::setVideoDecoderImportance(qreal value)
+{
+    d->vdec_importance = value;
+    if (d->vdec)
+        d->vdec->setProperty("importance", value);
+}
+
+qreal AVPlayer::videoDecoderImportance() const
+{
+    return d->vdec_importance;
+}
+
 void AVPlayer::setMediaEndAction(MediaEndAction value)
 {
     if (d->end_action == value)
@@ -597,9 +660,21 @@ void AVPlayer::resetMediaData()
     d->mediaDataTimer.stop();
 }
 
-bool AVPlayer::startRecording(const QString& filePath, int duration)
+bool AVPlayer::startRecording(const QString& filePath, int duration, int preRecord)
+{
+    return d->demuxer.startRecording(filePath, duration, preRecord);
+}
+
+bool AVPlayer::startRecording(const QString &filePath, const QVariantMap &options)
 {
-    return d->demuxer.startRecording(filePath, duration);
+    AVDemuxer::RecordOptions opt;
+    opt.duration = options.value(QStringLiteral("duration"), opt.duration).toInt();
+    opt.preRecord = options.value(QStringLiteral("preRecord"), opt.preRecord).toInt();
+    opt.segmentDuration = options.value(QStringLiteral("segmentDuration"), opt.segmentDuration).toLongLong();
+    opt.segmentSize = options.value(QStringLiteral("segmentSize"), opt.segmentSize).toLongLong();
+    opt.format = options.value(QStringLiteral("format")).toString();
+    opt.fragmented = options.value(QStringLiteral("fragmented"), opt.fragmented).toBool();
+    return d->demuxer.startRecording(filePath, opt);
 }
 
 bool AVPlayer::stopRecording()
@@ -607,6 +682,41 @@ bool AVPlayer::stopRecording()
     return d->demuxer.stopRecording();
 }
 
+QVariantMap AVPlayer::recordStatistics(const QString &filePath) const
+{
+    const AVDemuxer::RecordStatistics st = d->demuxer.recordStatistics(filePath);
+    QVariantMap m;
+    m[QStringLiteral("queuedPackets")] = st.queuedPackets;
+    m[QStringLiteral("queuedBytes")] = st.queuedBytes;
+    m[QStringLiteral("maxQueuedPackets")] = st.maxQueuedPackets;
+    m[QStringLiteral("writtenPackets")] = st.writtenPackets;
+    m[QStringLiteral("droppedPackets")] = st.droppedPackets;
+    m[QStringLiteral("lastWriteLatency")] = st.lastWriteLatency;
+    m[QStringLiteral("averageWriteLatency")] = st.averageWriteLatency;
+    m[QStringLiteral("maxWriteLatency")] = st.maxWriteLatency;
+    return m;
+}
+
+void AVPlayer::setRecordQueueLimit(int packets, qint64 bytes)
+{
+    d->demuxer.setRecordQueueLimit(packets, bytes);
+}
+
+void AVPlayer::setPreRecordBuffer(int seconds, qint64 bytes)
+{
+    d->demuxer.setPreRecordBuffer(seconds, bytes);
+}
+
+void AVPlayer::setRecordOverflowPolicy(AVDemuxer::RecordOverflowPolicy policy)
+{
+    d->demuxer.setRecordOverflowPolicy(policy);
+}
+
+AVDemuxer::RecordOverflowPolicy AVPlayer::recordOverflowPolicy() const
+{
+    return d->demuxer.recordOverflowPolicy();
+}
+
 MediaEndAction AVPlayer::mediaEndAction() const
 {
     return d->end_action;
@@ -789,6 +899,32 @@ bool AVPlayer::isAsyncLoad() const
     return d->async_load;
 }
 
+void AVPlayer::setKeyFrameIndexEnabled(bool value)
+{
+    if (d->demuxer.isKeyFrameIndexEnabled() == value)
+        return;
+    d->demuxer.setKeyFrameIndexEnabled(value);
+    Q_EMIT keyFrameIndexEnabledChanged();
+}
+
+bool AVPlayer::isKeyFrameIndexEnabled() const
+{
+    return d->demuxer.isKeyFrameIndexEnabled();
+}
+
+void AVPlayer::setStreamInfoCacheEnabled(bool value)
+{
+    if (d->demuxer.isStreamInfoCacheEnabled() == value)
+        return;
+    d->demuxer.setStreamInfoCacheEnabled(value);
+    Q_EMIT streamInfoCacheEnabledChanged();
+}
+
+bool AVPlayer::isStreamInfoCacheEnabled() const
+{
+    return d->demuxer.isStreamInfoCacheEnabled();
+}
+
 bool AVPlayer::isLoaded() const
 {
     return d->loaded;
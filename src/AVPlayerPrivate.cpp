@@ -105,11 +105,16 @@ AVPlayer::Private::Private(AVPlayer *player)
     , brightness(0)
     , contrast(0)
     , saturation(0)
+    , vdec_importance(1.0)
     , seeking(false)
     , seek_type(AccurateSeek)
     , interrupt_timeout(30000)
     , force_fps(0)
     , realtimeDecode{false}
+    , realtime_target_latency{150}
+    , shared_thread_pool{false}
+    , decoded_frame_queue_depth{0}
+    , decode_ahead{100}
     , notify_interval(-500)
     , status(NoMedia)
     , state(AVPlayer::StoppedState)
@@ -350,6 +355,14 @@ void AVPlayer::Private::initVideoStatistics(int s)
     }
 #endif
 }
+
+void AVPlayer::Private::updateVideoDecoderDetail(const QString &detail)
+{
+    QMutexLocker lock(&statistics.mutex);
+    Q_UNUSED(lock);
+    statistics.video.decoder_detail = detail;
+}
+
 // notify statistics change after audio/video thread is set
 bool AVPlayer::Private::setupAudioThread(AVPlayer *player)
 {
@@ -543,6 +556,7 @@ bool AVPlayer::Private::tryApplyDecoderPriority(AVPlayer *player)
             continue;
         vd->setCodecContext(avctx); // It's fine because AVDecoder copy the avctx properties
         vd->setOptions(vc_opt);
+        vd->setProperty("importance", vdec_importance);
         if (vd->open()) {
             qDebug("**************Video decoder found:%p", vd);
             break;
@@ -568,6 +582,7 @@ bool AVPlayer::Private::tryApplyDecoderPriority(AVPlayer *player)
         delete vdec;
     vdec = vd;
     QObject::connect(vdec, &VideoDecoder::error, player, &AVPlayer::error);
+    QObject::connect(vdec, &VideoDecoder::descriptionChanged, player, [this](const QString& detail) { updateVideoDecoderDetail(detail); });
     initVideoStatistics(demuxer.videoStream());
     // If no seek, drop packets until a key frame packet is found. But we may drop too many packets, and also a/v sync is a problem.
     player->setPosition(pos);
@@ -601,6 +616,7 @@ bool AVPlayer::Private::setupVideoThread(AVPlayer *player)
         //vd->isAvailable() //TODO: the value is wrong now
         vd->setCodecContext(avctx);
         vd->setOptions(vc_opt);
+        vd->setProperty("importance", vdec_importance);
         if (vd->open()) {
             vdec = vd;
             qDebug("**************Video decoder found:%p", vdec);
@@ -616,6 +632,7 @@ bool AVPlayer::Private::setupVideoThread(AVPlayer *player)
         return false;
     }
     QObject::connect(vdec, &VideoDecoder::error, player, &AVPlayer::error);
+    QObject::connect(vdec, &VideoDecoder::descriptionChanged, player, [this](const QString& detail) { updateVideoDecoderDetail(detail); });
     if (!vthread) {
         vthread = new VideoThread(player);
         vthread->setClock(clock);
@@ -684,11 +701,10 @@ bool AVPlayer::Private::calcRates()
     if(!elapsedTimer.isValid())
     {
         elapsedTimer.start();
-        demuxer.mutex.lock();
-        lastTotalBandwidth = demuxer.totalBandwidth;
-        lastTotalVideoBandwidth = demuxer.totalVideoBandwidth;
-        lastTotalAudioBandwidth = demuxer.totalAudioBandwidth;
-        demuxer.mutex.unlock();
+        const AVDemuxer::TrafficStatistics traffic = demuxer.trafficStatistics();
+        lastTotalBandwidth = traffic.totalBandwidth;
+        lastTotalVideoBandwidth = traffic.totalVideoBandwidth;
+        lastTotalAudioBandwidth = traffic.totalAudioBandwidth;
         statistics.mutex.lock();
         lastTotalFrames = statistics.totalFrames;
         statistics.mutex.unlock();
@@ -704,19 +720,18 @@ bool AVPlayer::Private::calcRates()
 
 
     double alpha = calc_count>0 ? 0.333 : 1.0;
-    demuxer.mutex.lock();
-    auto val = (static_cast<double>(demuxer.totalBandwidth-lastTotalBandwidth)/elapsed)*1000;
-    lastTotalBandwidth = demuxer.totalBandwidth;
+    const AVDemuxer::TrafficStatistics traffic = demuxer.trafficStatistics();
+    auto val = (static_cast<double>(traffic.totalBandwidth-lastTotalBandwidth)/elapsed)*1000;
+    lastTotalBandwidth = traffic.totalBandwidth;
     statistics.bandwidthRate = (alpha * val) + (1.0 - alpha) * statistics.bandwidthRate;
 
-    val = (static_cast<double>(demuxer.totalVideoBandwidth-lastTotalVideoBandwidth)/elapsed)*1000;
-    lastTotalVideoBandwidth = demuxer.totalVideoBandwidth;
+    val = (static_cast<double>(traffic.totalVideoBandwidth-lastTotalVideoBandwidth)/elapsed)*1000;
+    lastTotalVideoBandwidth = traffic.totalVideoBandwidth;
     statistics.videoBandwidthRate = (alpha * val) + (1.0 - alpha) * statistics.videoBandwidthRate;
 
-    val = (static_cast<double>(demuxer.totalAudioBandwidth-lastTotalAudioBandwidth)/elapsed)*1000;
-    lastTotalAudioBandwidth = demuxer.totalAudioBandwidth;
+    val = (static_cast<double>(traffic.totalAudioBandwidth-lastTotalAudioBandwidth)/elapsed)*1000;
+    lastTotalAudioBandwidth = traffic.totalAudioBandwidth;
     statistics.audioBandwidthRate = (alpha * val) + (1.0 - alpha) * statistics.audioBandwidthRate;
-    demuxer.mutex.unlock();
 
     statistics.mutex.lock();
     val = (static_cast<double>(statistics.totalFrames-lastTotalFrames)/elapsed)*1000;
@@ -760,6 +775,9 @@ void AVPlayer::Private::initMediaData()
     mediaData["decoder"] = "";
     mediaData["decoderDetails"] = "";
     mediaData["containerFormat"] = "";
+    mediaData["latency"] = 0;
+    mediaData["latencyRate"] = 1.0;
+    mediaData["latencyFlushes"] = 0;
 }
 
 void AVPlayer::Private::updateMediaData()
@@ -771,9 +789,7 @@ void AVPlayer::Private::updateMediaData()
         mediaData["protocol"] = q->file().mid(0,q->file().indexOf(":")).toUpper();
     mediaData["decoder"] = statistics.video.decoder;
     mediaData["decoderDetails"] = statistics.video.decoder_detail;
-    demuxer.mutex.lock();
-    mediaData["containerFormat"] = demuxer.containerFormat;
-    demuxer.mutex.unlock();
+    mediaData["containerFormat"] = demuxer.containerFormat();
     statistics.mutex.lock();
     mediaData["realResolution"] = statistics.realResolution;
     mediaData["imageBufferSize"] = statistics.imageBufferSize;
@@ -793,27 +809,29 @@ void AVPlayer::Private::updateMediaData()
     mediaData["droppedFrames"] = statistics.droppedFrames;
     mediaData["totalKeyFrames"] = statistics.totalKeyFrames;
     mediaData["imageBufferSize"] = statistics.imageBufferSize;
+    mediaData["latency"] = statistics.latency;
+    mediaData["latencyRate"] = statistics.latencyRate;
+    mediaData["latencyFlushes"] = statistics.latencyFlushes;
     statistics.mutex.unlock();
 
-    demuxer.mutex.lock();
-    mediaData["totalBandwidth"] = demuxer.totalBandwidth;
-    mediaData["totalVideoBandwidth"] = demuxer.totalVideoBandwidth;
-    mediaData["totalAudioBandwidth"] = demuxer.totalAudioBandwidth;
-    mediaData["totalKeyFrameSize"] = demuxer.totalKeyFrameSize;
-    mediaData["totalPFrameSize"] = demuxer.totalPFrameSize;
-    mediaData["totalPackets"] = demuxer.totalPackets;
-    mediaData["totalVideoPackets"] = demuxer.totalVideoPackets;
-    mediaData["totalAudioPackets"] = demuxer.totalAudioPackets;
-    mediaData["lostFrames"] = demuxer.lostFrames;
-    demuxer.mutex.unlock();
+    const AVDemuxer::TrafficStatistics traffic = demuxer.trafficStatistics();
+    mediaData["totalBandwidth"] = traffic.totalBandwidth;
+    mediaData["totalVideoBandwidth"] = traffic.totalVideoBandwidth;
+    mediaData["totalAudioBandwidth"] = traffic.totalAudioBandwidth;
+    mediaData["totalKeyFrameSize"] = traffic.totalKeyFrameSize;
+    mediaData["totalPFrameSize"] = traffic.totalPFrameSize;
+    mediaData["totalPackets"] = traffic.totalPackets;
+    mediaData["totalVideoPackets"] = traffic.totalVideoPackets;
+    mediaData["totalAudioPackets"] = traffic.totalAudioPackets;
+    mediaData["lostFrames"] = traffic.lostFrames;
 
     auto totalElapsed = totalElapsedTimer.elapsed();
     if(totalElapsed>0)
     {
         mediaData["averageFps"] = (static_cast<double>(statistics.totalFrames)/totalElapsed)*1000;
-        mediaData["averageBandwidth"] = (static_cast<double>(demuxer.totalBandwidth)/totalElapsed)*1000;
-        mediaData["averageVideoBandwidth"] = (static_cast<double>(demuxer.totalVideoBandwidth)/totalElapsed)*1000;
-        mediaData["averageAudioBandwidth"] = (static_cast<double>(demuxer.totalAudioBandwidth)/totalElapsed)*1000;
+        mediaData["averageBandwidth"] = (static_cast<double>(traffic.totalBandwidth)/totalElapsed)*1000;
+        mediaData["averageVideoBandwidth"] = (static_cast<double>(traffic.totalVideoBandwidth)/totalElapsed)*1000;
+        mediaData["averageAudioBandwidth"] = (static_cast<double>(traffic.totalAudioBandwidth)/totalElapsed)*1000;
     }
     emit q->mediaDataTimerTriggered(mediaData);
 }
@@ -49,6 +49,8 @@ public:
     void initCommonStatistics(int s, Statistics::Common* st, AVCodecContext* avctx);
     void initAudioStatistics(int s);
     void initVideoStatistics(int s);
+    // decoder thread allocation changed. detail is built in the decoding thread
+    void updateVideoDecoderDetail(const QString& detail);
     void initSubtitleStatistics(int s);
     QVariantList getTracksInfo(AVDemuxer* demuxer, AVDemuxer::StreamType st);
 
@@ -155,6 +157,7 @@ public:
     int brightness, contrast, saturation;
 
     QVariantHash ac_opt, vc_opt;
+    qreal vdec_importance;
 
     bool seeking;
     SeekType seek_type;
@@ -162,6 +165,10 @@ public:
 
     qreal force_fps;
     std::atomic_bool realtimeDecode;
+    std::atomic_int realtime_target_latency; // ms
+    std::atomic_bool shared_thread_pool;
+    std::atomic_int decoded_frame_queue_depth;
+    std::atomic_int decode_ahead; // ms
     // timerEvent interval in ms. can divide 1000. depends on media duration, fps etc.
     // <0: auto compute internally, |notify_interval| is the real interval
     int notify_interval;
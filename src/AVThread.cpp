@@ -123,7 +123,11 @@ const QList<Filter*>& AVThread::filters() const
 
 void AVThread::scheduleTask(QRunnable *task)
 {
-    d_func().tasks.put(task);
+    DPTR_D(AVThread);
+    d.tasks.put(task);
+    QMutexLocker lock(&d.task_mutex);
+    Q_UNUSED(lock);
+    d.task_cond.wakeAll();
 }
 
 void AVThread::requestSeek()
@@ -201,6 +205,9 @@ void AVThread::stop()
     d.packets.setBlocking(false); //stop blocking take()
     d.packets.clear();
     pause(false);
+    d.task_mutex.lock();
+    d.task_cond.wakeAll();
+    d.task_mutex.unlock();
     //terminate();
 }
 
@@ -334,6 +341,16 @@ bool AVThread::tryPause(unsigned long timeout)
     return true;
 }
 
+void AVThread::waitForTask()
+{
+    DPTR_D(AVThread);
+    QMutexLocker lock(&d.task_mutex);
+    Q_UNUSED(lock);
+    if (d.stop || !d.tasks.isEmpty())
+        return;
+    d.task_cond.wait(&d.task_mutex);
+}
+
 bool AVThread::processNextTask()
 {
     DPTR_D(AVThread);
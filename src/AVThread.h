@@ -108,6 +108,8 @@ protected:
     // has timeout so that the pending tasks can be processed
     bool tryPause(unsigned long timeout = 100);
     bool processNextTask(); //in AVThread
+    // block until a task is scheduled or stop() is called. used if packets are decoded by other thread
+    void waitForTask();
     // pts > 0: compare pts and clock when waiting
     void waitAndCheck(ulong value, qreal pts);
 
@@ -24,6 +24,7 @@
 
 #include <QtCore/QMutex>
 #include <QtCore/QMutexLocker>
+#include <QtCore/QQueue>
 #include <QtCore/QSemaphore>
 #include <QtCore/QVariant>
 #include <QtCore/QWaitCondition>
@@ -89,6 +90,8 @@ public:
     QList<Filter*> filters;
     Statistics *statistics; //not obj. Statistics is unique for the player, which is in AVPlayer
     BlockingQueue<QRunnable*> tasks;
+    QMutex task_mutex;
+    QWaitCondition task_cond; // wake up waitForTask()
     QSemaphore sem;
     bool seek_requested;
     //only decode video without display or skip decode audio until pts reaches
@@ -275,7 +275,7 @@ AudioFrame AudioFrame::to(const AudioFormat &fmt) const
     AudioFrame f(fmt, conv->outData());
     f.setSamplesPerChannel(conv->outSamplesPerChannel());
     f.setTimestamp(timestamp());
-    f.d_ptr->metadata = d->metadata; // need metadata?
+    d->copyPropertiesTo(f.d_ptr.data());
     return f;
 }
 } //namespace QtAV
@@ -0,0 +1,191 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include "AudioFrameConverter.h"
+#include "QtAV/AudioResampler.h"
+#include "utils/Logger.h"
+
+namespace QtAV {
+
+AudioFrameConverter::AudioFrameConverter()
+    : m_conv(0)
+    , m_passthrough(false)
+    , m_batch_samples(0)
+    , m_batch_pts(0)
+    , m_ptr(0)
+    , m_size(0)
+    , m_pts(0)
+{
+}
+
+AudioFrameConverter::~AudioFrameConverter()
+{
+    if (m_conv) {
+        delete m_conv;
+        m_conv = 0;
+    }
+}
+
+void AudioFrameConverter::setOutFormat(const AudioFormat &fmt)
+{
+    if (m_out == fmt)
+        return;
+    m_out = fmt;
+    m_in = AudioFormat(); // negotiate again in the next convert()
+    clear();
+}
+
+bool AudioFrameConverter::prepare(const AudioFormat &in)
+{
+    qDebug() << "audio conversion: " << in << "=>" << m_out;
+    clear(); // batched samples are flushed by convert() before
+    m_in = in;
+    // ao and backends accept packed formats only, and planes of a frame are not contiguous
+    m_passthrough = in == m_out && !in.isPlanar();
+    const int planes = in.isPlanar() ? in.channels() : 1;
+    m_planes.resize(planes);
+    m_batch.resize(planes);
+    if (m_passthrough)
+        return true;
+    if (!m_conv) {
+        m_conv = AudioResampler::create(AudioResamplerId_FF);
+        if (!m_conv)
+            m_conv = AudioResampler::create(AudioResamplerId_Libav);
+        if (!m_conv) {
+            qWarning("no audio resampler is available");
+            return false;
+        }
+    }
+    // prepare() is called if changed
+    m_conv->setInAudioFormat(in);
+    m_conv->setOutAudioFormat(m_out);
+    return true;
+}
+
+bool AudioFrameConverter::convert(const AudioFrame &frame)
+{
+    m_ptr = 0;
+    m_size = 0;
+    if (!frame.isValid() || !frame.constBits(0) || !m_out.isValid())
+        return false;
+    QByteArray flushed;
+    qreal flushed_pts = 0;
+    if (!(m_in == frame.format())) {
+        // batched samples are in the old format. convert them now, otherwise there is a gap
+        if (m_in.isValid() && flush()) {
+            flushed = QByteArray(m_ptr, m_size);
+            flushed_pts = m_pts;
+        }
+        if (!prepare(frame.format())) {
+            m_in = AudioFormat(); // try again
+            if (flushed.isEmpty())
+                return false;
+        } else if (!convertFrame(frame) && flushed.isEmpty()) {
+            return false;
+        }
+        if (flushed.isEmpty())
+            return true;
+        // the same output format, so the frame output continues the flushed one. format changes are rare
+        flushed.append(m_ptr, m_size);
+        m_data = flushed;
+        m_ptr = m_data.constData();
+        m_size = m_data.size();
+        m_pts = flushed_pts;
+        return true;
+    }
+    return convertFrame(frame);
+}
+
+bool AudioFrameConverter::convertFrame(const AudioFrame &frame)
+{
+    m_ptr = 0;
+    m_size = 0;
+    const int samples = frame.samplesPerChannel();
+    if (samples <= 0)
+        return false;
+    if (m_passthrough) {
+        m_ptr = (const char*)frame.constBits(0);
+        m_size = samples*m_out.bytesPerFrame();
+        m_pts = frame.timestamp();
+        return true;
+    }
+    if (m_batch_samples > 0 || samples < BatchSamples) {
+        if (m_batch_samples == 0)
+            m_batch_pts = frame.timestamp();
+        append(frame);
+        if (m_batch_samples < BatchSamples)
+            return true; // no output yet
+        return flush();
+    }
+    for (size_t i = 0; i < m_planes.size(); ++i)
+        m_planes[i] = frame.constBits(int(i));
+    m_pts = frame.timestamp();
+    return resample(&m_planes[0], samples);
+}
+
+bool AudioFrameConverter::flush()
+{
+    if (m_batch_samples <= 0 || m_passthrough)
+        return false;
+    for (size_t i = 0; i < m_planes.size(); ++i)
+        m_planes[i] = &m_batch[i][0];
+    m_pts = m_batch_pts;
+    const bool ok = resample(&m_planes[0], m_batch_samples);
+    m_batch_samples = 0;
+    for (size_t i = 0; i < m_batch.size(); ++i)
+        m_batch[i].clear(); // capacity is kept
+    return ok;
+}
+
+void AudioFrameConverter::clear()
+{
+    m_batch_samples = 0;
+    for (size_t i = 0; i < m_batch.size(); ++i)
+        m_batch[i].clear();
+    m_ptr = 0;
+    m_size = 0;
+}
+
+void AudioFrameConverter::append(const AudioFrame &frame)
+{
+    const int samples = frame.samplesPerChannel();
+    const int bytes = samples*m_in.bytesPerSample()*(m_in.isPlanar() ? 1 : m_in.channels());
+    for (size_t i = 0; i < m_batch.size(); ++i) {
+        const quint8 *src = frame.constBits(int(i));
+        m_batch[i].insert(m_batch[i].end(), src, src + bytes);
+    }
+    m_batch_samples += samples;
+}
+
+bool AudioFrameConverter::resample(const quint8 **planes, int samples)
+{
+    m_data = QByteArray(); // release the resampler output, so the resampler does not copy it
+    m_conv->setInSampesPerChannel(samples);
+    if (!m_conv->convert(planes)) {
+        qWarning() << "audio conversion error: " << m_in << "=>" << m_out;
+        return false;
+    }
+    m_data = m_conv->outData();
+    m_ptr = m_data.constData();
+    m_size = m_data.size();
+    return m_size > 0;
+}
+} //namespace QtAV
@@ -0,0 +1,85 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef QTAV_AUDIOFRAMECONVERTER_H
+#define QTAV_AUDIOFRAMECONVERTER_H
+
+#include <vector>
+#include <QtCore/QByteArray>
+#include "QtAV/AudioFrame.h"
+
+namespace QtAV {
+class AudioResampler;
+/*!
+ * \brief The AudioFrameConverter class
+ * Converts decoded frames to the audio output format. The resampler is set up once per input or output format
+ * change instead of per frame. Packed frames already in the output format are passed through without a copy.
+ * Frames shorter than BatchSamples are batched, so the resampler runs on fewer and larger buffers.
+ * Output is in the resampler's buffer, which is reused.
+ */
+class AudioFrameConverter
+{
+public:
+    enum { BatchSamples = 512 };
+    AudioFrameConverter();
+    ~AudioFrameConverter();
+    /// batched frames are dropped if fmt changes, they can not be output in the new format
+    void setOutFormat(const AudioFormat& fmt);
+    const AudioFormat& format() const { return m_out;}
+    /*!
+     * \brief convert
+     * If the input format changes, the frames batched in the old format are converted first and are at the start
+     * of the output.
+     * \return false if conversion failed. true if frame is converted or batched, size() is 0 if there is no
+     * output yet
+     */
+    bool convert(const AudioFrame& frame);
+    /// convert the batched frames, e.g. at the end of stream. false if none
+    bool flush();
+    /// drop the batched frames, e.g. after seeking
+    void clear();
+    /*!
+     * Output of the last convert() or flush(), in format(). Valid until the next call, and for a frame passed
+     * through, as long as the frame data
+     */
+    const char* constData() const { return m_ptr;}
+    int size() const { return m_size;}
+    qreal timestamp() const { return m_pts;}
+private:
+    bool prepare(const AudioFormat& in);
+    bool convertFrame(const AudioFrame& frame);
+    bool resample(const quint8** planes, int samples);
+    void append(const AudioFrame& frame);
+
+    AudioResampler *m_conv;
+    AudioFormat m_in, m_out;
+    bool m_passthrough;
+    std::vector<const quint8*> m_planes;
+    std::vector<std::vector<quint8> > m_batch; // per plane
+    int m_batch_samples;
+    qreal m_batch_pts;
+    QByteArray m_data; // shares the resampler output. released before converting again, so it is not detached
+    const char *m_ptr;
+    int m_size;
+    qreal m_pts;
+};
+} //namespace QtAV
+#endif //QTAV_AUDIOFRAMECONVERTER_H
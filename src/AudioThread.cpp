@@ -21,6 +21,8 @@
 
 #include "AudioThread.h"
 #include "AVThread_p.h"
+#include "AudioFrameConverter.h"
+#include "AudioTimeStretch.h"
 #include "QtAV/AudioDecoder.h"
 #include "QtAV/Packet.h"
 #include "QtAV/AudioFormat.h"
@@ -29,24 +31,97 @@
 #include "QtAV/AVClock.h"
 #include "QtAV/Filter.h"
 #include "output/OutputSet.h"
+#include "utils/WorkPool.h"
 #include "QtAV/private/AVCompat.h"
 #include <QtCore/QCoreApplication>
 #include <QtCore/QDateTime>
+#include <chrono>
+#include <thread>
 #include "utils/Logger.h"
 #include "AVPlayer.h"
 
 namespace QtAV {
 
+/*!
+ * Paces audio when no output device consumes it. Media time is mapped to absolute monotonic deadlines from an anchor,
+ * so sleep errors do not accumulate: an oversleep delays one chunk only, the next deadline does not move.
+ * The anchor is reset on seek, speed change, pts discontinuity and when the deadline is too late (e.g. after pause)
+ * to not burst to catch up.
+ */
+class AudioPacer
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+    AudioPacer() : m_valid(false), m_pts0(0), m_next(0), m_speed(1.0) {}
+    void reset() { m_valid = false; }
+    /*!
+     * \brief wait
+     * sleep until media time pts is due.
+     * \param duration media time of the chunk starting at pts
+     * \param speed media time per second
+     */
+    void wait(qreal pts, qreal duration, qreal speed) {
+        const Clock::time_point now = Clock::now();
+        if (!m_valid || speed != m_speed || qAbs(pts - m_next) > kMaxGap)
+            anchor(now, pts, speed);
+        Clock::time_point t = deadline(pts);
+        if (t < now - toDuration(kMaxLate)) {
+            anchor(now, pts, speed);
+            t = now;
+        }
+        m_next = pts + duration;
+        if (t > now)
+            std::this_thread::sleep_until(t);
+    }
+    /*!
+     * \brief waitClock
+     * sleep until a clock not driven by audio reaches pts. The deadline is from the clock, so it does not drift from it.
+     */
+    void waitClock(qreal pts, const AVClock *clock) {
+        reset();
+        const qreal dt = qMin((pts - clock->value())/clock->speed(), kMaxGap);
+        if (dt > 0)
+            std::this_thread::sleep_until(Clock::now() + toDuration(dt));
+    }
+private:
+    static Clock::duration toDuration(qreal s) {
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<qreal>(s));
+    }
+    void anchor(const Clock::time_point& now, qreal pts, qreal speed) {
+        m_t0 = now;
+        m_pts0 = pts;
+        m_speed = speed;
+        m_valid = true;
+    }
+    Clock::time_point deadline(qreal pts) const {
+        return m_t0 + toDuration((pts - m_pts0)/m_speed);
+    }
+
+    static const qreal kMaxGap; // pts jump, or max sleep for a chunk
+    static const qreal kMaxLate;
+    bool m_valid;
+    Clock::time_point m_t0;
+    qreal m_pts0;
+    qreal m_next; // expected pts of the next chunk
+    qreal m_speed;
+};
+const qreal AudioPacer::kMaxGap = 0.1;
+const qreal AudioPacer::kMaxLate = 0.1;
+
 class AudioThreadPrivate : public AVThreadPrivate
 {
 public:
     void init() {
-        resample = false;
         last_pts = 0;
+        conv.clear();
+        stretch.clear();
+        pacer.reset();
     }
 
-    bool resample;
     qreal last_pts; //used when audio output is not available, to calculate the aproximate sleeping time
+    AudioFrameConverter conv; // to audio output format
+    AudioTimeStretch stretch; // playback speed of audio output
+    AudioPacer pacer; // used when audio output is not available
 };
 
 AudioThread::AudioThread(QObject *parent)
@@ -73,47 +148,59 @@ bool AudioThread::decodePacket(Packet &pkt)
     if (!d.outputSet->outputs().isEmpty())
         ao = static_cast<AudioOutput*>(d.outputSet->outputs().first());
 
-    if (!dec->decode(pkt))
-        return false;
-
-    AudioFrame frame(dec->frame());
-    if (!frame)
-        return false;
-    if (frame.timestamp() <= 0)
-        frame.setTimestamp(pkt.pts); // pkt.pts is wrong. >= real timestamp
-
-    bool has_ao = ao && ao->isAvailable();
-    if (has_ao) {
-        applyFilters(frame);
-        frame.setAudioResampler(dec->resampler()); //!!!
-        // FIXME: resample ONCE is required for audio frames from ffmpeg
-        //if (ao->audioFormat() != frame.format()) {
-            frame = frame.to(ao->audioFormat());
-        //}
-    }
-    QByteArray decoded(frame.data());
-    int decodedSize = decoded.size();
-    int decodedPos = 0;
-    const qreal byte_rate = frame.format().bytesPerSecond();
-    qreal pts = frame.timestamp();
-    //qDebug("frame samples: %d @%.3f+%lld", frame.samplesPerChannel()*frame.channelCount(), frame.timestamp(), frame.duration()/1000LL);
-    while (decodedSize > 0) {
-        const int chunk = qMin(decodedSize, has_ao ? ao->bufferSize() : 512*frame.format().bytesPerFrame());//int(max_len*byte_rate));
-        //AudioFormat.bytesForDuration
-        const qreal chunk_delay = (qreal)chunk/(qreal)byte_rate;
-        if (has_ao && ao->isOpen()) {
-            QByteArray decodedChunk = QByteArray::fromRawData(decoded.constData() + decodedPos, chunk);
-            //qDebug("ao.timestamp: %.3f, pts: %.3f, pktpts: %.3f", ao->timestamp(), pts, pkt.pts);
-            ao->play(decodedChunk, pts);
+    const bool has_ao = ao && ao->isAvailable();
+    bool accepted = false; // a frame is played or batched by the converter
+    // a packet can be decoded to several frames. it's not consumed until the last frame is received
+    while (dec->decode(pkt)) {
+        if (!pkt.isEOF())
+            pkt.skip(pkt.data.size() - dec->undecodedSize());
+        AudioFrame frame(dec->frame());
+        if (frame) {
+            if (frame.timestamp() <= 0)
+                frame.setTimestamp(pkt.pts); // pkt.pts is wrong. >= real timestamp
+            AudioFormat fmt(frame.format());
+            qreal pts = frame.timestamp();
+            const char *decoded = 0;
+            int decodedSize = frame.samplesPerChannel()*fmt.bytesPerFrame(); // data is not used without ao
+            if (has_ao) {
+                applyFilters(frame);
+                d.conv.setOutFormat(ao->audioFormat());
+                if (!d.conv.convert(frame)) { // error
+                    if (!pkt.isEOF() && pkt.data.isEmpty())
+                        break;
+                    continue;
+                }
+                fmt = d.conv.format();
+                pts = d.conv.timestamp();
+                decoded = d.conv.constData();
+                decodedSize = d.conv.size(); // 0 if batched, no output yet
+            }
+            int decodedPos = 0;
+            const qreal byte_rate = fmt.bytesPerSecond();
+            //qDebug("frame samples: %d @%.3f+%lld", frame.samplesPerChannel()*frame.channelCount(), frame.timestamp(), frame.duration()/1000LL);
+            while (decodedSize > 0) {
+                const int chunk = qMin(decodedSize, has_ao ? ao->bufferSize() : 512*fmt.bytesPerFrame());//int(max_len*byte_rate));
+                //AudioFormat.bytesForDuration
+                const qreal chunk_delay = (qreal)chunk/(qreal)byte_rate;
+                if (has_ao && ao->isOpen()) {
+                    //qDebug("ao.timestamp: %.3f, pts: %.3f, pktpts: %.3f", ao->timestamp(), pts, pkt.pts);
+                    // blocks if the output buffer is full. a shared pool worker is replaced while blocked
+                    WorkPool::Blocking blocking;
+                    Q_UNUSED(blocking);
+                    ao->play(decoded + decodedPos, chunk, pts);
+                }
+                decodedPos += chunk;
+                decodedSize -= chunk;
+                pts += chunk_delay;
+                pkt.pts += chunk_delay; // packet not fully decoded, use new pts in the next decoding
+                pkt.dts += chunk_delay;
+            }
+            accepted = true;
         }
-        decodedPos += chunk;
-        decodedSize -= chunk;
-        pts += chunk_delay;
-        pkt.pts += chunk_delay; // packet not fully decoded, use new pts in the next decoding
-        pkt.dts += chunk_delay;
+        if (!pkt.isEOF() && pkt.data.isEmpty())
+            break;
     }
-
-    return true;
+    return accepted;
 }
 
 void AudioThread::applyFilters(AudioFrame &frame)
@@ -152,8 +239,8 @@ void AudioThread::run()
     while (!d.stop) {
         processNextTask();
 
-        if(realtimeDecode) {
-            QThread::msleep(1);
+        if(realtimeDecode) { // packets are decoded in demux thread
+            waitForTask();
             continue;
         }
 
@@ -201,6 +288,9 @@ void AudioThread::run()
                     Q_UNUSED(locker);
                     if (d.dec) //maybe set to null in setDecoder()
                         d.dec->flush();
+                    d.conv.clear();
+                    d.stretch.clear();
+                    d.pacer.reset();
                     d.render_pts0 = pkt.pts;
                     sync_id = pkt.position;
                     qDebug("audio seek: %.3f, id: %d", d.render_pts0, sync_id);
@@ -303,35 +393,6 @@ void AudioThread::run()
         //DO NOT decode and convert if ao is not available or mute!
         bool has_ao = ao && ao->isAvailable();
         //if (!has_ao) {//do not decode?
-        // TODO: move resampler to AudioFrame, like VideoFrame does
-        if (has_ao && dec->resampler()) {
-            if (dec->resampler()->speed() != ao->speed()
-                    || dec->resampler()->outAudioFormat() != ao->audioFormat()) {
-                //resample later to ensure thread safe. TODO: test
-                if (d.resample) {
-                    qDebug() << "ao.format " << ao->audioFormat();
-                    qDebug() << "swr.format " << dec->resampler()->outAudioFormat();
-                    qDebug("decoder set speed: %.2f", ao->speed());
-                    dec->resampler()->setOutAudioFormat(ao->audioFormat());
-                    dec->resampler()->setSpeed(ao->speed());
-                    dec->resampler()->prepare();
-                    d.resample = false;
-                } else {
-                    d.resample = true;
-                }
-            }
-        } else {
-            if (dec->resampler() && dec->resampler()->speed() != d.clock->speed()) {
-                if (d.resample) {
-                    qDebug("decoder set speed: %.2f", d.clock->speed());
-                    dec->resampler()->setSpeed(d.clock->speed());
-                    dec->resampler()->prepare();
-                    d.resample = false;
-                } else {
-                    d.resample = true;
-                }
-            }
-        }
         if (d.stop) {
             qDebug("audio thread stop before decode()");
             break;
@@ -341,6 +402,9 @@ void AudioThread::run()
             qWarning("Decode audio failed. undecoded: %d", dec->undecodedSize());
             if (pkt.isEOF()) {
                 qDebug("audio decode eof done");
+                // small frames still batched
+                if (has_ao && ao->isOpen() && d.conv.flush())
+                    ao->play(d.conv.constData(), d.conv.size(), d.conv.timestamp());
                 Q_EMIT eofDecoded();
                 if (d.render_pts0 >= 0) {
                     qDebug("audio seek done at eof pts: %.3f. id: %d", pkt.pts, sync_id);
@@ -365,7 +429,6 @@ void AudioThread::run()
         // reduce here to ensure to decode the rest data in the next loop
         if (!pkt.isEOF())
             pkt.skip(pkt.data.size() - dec->undecodedSize());
-#if USE_AUDIO_FRAME
         AudioFrame frame(dec->frame());
         if (!frame)
             continue; //pkt data is updated after decode, no reset here
@@ -384,37 +447,54 @@ void AudioThread::run()
             if (has_ao) {
                 ao->clear();
             }
+            d.conv.clear();
+            d.stretch.clear();
+            d.pacer.reset();
         }
+        AudioFormat fmt(frame.format());
+        qreal pts = frame.timestamp();
+        const char *decoded = 0;
+        int decodedSize = frame.samplesPerChannel()*fmt.bytesPerFrame(); // data is not used without ao
+        // media time per second of output
+        qreal speed = 1.0;
+        QByteArray stretched;
         if (has_ao) {
             applyFilters(frame);
-            frame.setAudioResampler(dec->resampler()); //!!!
-            // FIXME: resample ONCE is required for audio frames from ffmpeg
-            //if (ao->audioFormat() != frame.format()) {
-                frame = frame.to(ao->audioFormat());
-            //}
+            // set up once per format change. frames in ao format are not copied
+            d.conv.setOutFormat(ao->audioFormat());
+            // error, or batched with no output yet. pkt data is updated after decode, no reset here
+            if (!d.conv.convert(frame) || d.conv.size() <= 0)
+                continue;
+            fmt = d.conv.format();
+            pts = d.conv.timestamp();
+            decoded = d.conv.constData();
+            decodedSize = d.conv.size();
+            d.stretch.setFormat(fmt);
+            d.stretch.setSpeed(ao->speed());
+            if (d.stretch.isActive()) {
+                speed = d.stretch.speed();
+                const int in_frames = decodedSize/fmt.bytesPerFrame();
+                stretched = d.stretch.process(QByteArray::fromRawData(decoded, decodedSize));
+                decoded = stretched.constData();
+                decodedSize = stretched.size();
+                // output ends at the pending input
+                pts += (qreal(in_frames - d.stretch.pendingFrames()) - qreal(decodedSize/fmt.bytesPerFrame())*speed)/qreal(fmt.sampleRate());
+            }
         }
-        QByteArray decoded(frame.data());
-#else
-        QByteArray decoded(dec->data());
-#endif
-        int decodedSize = decoded.size();
         int decodedPos = 0;
-        qreal delay = 0;
-        const qreal byte_rate = frame.format().bytesPerSecond();
-        qreal pts = frame.timestamp();
+        const qreal byte_rate = fmt.bytesPerSecond();
         //qDebug("frame samples: %d @%.3f+%lld", frame.samplesPerChannel()*frame.channelCount(), frame.timestamp(), frame.duration()/1000LL);
         while (decodedSize > 0) {
             if (d.stop) {
                 qDebug("audio thread stop after decode()");
                 break;
             }
-            const int chunk = qMin(decodedSize, has_ao ? ao->bufferSize() : 512*frame.format().bytesPerFrame());//int(max_len*byte_rate));
+            const int chunk = qMin(decodedSize, has_ao ? ao->bufferSize() : 512*fmt.bytesPerFrame());//int(max_len*byte_rate));
             //AudioFormat.bytesForDuration
             const qreal chunk_delay = (qreal)chunk/(qreal)byte_rate;
             if (has_ao && ao->isOpen()) {
-                QByteArray decodedChunk = QByteArray::fromRawData(decoded.constData() + decodedPos, chunk);
                 //qDebug("ao.timestamp: %.3f, pts: %.3f, pktpts: %.3f", ao->timestamp(), pts, pkt.pts);
-                ao->play(decodedChunk, pts);
+                ao->play(decoded + decodedPos, chunk, pts);
                 if (!is_external_clock && ao->timestamp() > 0) {//TODO: clear ao buffer
                    // const qreal da = qAbs(pts - ao->timestamp());
                    // if (da > 1.0) { // what if frame duration is long?
@@ -423,20 +503,27 @@ void AudioThread::run()
                     d.clock->updateValue(ao->timestamp());
                 }
             } else {
-                d.clock->updateDelay(delay += chunk_delay);
-            /*
-             * why need this even if we add delay? and usleep sounds weird
-             * the advantage is if no audio device, the play speed is ok too
-             * So is portaudio blocking the thread when playing?
-             */
-                //TODO: avoid acummulative error. External clock?
-                msleep((unsigned long)(chunk_delay * 1000.0));
+                /*
+                 * the advantage is if no audio device, the play speed is ok too.
+                 * sleep to the absolute deadline of pts instead of chunk_delay, otherwise sleep errors accumulate.
+                 * the clock is driven by pts at the deadline, not by the sum of delays.
+                 */
+                if (is_external_clock) {
+                    d.pacer.waitClock(pts, d.clock);
+                } else {
+                    // not stretched without ao
+                    d.pacer.wait(pts, chunk_delay*speed, has_ao ? speed : d.clock->speed());
+                    if (d.clock->clockType() == AVClock::AudioClock) {
+                        d.clock->updateValue(pts);
+                        d.clock->updateDelay(0);
+                    }
+                }
             }
             decodedPos += chunk;
             decodedSize -= chunk;
-            pts += chunk_delay;
-            pkt.pts += chunk_delay; // packet not fully decoded, use new pts in the next decoding
-            pkt.dts += chunk_delay;
+            pts += chunk_delay*speed;
+            pkt.pts += chunk_delay*speed; // packet not fully decoded, use new pts in the next decoding
+            pkt.dts += chunk_delay*speed;
         }
         if (has_ao)
             emit frameDelivered();
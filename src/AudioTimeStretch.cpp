@@ -0,0 +1,342 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include "AudioTimeStretch.h"
+#include "output/audio/AudioVolume.h"
+#include "utils/AudioSample.h"
+#include <math.h>
+#include <string.h>
+#include "utils/Logger.h"
+
+namespace QtAV {
+namespace {
+using AudioSample::kMaxS32f;
+using AudioSample::clampf;
+static const double kPi = 3.14159265358979323846;
+// correlation of target and candidate, and energy of candidate
+typedef void (*CorrelateFunc)(const float *t, const float *c, int n, float *corr, float *energy);
+
+void correlate_c(const float *t, const float *c, int n, float *corr, float *energy)
+{
+    float xy = 0, yy = 0;
+    for (int i = 0; i < n; ++i) {
+        xy += t[i]*c[i];
+        yy += c[i]*c[i];
+    }
+    *corr = xy;
+    *energy = yy;
+}
+
+#if AUDIO_SSE2
+void correlate_sse2(const float *t, const float *c, int n, float *corr, float *energy)
+{
+    __m128 xy = _mm_setzero_ps(), yy = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128 y = _mm_loadu_ps(c + i);
+        xy = _mm_add_ps(xy, _mm_mul_ps(_mm_loadu_ps(t + i), y));
+        yy = _mm_add_ps(yy, _mm_mul_ps(y, y));
+    }
+    float a[4], b[4];
+    _mm_storeu_ps(a, xy);
+    _mm_storeu_ps(b, yy);
+    float sxy = a[0] + a[1] + a[2] + a[3], syy = b[0] + b[1] + b[2] + b[3];
+    for (; i < n; ++i) {
+        sxy += t[i]*c[i];
+        syy += c[i]*c[i];
+    }
+    *corr = sxy;
+    *energy = syy;
+}
+#endif
+#if AUDIO_AVX2
+TARGET_AVX2 void correlate_avx2(const float *t, const float *c, int n, float *corr, float *energy)
+{
+    __m256 xy = _mm256_setzero_ps(), yy = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 y = _mm256_loadu_ps(c + i);
+        xy = _mm256_add_ps(xy, _mm256_mul_ps(_mm256_loadu_ps(t + i), y));
+        yy = _mm256_add_ps(yy, _mm256_mul_ps(y, y));
+    }
+    float a[8], b[8];
+    _mm256_storeu_ps(a, xy);
+    _mm256_storeu_ps(b, yy);
+    float sxy = 0, syy = 0;
+    for (int k = 0; k < 8; ++k) {
+        sxy += a[k];
+        syy += b[k];
+    }
+    for (; i < n; ++i) {
+        sxy += t[i]*c[i];
+        syy += c[i]*c[i];
+    }
+    *corr = sxy;
+    *energy = syy;
+}
+#endif
+#if AUDIO_NEON
+void correlate_neon(const float *t, const float *c, int n, float *corr, float *energy)
+{
+    float32x4_t xy = vdupq_n_f32(0), yy = vdupq_n_f32(0);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const float32x4_t y = vld1q_f32(c + i);
+        xy = vmlaq_f32(xy, vld1q_f32(t + i), y);
+        yy = vmlaq_f32(yy, y, y);
+    }
+    float a[4], b[4];
+    vst1q_f32(a, xy);
+    vst1q_f32(b, yy);
+    float sxy = a[0] + a[1] + a[2] + a[3], syy = b[0] + b[1] + b[2] + b[3];
+    for (; i < n; ++i) {
+        sxy += t[i]*c[i];
+        syy += c[i]*c[i];
+    }
+    *corr = sxy;
+    *energy = syy;
+}
+#endif
+
+static CorrelateFunc correlateFunc()
+{
+    // the same instruction set as software volume, detected once
+    switch (AudioVolume::bestIsa()) {
+#if AUDIO_AVX2
+    case AudioVolume::AVX2:
+        return correlate_avx2;
+#elif AUDIO_SSE2
+    case AudioVolume::AVX2:
+        return correlate_sse2;
+#endif
+#if AUDIO_SSE2
+    case AudioVolume::SSE2:
+        return correlate_sse2;
+#endif
+#if AUDIO_NEON
+    case AudioVolume::NEON:
+        return correlate_neon;
+#endif
+    default:
+        return correlate_c;
+    }
+}
+
+template<typename T> float toFloat(T v);
+template<> inline float toFloat<quint8>(quint8 v) { return float(int(v) - 128)*(1.0f/128.0f);}
+template<> inline float toFloat<qint16>(qint16 v) { return float(v)*(1.0f/32768.0f);}
+template<> inline float toFloat<qint32>(qint32 v) { return float(v)*(1.0f/2147483648.0f);}
+template<> inline float toFloat<float>(float v) { return v;}
+template<> inline float toFloat<double>(double v) { return float(v);}
+
+template<typename T> T fromFloat(float v);
+template<> inline quint8 fromFloat<quint8>(float v) { return quint8(lrintf(clampf(v*128.0f, -128.0f, 127.0f)) + 128);}
+template<> inline qint16 fromFloat<qint16>(float v) { return qint16(lrintf(clampf(v*32768.0f, -32768.0f, 32767.0f)));}
+template<> inline qint32 fromFloat<qint32>(float v) { return qint32(lrintf(clampf(v*2147483648.0f, -2147483648.0f, kMaxS32f)));}
+template<> inline float fromFloat<float>(float v) { return v;}
+template<> inline double fromFloat<double>(float v) { return v;}
+
+// planar data is stored plane after plane
+template<typename T>
+void readSamples(const quint8 *data, int frames, int channels, bool planar, float *dst)
+{
+    const T *src = (const T*)data;
+    if (!planar) {
+        for (int i = 0; i < frames*channels; ++i)
+            dst[i] = toFloat<T>(src[i]);
+        return;
+    }
+    for (int c = 0; c < channels; ++c, src += frames) {
+        for (int i = 0; i < frames; ++i)
+            dst[i*channels + c] = toFloat<T>(src[i]);
+    }
+}
+
+template<typename T>
+void writeSamples(const float *src, int frames, int channels, bool planar, quint8 *data)
+{
+    T *dst = (T*)data;
+    if (!planar) {
+        for (int i = 0; i < frames*channels; ++i)
+            dst[i] = fromFloat<T>(src[i]);
+        return;
+    }
+    for (int c = 0; c < channels; ++c, dst += frames) {
+        for (int i = 0; i < frames; ++i)
+            dst[i] = fromFloat<T>(src[i*channels + c]);
+    }
+}
+
+typedef void (*ReadFunc)(const quint8*, int, int, bool, float*);
+typedef void (*WriteFunc)(const float*, int, int, bool, quint8*);
+
+static const ReadFunc kRead[] = { readSamples<quint8>, readSamples<qint16>, readSamples<qint32>, readSamples<float>, readSamples<double> };
+static const WriteFunc kWrite[] = { writeSamples<quint8>, writeSamples<qint16>, writeSamples<qint32>, writeSamples<float>, writeSamples<double> };
+} //namespace
+
+AudioTimeStretch::AudioTimeStretch()
+    : m_speed(1.0)
+    , m_channels(0)
+    , m_window(0)
+    , m_hop(0)
+    , m_search(0)
+    , m_step(1)
+    , m_prev(0)
+    , m_pos(0)
+{
+}
+
+void AudioTimeStretch::setFormat(const AudioFormat &format)
+{
+    if (m_format == format)
+        return;
+    m_format = format;
+    m_channels = 0;
+    m_in.clear();
+    if (!format.isValid() || AudioSample::typeIndex(format.sampleFormat()) < 0)
+        return;
+    m_channels = format.channels();
+    const int rate = format.sampleRate();
+    m_hop = qMax(rate*WindowMs/2000, 1);
+    m_window = 2*m_hop;
+    m_search = rate*SearchMs/1000;
+    // correlation peaks of the lower frequencies are found by a coarse search at about 12kHz, then refined
+    m_step = qMax(rate/12000, 1);
+    m_hann.resize(m_window);
+    for (int i = 0; i < m_window; ++i)
+        m_hann[i] = float(0.5 - 0.5*cos(2.0*kPi*double(i)/double(m_window))); // periodic: w[i] + w[i+hop] = 1
+    clear();
+}
+
+void AudioTimeStretch::setSpeed(qreal value)
+{
+    if (value <= 0)
+        return;
+    m_speed = value;
+}
+
+void AudioTimeStretch::clear()
+{
+    m_in.clear();
+    m_prev = -m_hop;
+    m_pos = 0;
+}
+
+int AudioTimeStretch::pendingFrames() const
+{
+    if (m_channels <= 0 || m_in.empty())
+        return 0;
+    return int(m_in.size())/m_channels - (m_prev + m_hop);
+}
+
+int AudioTimeStretch::search(int target, int from, int to) const
+{
+    static const CorrelateFunc correlate = correlateFunc();
+    const int n = m_hop*m_channels;
+    const float *t = &m_in[target*m_channels];
+    int best = from;
+    float best_score = -1e30f;
+    int lo = from, hi = to, step = m_step;
+    // coarse search, then around the best coarse candidate
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int i = lo; i <= hi; i += step) {
+            float xy = 0, yy = 0;
+            correlate(t, &m_in[i*m_channels], n, &xy, &yy);
+            // sign(xy)*xy^2/yy is monotonic to the normalized correlation
+            const float score = xy*qAbs(xy)/(yy + 1e-9f);
+            if (score > best_score) {
+                best_score = score;
+                best = i;
+            }
+        }
+        if (step == 1)
+            break;
+        lo = qMax(from, best - step + 1);
+        hi = qMin(to, best + step - 1);
+        step = 1;
+    }
+    return best;
+}
+
+void AudioTimeStretch::appendInput(const QByteArray &data)
+{
+    const int frames = data.size()/m_format.bytesPerFrame();
+    if (frames <= 0)
+        return;
+    const size_t size = m_in.size();
+    m_in.resize(size + frames*m_channels);
+    kRead[AudioSample::typeIndex(m_format.sampleFormat())]((const quint8*)data.constData(), frames, m_channels, m_format.isPlanar(), &m_in[size]);
+}
+
+QByteArray AudioTimeStretch::output(const float *data, int frames) const
+{
+    QByteArray out(frames*m_format.bytesPerFrame(), Qt::Uninitialized);
+    if (frames > 0)
+        kWrite[AudioSample::typeIndex(m_format.sampleFormat())](data, frames, m_channels, m_format.isPlanar(), (quint8*)out.data());
+    return out;
+}
+
+QByteArray AudioTimeStretch::process(const QByteArray &data)
+{
+    if (m_channels <= 0 || !isActive())
+        return data;
+    appendInput(data);
+    const int frames = int(m_in.size())/m_channels;
+    const int target = m_prev + m_hop;
+    if (m_speed == 1.0) {
+        // the previous window faded out + the natural continuation faded in == input. so just flush from target
+        const QByteArray out(target < frames ? output(m_in.data() + target*m_channels, frames - target) : QByteArray());
+        clear();
+        return out;
+    }
+    m_out.clear();
+    int out_frames = 0;
+    for (;;) {
+        const int t = m_prev + m_hop;
+        const int p = int(floor(m_pos + 0.5));
+        const int from = qMax(p - m_search, 0);
+        const int to = p + m_search;
+        if (qMax(to, t) + m_window > frames)
+            break;
+        const int best = search(t, from, to);
+        m_out.resize((out_frames + m_hop)*m_channels);
+        float *dst = &m_out[out_frames*m_channels];
+        const float *a = &m_in[t*m_channels]; // 2nd half of the previous window
+        const float *b = &m_in[best*m_channels];
+        for (int i = 0; i < m_hop; ++i) {
+            const float wa = m_hann[m_hop + i], wb = m_hann[i];
+            for (int c = 0; c < m_channels; ++c)
+                dst[i*m_channels + c] = a[i*m_channels + c]*wa + b[i*m_channels + c]*wb;
+        }
+        out_frames += m_hop;
+        m_prev = best;
+        m_pos += double(m_hop)*m_speed;
+    }
+    // drop input no longer reachable by target or search
+    const int base = qMin(m_prev + m_hop, int(floor(m_pos + 0.5)) - m_search);
+    if (base > 0) {
+        m_in.erase(m_in.begin(), m_in.begin() + base*m_channels);
+        m_prev -= base;
+        m_pos -= base;
+    }
+    return output(m_out.empty() ? 0 : &m_out[0], out_frames);
+}
+} //namespace QtAV
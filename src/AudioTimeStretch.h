@@ -0,0 +1,81 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef QTAV_AUDIOTIMESTRETCH_H
+#define QTAV_AUDIOTIMESTRETCH_H
+
+#include <vector>
+#include <QtCore/QByteArray>
+#include "QtAV/AudioFormat.h"
+
+namespace QtAV {
+/*
+ * Pitch preserving time stretch (WSOLA). Windows of WindowMs are overlap-added with 50% overlap, and each window
+ * is taken from the input position of the current speed within +-SearchMs where it correlates best with the
+ * natural continuation of the previous one. Samples are processed as interleaved float, the correlation search
+ * uses AVX2, SSE2 or NEON if available.
+ * Speed can be changed at any time without a reset. If speed is 1, the pending input is flushed and data passes
+ * through untouched.
+ */
+class Q_AV_PRIVATE_EXPORT AudioTimeStretch
+{
+public:
+    enum { WindowMs = 20, SearchMs = 8 };
+    AudioTimeStretch();
+    /// clear() if format changes. only sample formats supported by AudioFormat are accepted, packed or planar
+    void setFormat(const AudioFormat& format);
+    const AudioFormat& format() const { return m_format;}
+    /// > 0. takes effect in the next process()
+    void setSpeed(qreal value);
+    qreal speed() const { return m_speed;}
+    /// true if process() stretches data or has pending input to flush
+    bool isActive() const { return m_speed != 1.0 || !m_in.empty();}
+    /// drop pending input, e.g. after seeking
+    void clear();
+    /// input frames received but not in the output yet
+    int pendingFrames() const;
+    /*!
+     * \brief process
+     * Append data in format() and return the stretched output in format(). Output duration is about input
+     * duration/speed, but delayed by pendingFrames().
+     */
+    QByteArray process(const QByteArray& data);
+private:
+    int search(int target, int from, int to) const;
+    void appendInput(const QByteArray& data);
+    QByteArray output(const float* data, int frames) const;
+
+    AudioFormat m_format;
+    qreal m_speed;
+    int m_channels;
+    int m_window; // frames
+    int m_hop; // m_window/2
+    int m_search;
+    int m_step; // coarse search step
+    std::vector<float> m_hann;
+    std::vector<float> m_in; // interleaved
+    std::vector<float> m_out;
+    // start frame of the previous window in m_in, -m_hop if none. the output continues from m_prev + m_hop
+    int m_prev;
+    double m_pos; // nominal start frame of the next window
+};
+} //namespace QtAV
+#endif //QTAV_AUDIOTIMESTRETCH_H
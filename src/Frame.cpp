@@ -200,6 +200,29 @@ void Frame::setMetaData(const QString &key, const QVariant &value)
         d->metadata.remove(key);
 }
 
+/*!
+    Returns the typed data in slot \a type.
+ */
+FrameSideDataPtr Frame::sideData(SideDataType type) const
+{
+    Q_D(const Frame);
+    if (type < 0 || type >= SideDataCount)
+        return FrameSideDataPtr();
+    return d->side_data[type];
+}
+
+/*!
+    Sets the typed data in slot \a type to \a data, which is shared by copies of this frame.
+    A null \a data clears the slot.
+ */
+void Frame::setSideData(SideDataType type, const FrameSideDataPtr &data)
+{
+    Q_D(Frame);
+    if (type < 0 || type >= SideDataCount)
+        return;
+    d->side_data[type] = data;
+}
+
 qreal Frame::timestamp() const
 {
     return d_func()->timestamp;
@@ -110,6 +110,16 @@ public:
     // FIXME: why match to the pure virtual one if not declare here?
     bool convert(const quint8 *const src[], const int srcStride[]) Q_DECL_OVERRIDE { return ImageConverter::convert(src, srcStride);}
     bool convert(const quint8 *const src[], const int srcStride[], quint8 *const dst[], const int dstStride[]) Q_DECL_OVERRIDE;
+    /*!
+     * \brief setThreads
+     * If input and output heights are equal and so are the chroma heights (e.g. yuv420p => nv12, yuv422p => rgb32),
+     * the image is split into horizontal bands converted in parallel on the shared WorkPool, 1 SwsContext per band.
+     * Vertical scaling or chroma resampling (e.g. yuv420p => rgb32) needs lines of the neighbour bands, so it is done
+     * by 1 context.
+     * 0 (default): depends on frame size, about 1 band per 1M pixels. 1: convert in the calling thread
+     */
+    void setThreads(int value);
+    int threads() const;
 };
 typedef ImageConverterFF ImageConverterSWS;
 
@@ -20,10 +20,13 @@
 ******************************************************************************/
 
 #include "ImageConverter.h"
+#include <QtCore/QVarLengthArray>
 #include "ImageConverter_p.h"
 #include "QtAV/private/AVCompat.h"
 #include "QtAV/private/mkid.h"
 #include "QtAV/private/factory.h"
+#include "utils/SwsContextCache.h"
+#include "utils/WorkPool.h"
 #include "utils/Logger.h"
 
 namespace QtAV {
@@ -33,22 +36,69 @@ FACTORY_REGISTER(ImageConverter, FF, "FFmpeg")
 class ImageConverterFFPrivate Q_DECL_FINAL: public ImageConverterPrivate
 {
 public:
+    enum {
+        PixelsPerBand = 1 << 20, // auto threads
+        MinBandHeight = 16
+    };
     ImageConverterFFPrivate()
-        : sws_ctx(0)
-        , update_eq(true)
+        : threads(0)
+        , reserved(0)
     {}
     ~ImageConverterFFPrivate() {
-        if (sws_ctx) {
-            sws_freeContext(sws_ctx);
-            sws_ctx = 0;
-        }
+        SwsContextCache::instance().reserve(-reserved);
+    }
+    // contexts used at once are reserved in the shared cache, so converters do not evict each other's bands
+    void reserveContexts(int n) {
+        if (n == reserved)
+            return;
+        SwsContextCache::instance().reserve(n - reserved);
+        reserved = n;
     }
-    virtual bool setupColorspaceDetails(bool force = true) Q_DECL_FINAL;
+    // contexts are from the shared SwsContextCache, so the color details are part of the key
+    SwsContextCache::Key contextKey(int in_height, int out_height) const {
+        SwsContextCache::Key k;
+        k.w_in = w_in;
+        k.h_in = in_height;
+        k.fmt_in = fmt_in;
+        k.w_out = w_out;
+        k.h_out = out_height;
+        k.fmt_out = fmt_out;
+        k.flags = (w_in == w_out && k.h_in == k.h_out) ? SWS_POINT : SWS_FAST_BILINEAR; //SWS_BICUBIC
+        k.range_in = range_in == ColorRange_Limited ? 0 : 1;
+        k.range_out = range_out == ColorRange_Limited ? 0 : 1;
+        k.colorspace = SWS_CS_DEFAULT; // TODO: color space
+        k.brightness = brightness;
+        k.contrast = contrast;
+        k.saturation = saturation;
+        return k;
+    }
+    // 1 if bands are not used
+    int bandCount() const;
+    bool convertBands(int bands, const quint8 *const src[], const int srcStride[], quint8 *const dst[], const int dstStride[]);
+    // sws_scale() bands in parallel
+    bool scaleBands(int band_h, SwsContext *const ctx[], int bands, const quint8 *const src[], const int srcStride[], quint8 *const dst[], const int dstStride[]);
 
-    SwsContext *sws_ctx;
-    bool update_eq;
+    int threads;
+    int reserved;
 };
 
+namespace {
+// planes passed to sws_scale. the palette is the last one
+int swsPlaneCount(const AVPixFmtDescriptor *desc, AVPixelFormat fmt)
+{
+    return qMax(av_pix_fmt_count_planes(fmt), 0) + ((desc->flags & AV_PIX_FMT_FLAG_PAL) ? 1 : 0);
+}
+
+// offset of line y in plane. the palette is not offset
+int lineOffset(const AVPixFmtDescriptor *desc, int plane, int y, int stride)
+{
+    if (plane > 0 && (desc->flags & AV_PIX_FMT_FLAG_PAL))
+        return 0;
+    const int shift = (plane == 1 || plane == 2) ? desc->log2_chroma_h : 0;
+    return (y >> shift)*stride;
+}
+} //namespace
+
 ImageConverterFF::ImageConverterFF()
     :ImageConverter(*new ImageConverterFFPrivate())
 {
@@ -79,19 +129,25 @@ bool ImageConverterFF::convert(const quint8 *const src[], const int srcStride[],
             return false;
         setOutSize(d.w_in, d.h_in);
     }
-//TODO: move those code to prepare()
-    d.sws_ctx = sws_getCachedContext(d.sws_ctx
-            , d.w_in, d.h_in, (AVPixelFormat)d.fmt_in
-            , d.w_out, d.h_out, (AVPixelFormat)d.fmt_out
-            , (d.w_in == d.w_out && d.h_in == d.h_out) ? SWS_POINT : SWS_FAST_BILINEAR //SWS_BICUBIC
-            , NULL, NULL, NULL
-            );
+    const int bands = d.bandCount();
+    d.reserveContexts(bands);
+    if (bands > 1) {
+        if (!d.convertBands(bands, src, srcStride, dst, dstStride))
+            return false;
+        for (int i = 0; i < d.pitchs.size(); ++i) {
+            d.bits[i] = dst[i];
+            d.pitchs[i] = dstStride[i];
+        }
+        return true;
+    }
     //int64_t flags = SWS_CPU_CAPS_SSE2 | SWS_CPU_CAPS_MMX | SWS_CPU_CAPS_MMX2;
     //av_opt_set_int(d.sws_ctx, "sws_flags", flags, 0);
-    if (!d.sws_ctx)
+    const SwsContextCache::Key key(d.contextKey(d.h_in, d.h_out));
+    SwsContext *ctx = SwsContextCache::instance().checkout(key);
+    if (!ctx)
         return false;
-    d.setupColorspaceDetails(false);
-    int result_h = sws_scale(d.sws_ctx, src, srcStride, 0, d.h_in, dst, dstStride);
+    int result_h = sws_scale(ctx, src, srcStride, 0, d.h_in, dst, dstStride);
+    SwsContextCache::instance().checkin(key, ctx);
     if (result_h != d.h_out) {
         qDebug("convert failed: %d, %d", result_h, d.h_out);
         return false;
@@ -104,30 +160,81 @@ bool ImageConverterFF::convert(const quint8 *const src[], const int srcStride[],
     return true;
 }
 
-bool ImageConverterFFPrivate::setupColorspaceDetails(bool force)
+void ImageConverterFF::setThreads(int value)
 {
-    if (!sws_ctx) {
-        update_eq = true;
+    d_func().threads = qMax(value, 0);
+}
+
+int ImageConverterFF::threads() const
+{
+    return d_func().threads;
+}
+
+int ImageConverterFFPrivate::bandCount() const
+{
+    if (threads == 1 || h_in != h_out || h_out < 2*MinBandHeight)
+        return 1;
+    // a band's context sees only the band's source lines. vertical chroma up or down sampling filters the
+    // neighbour lines, so bands would show seams. the same chroma height needs no vertical filter
+    const AVPixFmtDescriptor *desc_in = av_pix_fmt_desc_get(fmt_in);
+    const AVPixFmtDescriptor *desc_out = av_pix_fmt_desc_get(fmt_out);
+    if (!desc_in || !desc_out || desc_in->log2_chroma_h != desc_out->log2_chroma_h)
+        return 1;
+    int n = threads;
+    if (n <= 0)
+        n = qMin((w_out*h_out + PixelsPerBand/2)/PixelsPerBand, WorkPool::instance().threadCount());
+    return qBound(1, n, h_out/MinBandHeight);
+}
+
+bool ImageConverterFFPrivate::convertBands(int bands, const quint8 *const src[], const int srcStride[], quint8 *const dst[], const int dstStride[])
+{
+    const AVPixFmtDescriptor *desc_in = av_pix_fmt_desc_get(fmt_in);
+    const AVPixFmtDescriptor *desc_out = av_pix_fmt_desc_get(fmt_out);
+    if (!desc_in || !desc_out)
         return false;
+    // a band starts at a chroma line
+    const int align = 1 << qMax(desc_in->log2_chroma_h, desc_out->log2_chroma_h);
+    const int band_h = FFALIGN((h_out + bands - 1)/bands, align);
+    bands = (h_out + band_h - 1)/band_h;
+    SwsContextCache &cache = SwsContextCache::instance();
+    QVarLengthArray<SwsContext*, 16> ctx(bands);
+    bool ok = true;
+    for (int i = 0; i < bands; ++i) {
+        const int h = qMin(band_h, h_out - i*band_h);
+        ctx[i] = cache.checkout(contextKey(h, h));
+        ok = ok && ctx[i];
     }
-    if (force)
-        update_eq = true;
-    if (!update_eq) {
-        return true;
+    if (ok)
+        ok = scaleBands(band_h, ctx.constData(), bands, src, srcStride, dst, dstStride);
+    for (int i = 0; i < bands; ++i) {
+        const int h = qMin(band_h, h_out - i*band_h);
+        cache.checkin(contextKey(h, h), ctx[i]);
     }
-    const int srcRange = range_in == ColorRange_Limited ? 0 : 1;
-    int dstRange = range_out == ColorRange_Limited ? 0 : 1;
-    // TODO: color space
-    bool supported = sws_setColorspaceDetails(sws_ctx, sws_getCoefficients(SWS_CS_DEFAULT)
-                             , srcRange, sws_getCoefficients(SWS_CS_DEFAULT)
-                             , dstRange
-                             , ((brightness << 16) + 50)/100
-                             , (((contrast + 100) << 16) + 50)/100
-                             , (((saturation + 100) << 16) + 50)/100
-                             ) >= 0;
-    //sws_init_context(d.sws_ctx, NULL, NULL);
-    update_eq = false;
-    return supported;
+    if (!ok)
+        qDebug("convert bands failed");
+    return ok;
+}
+
+bool ImageConverterFFPrivate::scaleBands(int band_h, SwsContext *const ctx[], int bands, const quint8 *const src[], const int srcStride[], quint8 *const dst[], const int dstStride[])
+{
+    const AVPixFmtDescriptor *desc_in = av_pix_fmt_desc_get(fmt_in);
+    const AVPixFmtDescriptor *desc_out = av_pix_fmt_desc_get(fmt_out);
+    const int nb_in = qMin(swsPlaneCount(desc_in, fmt_in), 4);
+    const int nb_out = qMin(swsPlaneCount(desc_out, fmt_out), 4);
+    std::atomic<bool> ok(true);
+    WorkPool::instance().parallelFor(bands, [&](int i) {
+        const int y = i*band_h;
+        const int h = qMin(band_h, h_out - y);
+        const quint8 *s[4] = {0};
+        quint8 *o[4] = {0};
+        for (int p = 0; p < nb_in; ++p)
+            s[p] = src[p] ? src[p] + lineOffset(desc_in, p, y, srcStride[p]) : 0;
+        for (int p = 0; p < nb_out; ++p)
+            o[p] = dst[p] ? dst[p] + lineOffset(desc_out, p, y, dstStride[p]) : 0;
+        if (sws_scale(ctx[i], s, srcStride, 0, h, o, dstStride) != h)
+            ok = false;
+    });
+    return ok;
 }
 
 } //namespace QtAV
@@ -0,0 +1,189 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include "KeyFrameIndex.h"
+#include "QtAV/private/AVCompat.h"
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDataStream>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QStringList>
+#include <algorithm>
+#include "utils/Logger.h"
+
+namespace QtAV {
+static const quint32 kMagic = 0x514b4649; // QKFI
+static const quint32 kVersion = 2;
+
+bool KeyFrameIndex::isRequired(const AVInputFormat *fmt)
+{
+    if (!fmt || !fmt->name)
+        return false;
+    static const QStringList names = QStringList()
+            << QStringLiteral("mpegts") << QStringLiteral("mpeg") << QStringLiteral("mpegvideo")
+            << QStringLiteral("h264") << QStringLiteral("hevc");
+    // name can be a comma separated list
+    const QStringList fmts(QString::fromLatin1(fmt->name).split(QLatin1Char(',')));
+    foreach (const QString& f, fmts) {
+        if (names.contains(f))
+            return true;
+    }
+    return false;
+}
+
+QString KeyFrameIndex::sidecarPath(const QString &mediaFile)
+{
+    // not next to the media: it may be read only or shared
+    const QString dir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
+    if (dir.isEmpty())
+        return QString();
+    const QByteArray key(QCryptographicHash::hash(QFileInfo(mediaFile).absoluteFilePath().toUtf8(), QCryptographicHash::Sha1).toHex());
+    return dir + QStringLiteral("/kfi/") + QString::fromLatin1(key) + QStringLiteral(".kfi");
+}
+
+const KeyFrameIndex::Entry* KeyFrameIndex::find(qint64 ts, bool backward) const
+{
+    if (!backward) {
+        auto it = std::lower_bound(m_entries.cbegin(), m_entries.cend(), ts, [](const Entry& e, qint64 t) {
+            return e.ts < t;
+        });
+        if (it == m_entries.cend())
+            return 0;
+        return &*it;
+    }
+    auto it = std::upper_bound(m_entries.cbegin(), m_entries.cend(), ts, [](qint64 t, const Entry& e) {
+        return t < e.ts;
+    });
+    if (it == m_entries.cbegin())
+        return 0;
+    return &*(it - 1);
+}
+
+bool KeyFrameIndex::load(const QString &mediaFile)
+{
+    clear();
+    const QFileInfo fi(mediaFile);
+    QFile f(sidecarPath(mediaFile));
+    if (!fi.isFile() || !f.open(QIODevice::ReadOnly))
+        return false;
+    QDataStream ds(&f);
+    quint32 magic = 0, version = 0, count = 0;
+    qint64 size = 0, mtime = 0;
+    bool complete = false;
+    ds >> magic >> version >> size >> mtime >> complete >> count;
+    if (magic != kMagic || version != kVersion)
+        return false;
+    if (size != fi.size() || mtime != fi.lastModified().toMSecsSinceEpoch()) {
+        qDebug("KeyFrameIndex: outdated index %s", qPrintable(f.fileName()));
+        return false;
+    }
+    if (qint64(count)*2*sizeof(qint64) > quint64(f.size()))
+        return false;
+    m_entries.resize(count);
+    for (Entry& e : m_entries)
+        ds >> e.ts >> e.pos;
+    if (ds.status() != QDataStream::Ok) {
+        m_entries.clear();
+        return false;
+    }
+    m_complete = complete;
+    return !m_entries.empty();
+}
+
+bool KeyFrameIndex::save(const QString &mediaFile) const
+{
+    const QFileInfo fi(mediaFile);
+    const QString path(sidecarPath(mediaFile));
+    if (path.isEmpty() || !QDir().mkpath(QFileInfo(path).absolutePath()))
+        return false;
+    QSaveFile f(path);
+    if (!f.open(QIODevice::WriteOnly)) {
+        qDebug("KeyFrameIndex: can not write %s", qPrintable(f.fileName()));
+        return false;
+    }
+    QDataStream ds(&f);
+    ds << kMagic << kVersion << fi.size() << fi.lastModified().toMSecsSinceEpoch() << m_complete << quint32(m_entries.size());
+    for (const Entry& e : m_entries)
+        ds << e.ts << e.pos;
+    return f.commit();
+}
+
+static int interrupted(void* opaque)
+{
+    return static_cast<const std::atomic<bool>*>(opaque)->load() ? 1 : 0;
+}
+
+bool KeyFrameIndex::build(const QString &mediaFile, const std::atomic<bool> &stop)
+{
+    if (m_complete)
+        clear();
+    AVFormatContext *ic = avformat_alloc_context();
+    // the same timestamps as AVDemuxer
+    ic->flags |= AVFMT_FLAG_GENPTS;
+    ic->interrupt_callback.callback = interrupted;
+    ic->interrupt_callback.opaque = const_cast<std::atomic<bool>*>(&stop);
+    if (avformat_open_input(&ic, mediaFile.toUtf8().constData(), NULL, NULL) < 0) // ic is freed
+        return false;
+    bool ok = false;
+    if (avformat_find_stream_info(ic, NULL) >= 0) {
+        const int vs = av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+        if (vs >= 0) {
+            for (unsigned i = 0; i < ic->nb_streams; ++i) {
+                if (int(i) != vs)
+                    ic->streams[i]->discard = AVDISCARD_ALL;
+            }
+            // continue at the last key frame, it is skipped below because its ts is not greater.
+            // generated timestamps restart after a byte seek
+            if (!m_entries.empty() && ((ic->iformat->flags & AVFMT_NOTIMESTAMPS)
+                                       || av_seek_frame(ic, -1, m_entries.back().pos, AVSEEK_FLAG_BYTE) < 0))
+                m_entries.clear();
+            const AVRational tb = ic->streams[vs]->time_base;
+            AVPacket *pkt = av_packet_alloc();
+            while (!stop && av_read_frame(ic, pkt) >= 0) {
+                if (pkt->stream_index == vs && (pkt->flags & AV_PKT_FLAG_KEY) && pkt->pos >= 0) {
+                    const int64_t t = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+                    if (t != AV_NOPTS_VALUE) {
+                        Entry e;
+                        e.ts = av_rescale_q(t, tb, av_get_time_base_q());
+                        e.pos = pkt->pos;
+                        // key frames after a timestamp discontinuity can not be found by time
+                        if (m_entries.empty() || e.ts > m_entries.back().ts)
+                            m_entries.push_back(e);
+                    }
+                }
+                av_packet_unref(pkt);
+            }
+            av_packet_free(&pkt);
+            ok = !stop && !m_entries.empty();
+        }
+    }
+    avformat_close_input(&ic);
+    m_complete = ok;
+    if (!ok && !stop) // an interrupted scan is continued by the next build()
+        m_entries.clear();
+    return ok;
+}
+
+} //namespace QtAV
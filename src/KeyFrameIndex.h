@@ -0,0 +1,80 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef QTAV_KEYFRAMEINDEX_H
+#define QTAV_KEYFRAMEINDEX_H
+
+#include <QtCore/QString>
+#include <atomic>
+#include <vector>
+
+struct AVInputFormat;
+
+namespace QtAV {
+
+/*
+ * Video key frame timestamps and byte positions of a local file without a container index
+ * (MPEG-TS/PS, raw H.264/HEVC). Built once by scanning the packets (no decoding) and stored in a
+ * sidecar file in the cache directory, which is valid as long as the media size and modification time match.
+ * An interrupted scan can be saved and continued from the last indexed key frame.
+ */
+class KeyFrameIndex
+{
+public:
+    typedef struct {
+        qint64 ts; // us, AV_TIME_BASE
+        qint64 pos; // byte position of the packet
+    } Entry;
+
+    /// true if seeking in the format requires a bitstream scan
+    static bool isRequired(const AVInputFormat* fmt);
+    /// in QStandardPaths::CacheLocation, named by the hash of the absolute media path. empty if no cache directory
+    static QString sidecarPath(const QString& mediaFile);
+    KeyFrameIndex() : m_complete(false) {}
+    bool isEmpty() const { return m_entries.empty(); }
+    /// false if the scan was interrupted. find() only covers the scanned part
+    bool isComplete() const { return m_complete; }
+    int size() const { return int(m_entries.size()); }
+    const std::vector<Entry>& entries() const { return m_entries; }
+    void clear() {
+        m_entries.clear();
+        m_complete = false;
+    }
+    /// key frame at or before ts if backward, otherwise at or after ts. null if there is none
+    const Entry* find(qint64 ts, bool backward = true) const;
+    /// false if the sidecar does not exist or is outdated. a partial index is loaded too, see isComplete()
+    bool load(const QString& mediaFile);
+    bool save(const QString& mediaFile) const;
+    /*!
+     * \brief build
+     * Read all packets of mediaFile in the calling thread. A partial index is continued from its last key frame,
+     * except if the format has no timestamps (they are generated from the start of the file).
+     * \param stop checked between packets and in blocking io. the entries found so far are kept
+     * \return false if interrupted or no video stream
+     */
+    bool build(const QString& mediaFile, const std::atomic<bool>& stop);
+private:
+    std::vector<Entry> m_entries; // sorted by ts
+    bool m_complete;
+};
+
+} //namespace QtAV
+#endif // QTAV_KEYFRAMEINDEX_H
@@ -21,8 +21,9 @@
 
 #include "QtAV/Packet.h"
 #include "QtAV/private/AVCompat.h"
+#include <mutex>
+#include <vector>
 #include "utils/Logger.h"
-#include "AVWrapper.h"
 
 namespace QtAV {
 namespace {
@@ -33,38 +34,117 @@ static const struct RegisterMetaTypes {
 } _registerMetaTypes;
 } //namespace
 
+typedef struct {
+    AVPacket *avpkt;
+    QByteArray raw; // header is reused by setRawData() if not shared
+} PacketSlot;
+
+/*
+ * Recycles PacketPrivate storage and packet slots. Packets are created in the demuxer thread and released
+ * in decoder threads, so the free lists are locked. Nothing is allocated once enough packets are in flight.
+ * Never destroyed because packets can be released after static destruction.
+ */
+class PacketPool
+{
+public:
+    static PacketPool& instance() {
+        static PacketPool *pool = new PacketPool();
+        return *pool;
+    }
+    void* allocate(size_t size) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_mem.empty()) {
+                void *p = m_mem.back();
+                m_mem.pop_back();
+                return p;
+            }
+        }
+        return ::operator new(size);
+    }
+    void deallocate(void* p) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_mem.size() < kMaxFree) {
+                m_mem.push_back(p);
+                return;
+            }
+        }
+        ::operator delete(p);
+    }
+    PacketSlot* acquire() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_slots.empty()) {
+                PacketSlot *s = m_slots.back();
+                m_slots.pop_back();
+                return s;
+            }
+        }
+        PacketSlot *s = new PacketSlot();
+        s->avpkt = av_packet_alloc();
+        return s;
+    }
+    void release(PacketSlot* s) {
+        av_packet_unref(s->avpkt);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_slots.size() < kMaxFree) {
+                m_slots.push_back(s);
+                return;
+            }
+        }
+        av_packet_free(&s->avpkt);
+        delete s;
+    }
+private:
+    enum { kMaxFree = 1024 };
+    PacketPool() {
+        m_mem.reserve(kMaxFree);
+        m_slots.reserve(kMaxFree);
+    }
+    std::mutex m_mutex;
+    std::vector<void*> m_mem;
+    std::vector<PacketSlot*> m_slots;
+};
+
 class PacketPrivate : public QSharedData
 {
 public:
     PacketPrivate()
         : QSharedData()
         , initialized(false)
+        , slot(PacketPool::instance().acquire())
     {
-        
     }
     PacketPrivate(const PacketPrivate& o)
         : QSharedData(o)
         , initialized(o.initialized)
+        , slot(PacketPool::instance().acquire())
     { //used by QSharedDataPointer.detach()
-        avpkt = o.avpkt;
+        av_packet_ref(slot->avpkt, o.slot->avpkt);
     }
-     ~PacketPrivate() {
-        
+    ~PacketPrivate() {
+        PacketPool::instance().release(slot);
     }
+    static void* operator new(size_t size) { return PacketPool::instance().allocate(size); }
+    static void operator delete(void* p) { PacketPool::instance().deallocate(p); }
+    AVPacket* avpkt() const { return slot->avpkt; }
+
     bool initialized;
-    Wrapper::AVPacketWrapper avpkt;
+    PacketSlot *slot;
 };
 
 Packet Packet::createEOF()
 {
     Packet pkt;
-    pkt.data = QByteArray("eof");
+    pkt.eof = true;
     return pkt;
 }
 
 bool Packet::isEOF() const
 {
-    return data == "eof" && pts < 0.0 && dts < 0.0;
+    return eof;
 }
 
 Packet Packet::fromAVPacket(const AVPacket *avpkt, double time_base)
@@ -76,11 +156,8 @@ Packet Packet::fromAVPacket(const AVPacket *avpkt, double time_base)
 }
 
 // time_base: av_q2d(format_context->streams[stream_idx]->time_base)
-bool Packet::fromAVPacket(Packet* pkt, const AVPacket *avpkt, double time_base)
+static void copyProperties(Packet* pkt, const AVPacket *avpkt, double time_base)
 {
-    if (!pkt || !avpkt)
-        return false;
-
     pkt->position = avpkt->pos;
     pkt->hasKeyFrame = !!(avpkt->flags & AV_PKT_FLAG_KEY);
     // what about marking avpkt as invalid and do not use isCorrupt?
@@ -120,15 +197,23 @@ bool Packet::fromAVPacket(Packet* pkt, const AVPacket *avpkt, double time_base)
         pkt->duration = avpkt->convergence_duration * time_base;
 #endif
     //qDebug("AVPacket.pts=%f, duration=%f, dts=%lld", pkt->pts, pkt->duration, packet.dts);
+}
+
+bool Packet::fromAVPacket(Packet* pkt, const AVPacket *avpkt, double time_base)
+{
+    if (!pkt || !avpkt)
+        return false;
+    copyProperties(pkt, avpkt, time_base);
     pkt->data.clear();
+    pkt->eof = false;
     // TODO: pkt->avpkt. data is not necessary now. see mpv new_demux_packet_from_avpacket
     // copy properties and side data. does not touch data, size and ref
     pkt->d = QSharedDataPointer<PacketPrivate>(new PacketPrivate());
     pkt->d->initialized = true;
-    AVPacket *p = &pkt->d->avpkt;
+    AVPacket *p = pkt->d->avpkt();
     av_packet_ref(p, (AVPacket*)avpkt);  //properties are copied internally
     // add ref without copy, bytearray does not copy either. bytearray options linke remove() is safe. omit FF_INPUT_BUFFER_PADDING_SIZE
-    pkt->data = QByteArray::fromRawData((const char*)p->data, p->size);
+    pkt->data = pkt->d->slot->raw.setRawData((const char*)p->data, p->size);
     // QtAV always use ms (1/1000s) and s. As a result no time_base is required in Packet
     p->pts = pkt->pts * 1000.0;
     p->dts = pkt->dts * 1000.0;
@@ -136,6 +221,28 @@ bool Packet::fromAVPacket(Packet* pkt, const AVPacket *avpkt, double time_base)
     return true;
 }
 
+Packet Packet::takeAVPacket(AVPacket *avpkt, double time_base)
+{
+    Packet pkt;
+    if (!avpkt)
+        return pkt;
+    if (!avpkt->buf) { // payload is not owned by avpkt, must be copied
+        fromAVPacket(&pkt, avpkt, time_base);
+        av_packet_unref(avpkt);
+        return pkt;
+    }
+    copyProperties(&pkt, avpkt, time_base);
+    pkt.d = QSharedDataPointer<PacketPrivate>(new PacketPrivate());
+    pkt.d->initialized = true;
+    AVPacket *p = pkt.d->avpkt();
+    av_packet_move_ref(p, avpkt);
+    pkt.data = pkt.d->slot->raw.setRawData((const char*)p->data, p->size);
+    p->pts = pkt.pts * 1000.0;
+    p->dts = pkt.dts * 1000.0;
+    p->duration = pkt.duration * 1000.0;
+    return pkt;
+}
+
 Packet::Packet()
     : hasKeyFrame(false)
     , isCorrupt(false)
@@ -143,10 +250,10 @@ Packet::Packet()
     , duration(-1)
     , dts(-1)
     , position(-1)
+    , eof(false)
 {
 }
 
-
 Packet::Packet(const Packet &other)
     : hasKeyFrame(other.hasKeyFrame)
     , isCorrupt(other.isCorrupt)
@@ -155,10 +262,24 @@ Packet::Packet(const Packet &other)
     , duration(other.duration)
     , dts(other.dts)
     , position(other.position)
+    , eof(other.eof)
     , d(other.d)
 {
 }
 
+Packet::Packet(Packet &&other) noexcept
+    : hasKeyFrame(other.hasKeyFrame)
+    , isCorrupt(other.isCorrupt)
+    , data(std::move(other.data))
+    , pts(other.pts)
+    , duration(other.duration)
+    , dts(other.dts)
+    , position(other.position)
+    , eof(other.eof)
+    , d(std::move(other.d))
+{
+}
+
 Packet& Packet::operator =(const Packet& other)
 {
     if (this == &other)
@@ -170,10 +291,27 @@ Packet& Packet::operator =(const Packet& other)
     duration = other.duration;
     dts = other.dts;
     position = other.position;
+    eof = other.eof;
     data = other.data;
     return *this;
 }
 
+Packet& Packet::operator =(Packet&& other) noexcept
+{
+    if (this == &other)
+        return *this;
+    d.swap(other.d);
+    data.swap(other.data);
+    hasKeyFrame = other.hasKeyFrame;
+    isCorrupt = other.isCorrupt;
+    pts = other.pts;
+    duration = other.duration;
+    dts = other.dts;
+    position = other.position;
+    eof = other.eof;
+    return *this;
+}
+
 Packet::~Packet()
 {
 }
@@ -182,16 +320,22 @@ const AVPacket *Packet::asAVPacket() const
 {
     if (d.constData()) { //why d->initialized (ref==1) result in detach?
         if (d.constData()->initialized) {//d.data() was 0 if d has not been accessed. now only contains avpkt, check d.constData() is engough
-            d->avpkt->data = (uint8_t*)data.constData();
-            d->avpkt->size = data.size();
-            return &d->avpkt;
+            // copies sharing d are used in other threads (decoder, record writers), so the shared AVPacket is never written.
+            // they have the same data unless skip() is called, which detaches
+            const AVPacket *p = d.constData()->avpkt();
+            if (p->data == (const uint8_t*)data.constData() && p->size == data.size())
+                return p;
+            AVPacket *dp = d->avpkt(); // detach
+            dp->data = (uint8_t*)data.constData();
+            dp->size = data.size();
+            return dp;
         }
     } else {
         d = QSharedDataPointer<PacketPrivate>(new PacketPrivate());
     }
 
     d->initialized = true;
-    AVPacket *p = &d->avpkt;
+    AVPacket *p = d->avpkt();
     p->pts = pts * 1000.0;
     p->dts = dts * 1000.0;
     p->duration = duration * 1000.0;
@@ -47,7 +47,7 @@ void PacketBuffer::setBufferMode(BufferMode mode)
         return;
     }
     if (m_mode == BufferTime) {
-        m_value0 = qint64(queue[0].pts*1000.0);
+        m_value0 = qint64(queue.head().pts*1000.0);
     } else {
         m_value0 = 0;
     }
@@ -84,8 +84,8 @@ qreal PacketBuffer::bufferMax() const
 
 qint64 PacketBuffer::buffered() const
 {
-    Q_ASSERT(m_value1 >= m_value0);
-    return m_value1 - m_value0;
+    // the 2 values are not read atomically together, so the difference can be negative for a moment
+    return qMax<qint64>(0, m_value1.load() - m_value0.load());
 }
 
 bool PacketBuffer::isBuffering() const
@@ -121,10 +121,10 @@ bool PacketBuffer::checkFull() const
 
 void PacketBuffer::onPut(const Packet &p)
 {
-	std::unique_lock<std::mutex> lck(m_mtx);
     if (m_mode == BufferTime) {
         m_value1 = qint64(p.pts*1000.0); // FIXME: what if no pts
-        m_value0 = qint64(queue[0].pts*1000.0); // must compute here because it is reset to 0 if take from empty
+        if (queue.size() == 1) // must compute here because it is reset to 0 if take from empty
+            m_value0 = m_value1.load();
         //if (isBuffering())
           //  qDebug("+buffering progress: %.1f%%=%.1f/%.1f~%.1fs %d-%d", bufferProgress()*100.0, (qreal)buffered()/1000.0, (qreal)bufferValue()/1000.0, qreal(bufferValue())*bufferMax()/1000.0, m_value1, m_value0);
     } else if (m_mode == BufferBytes) {
@@ -134,6 +134,7 @@ void PacketBuffer::onPut(const Packet &p)
     }
     if (!m_buffering)
         return;
+    std::lock_guard<std::mutex> lock(m_history_mtx);
     if (checkEnough()) {
         m_buffering = false;
     }
@@ -152,7 +153,6 @@ void PacketBuffer::onPut(const Packet &p)
 
 void PacketBuffer::onTake(const Packet &p)
 {
-	std::unique_lock<std::mutex> lck(m_mtx);
     if (checkEmpty()) {
         m_buffering = true;
     }
@@ -162,12 +162,11 @@ void PacketBuffer::onTake(const Packet &p)
         return;
     }
     if (m_mode == BufferTime) {
-        m_value0 = qint64(queue[0].pts*1000.0);
+        m_value0 = qint64(queue.head().pts*1000.0);
         //if (isBuffering())
           //  qDebug("-buffering progress: %.1f=%.1f/%.1fs", bufferProgress(), (qreal)buffered()/1000.0, (qreal)bufferValue()/1000.0);
     } else if (m_mode == BufferBytes) {
-        m_value1 -= p.data.size();
-        m_value1 = qMax<qint64>(0LL, m_value1);
+        m_value1 = qMax<qint64>(0LL, m_value1 - p.data.size());
     } else {
         m_value1--;
     }
@@ -175,7 +174,7 @@ void PacketBuffer::onTake(const Packet &p)
 
 qreal PacketBuffer::calc_speed(bool use_bytes) const
 {
-    std::unique_lock<std::mutex> lck(m_mtx);
+    std::lock_guard<std::mutex> lock(m_history_mtx);
     if (m_history.empty())
         return 0;
     const qreal dt = (double)QDateTime::currentMSecsSinceEpoch()/1000.0 - m_history.front().t/1000.0;
@@ -22,10 +22,10 @@
 #ifndef QTAV_PACKETBUFFER_H
 #define QTAV_PACKETBUFFER_H
 
-#include <QtCore/QQueue>
 #include <QtAV/Packet.h>
 #include "utils/BlockingQueue.h"
 #include "utils/ring.h"
+#include <atomic>
 #include <mutex>
 namespace QtAV {
 
@@ -34,8 +34,11 @@ namespace QtAV {
  * take enough: start to put more packets
  * put enough: end buffering, end take block
  * put full: stop putting more packets
+ *
+ * Buffered value is updated in onPut()/onTake() which are called with the queue locked. It is stored in atomics,
+ * so buffered(), bufferProgress() and isBuffering() can be called from any thread without locking.
  */
-class PacketBuffer : public BlockingQueue<Packet, QQueue>
+class PacketBuffer : public BlockingQueue<Packet, ring_queue>
 {
 public:
     PacketBuffer();
@@ -83,7 +86,7 @@ protected:
     void onTake(const Packet &) Q_DECL_OVERRIDE;
     void onPut(const Packet &) Q_DECL_OVERRIDE;
 protected:
-    typedef BlockingQueue<Packet, QQueue> PQ;
+    typedef BlockingQueue<Packet, ring_queue> PQ;
     using PQ::setCapacity;
     using PQ::setThreshold;
     using PQ::capacity;
@@ -93,19 +96,18 @@ private:
     qreal calc_speed(bool use_bytes) const;
 
     BufferMode m_mode;
-    bool m_buffering;
-    qreal m_max;
+    std::atomic<bool> m_buffering;
+    std::atomic<qreal> m_max;
     // bytes or count
-    qint64 m_buffer;
-    qint64 m_value0, m_value1;
+    std::atomic<qint64> m_buffer;
+    std::atomic<qint64> m_value0, m_value1;
     typedef struct {
         qint64 v; //pts, total packes or total bytes
         qint64 bytes; //total bytes
         qint64 t;
     } BufferInfo;
-    ring<BufferInfo> m_history;
-
-    mutable std::mutex m_mtx;
+    ring<BufferInfo> m_history; // only updated while buffering
+    mutable std::mutex m_history_mtx;
 };
 
 } //namespace QtAV
@@ -0,0 +1,171 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include "PreRecordBuffer.h"
+#include "QtAV/private/AVCompat.h"
+
+namespace QtAV {
+static const size_t kInitSlots = 64;
+// a larger gap between packets is a discontinuity, e.g. a live stream reopened after a long time
+static const qint64 kMaxGapUs = 10*1000000LL;
+
+PreRecordBuffer::PreRecordBuffer()
+    : m_max_ms(0)
+    , m_max_bytes(16*1024*1024)
+    , m_key_stream(-1)
+    , m_head(0)
+    , m_tail(0)
+    , m_bytes(0)
+{
+}
+
+PreRecordBuffer::~PreRecordBuffer()
+{
+    for (AVPacket* p : m_slots)
+        av_packet_free(&p);
+}
+
+void PreRecordBuffer::setLimits(qint64 ms, qint64 bytes)
+{
+    m_max_ms = qMax<qint64>(0, ms);
+    m_max_bytes = bytes;
+}
+
+void PreRecordBuffer::setKeyStream(int index)
+{
+    if (m_key_stream == index)
+        return;
+    m_key_stream = index;
+    clear();
+}
+
+void PreRecordBuffer::clear()
+{
+    for (; m_head < m_tail; ++m_head)
+        av_packet_unref(m_slots[slot(m_head)]);
+    m_head = m_tail = 0;
+    m_bytes = 0;
+    m_gops.clear();
+}
+
+void PreRecordBuffer::grow()
+{
+    const size_t n = m_slots.empty() ? kInitSlots : m_slots.size()*2;
+    std::vector<AVPacket*> slots(n, nullptr);
+    std::vector<qint64> ts(n, 0);
+    // keep sequence numbers, move valid packets to their new slots
+    for (quint64 i = m_head; i < m_tail; ++i) {
+        slots[size_t(i & (n - 1))] = m_slots[slot(i)];
+        ts[size_t(i & (n - 1))] = m_ts[slot(i)];
+        m_slots[slot(i)] = nullptr;
+    }
+    size_t spare = 0; // reuse free shells
+    for (AVPacket*& p : slots) {
+        if (p)
+            continue;
+        while (spare < m_slots.size() && !m_slots[spare])
+            ++spare;
+        if (spare < m_slots.size()) {
+            p = m_slots[spare];
+            m_slots[spare++] = nullptr;
+        } else {
+            p = av_packet_alloc();
+        }
+    }
+    m_slots.swap(slots);
+    m_ts.swap(ts);
+}
+
+void PreRecordBuffer::dropOldestGop()
+{
+    if (m_gops.empty())
+        return;
+    const quint64 end = m_gops.size() > 1 ? m_gops[1].first : m_tail;
+    for (; m_head < end; ++m_head)
+        av_packet_unref(m_slots[slot(m_head)]);
+    m_bytes -= m_gops.front().bytes;
+    m_gops.pop_front();
+    if (m_gops.empty()) {
+        m_head = m_tail = 0;
+        m_bytes = 0;
+    }
+}
+
+void PreRecordBuffer::push(const AVPacket *pkt, qint64 ts)
+{
+    if (!pkt || !pkt->data)
+        return;
+    const bool boundary = m_key_stream < 0
+            || (pkt->stream_index == m_key_stream && (pkt->flags & AV_PKT_FLAG_KEY));
+    if (m_tail > m_head) {
+        // timestamp discontinuity, durations are unknown and a recording must not start with a jump
+        const qint64 last = m_ts[slot(m_tail - 1)];
+        if ((boundary && ts < m_gops.back().ts) || ts - last > kMaxGapUs)
+            clear();
+    }
+    if (m_gops.empty() && !boundary) // always start at a key frame
+        return;
+    if (boundary) {
+        Gop g;
+        g.first = m_tail;
+        g.ts = ts;
+        g.bytes = 0;
+        m_gops.push_back(g);
+    }
+    if (size() >= (int)m_slots.size())
+        grow();
+    AVPacket *p = m_slots[slot(m_tail)];
+    if (av_packet_ref(p, pkt) < 0)
+        return;
+    m_ts[slot(m_tail)] = ts;
+    ++m_tail;
+    m_bytes += pkt->size;
+    m_gops.back().bytes += pkt->size;
+    if (boundary) {
+        // a new gop started. drop old gops if the newer ones still cover the duration
+        const qint64 max_us = m_max_ms*1000LL;
+        while (m_gops.size() > 1 && ts - m_gops[1].ts >= max_us)
+            dropOldestGop();
+    }
+    while (m_max_bytes > 0 && m_bytes > m_max_bytes) {
+        if (m_gops.size() == 1) { // a single gop is too large, wait for the next key frame
+            clear();
+            break;
+        }
+        dropOldestGop();
+    }
+}
+
+void PreRecordBuffer::forEach(qint64 ms, const std::function<void(const AVPacket*)>& f) const
+{
+    if (m_gops.empty())
+        return;
+    const qint64 newest = m_ts[slot(m_tail - 1)];
+    size_t g = m_gops.size() - 1;
+    if (ms > 0) {
+        while (g > 0 && newest - m_gops[g].ts < ms*1000LL)
+            --g;
+    }
+    for (quint64 i = m_gops[g].first; i < m_tail; ++i)
+        f(m_slots[slot(i)]);
+}
+
+} //namespace QtAV
@@ -0,0 +1,88 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef QTAV_PRERECORDBUFFER_H
+#define QTAV_PRERECORDBUFFER_H
+
+#include <QtCore/QtGlobal>
+#include <deque>
+#include <functional>
+#include <vector>
+
+struct AVPacket;
+
+namespace QtAV {
+
+/*
+ * Ring of refcounted packets of the last whole gops read by a demuxer, used for pre-event recording.
+ * Packet shells are allocated once and reused, payloads are only referenced.
+ * The ring always starts at a key frame of the key stream (video) and is trimmed by whole gops:
+ * the oldest gop is dropped as long as the remaining gops still cover the duration limit,
+ * or when the bytes limit is exceeded. The ring is reset on a timestamp discontinuity (backwards, or a gap
+ * of more than 10s). Not thread safe, used in demuxer thread only.
+ */
+class PreRecordBuffer
+{
+public:
+    PreRecordBuffer();
+    ~PreRecordBuffer();
+    /*!
+     * \param ms duration to keep. 0: only the current gop
+     * \param bytes max payload bytes. if the current gop is larger, the buffer is reset and waits for the next key frame
+     */
+    void setLimits(qint64 ms, qint64 bytes);
+    qint64 durationLimit() const { return m_max_ms; }
+    /// stream index whose key frames start a gop. <0: every packet starts a gop (audio only)
+    void setKeyStream(int index);
+    /// ts: timestamp in us
+    void push(const AVPacket* pkt, qint64 ts);
+    void clear();
+    /*!
+     * \brief forEach
+     * Call f for every buffered packet, starting from the latest gop which covers the last ms.
+     * \param ms <=0: the current gop only
+     */
+    void forEach(qint64 ms, const std::function<void(const AVPacket*)>& f) const;
+    int size() const { return int(m_tail - m_head); }
+    qint64 bytes() const { return m_bytes; }
+
+private:
+    typedef struct {
+        quint64 first; // sequence number of the key frame
+        qint64 ts;
+        qint64 bytes;
+    } Gop;
+    size_t slot(quint64 seq) const { return size_t(seq & (m_slots.size() - 1)); }
+    void grow();
+    void dropOldestGop();
+
+    qint64 m_max_ms;
+    qint64 m_max_bytes;
+    int m_key_stream;
+    std::vector<AVPacket*> m_slots; // power of 2 size
+    std::vector<qint64> m_ts;
+    quint64 m_head, m_tail; // sequence numbers, [m_head, m_tail) are valid
+    qint64 m_bytes;
+    std::deque<Gop> m_gops;
+};
+
+} //namespace QtAV
+#endif // QTAV_PRERECORDBUFFER_H
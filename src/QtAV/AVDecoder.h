@@ -76,7 +76,8 @@ public:
 
 Q_SIGNALS:
     void error(const QtAV::AVError& e, int ffmpegError=0, const QString& ffmpegErrorStr=""); //explictly use QtAV::AVError in connection for Qt4 syntax
-    void descriptionChanged();
+    /// emitted in the decoding thread, so description is built there
+    void descriptionChanged(const QString& description);
 protected:
     AVDecoder(AVDecoderPrivate& d);
     DPTR_DECLARE(AVDecoder)
@@ -28,6 +28,7 @@
 #include <QtCore/QObject>
 #include <QtCore/QScopedPointer>
 #include <QMutex>
+#include <atomic>
 
 struct AVFormatContext;
 struct AVCodecContext;
@@ -118,6 +119,28 @@ public:
      * TODO: what if duration() is not valid but size is known?
      */
     bool seek(qreal q);
+    /*!
+     * \brief setKeyFrameIndexEnabled
+     * Seeking in a local file without a container index (MPEG-TS/PS, raw H.264/HEVC) requires a bitstream scan.
+     * If enabled, the key frames are indexed in background after load() and the index is saved to the cache
+     * directory (QStandardPaths::CacheLocation). The index is reused while the file size and modification time
+     * do not change. An interrupted scan (e.g. unload() before it finished) is saved and continued by the next
+     * load(). Default is false.
+     * Applies to the next load().
+     */
+    void setKeyFrameIndexEnabled(bool value);
+    bool isKeyFrameIndexEnabled() const;
+    /*!
+     * \brief setStreamInfoCacheEnabled
+     * Opt-in. If enabled, the stream parameters probed by load() are cached by url, and the next load() of the same url
+     * (reconnect, channel switch) uses them and probes only the first packets. An entry is dropped if the streams or
+     * the parameters in the first packets are different, and the next load() probes again.
+     * Not used for MediaIO inputs. Default is false.
+     */
+    void setStreamInfoCacheEnabled(bool value);
+    bool isStreamInfoCacheEnabled() const;
+    /// remove the cached stream info of url, or of all urls if url is empty
+    static void clearStreamInfoCache(const QString& url = QString());
     AVFormatContext* formatContext();
     QString formatName() const;
     QString formatLongName() const;
@@ -200,6 +223,8 @@ Q_SIGNALS:
     void mediaStatusChanged(QtAV::MediaStatus status);
     void seekableChanged();
     void recordFinished(bool success, const QString& format);
+    // a segment file of a segmented recording is closed
+    void recordSegmentFinished(const QString& filePath, const QString& segmentFile);
 private:
     void setMediaStatus(MediaStatus status);
     // error code (errorCode) and message (msg) may be modified internally
@@ -211,21 +236,103 @@ private:
     friend class InterruptHandler;
 
 public:
-    bool startRecording(const QString& filePath, int duration = -1);
+    /*!
+     * \brief The RecordOverflowPolicy enum
+     * What to do when a recording destination can not keep up and its packet queue is full.
+     * RecordDropNewest: drop the incoming packet and resume video at the next key frame.
+     * RecordDropOldest: drop queued packets from the head, then skip to the next queued key frame.
+     * RecordBlock: block readFrame() until the writer catches up (bounded by the block timeout), then drop as RecordDropNewest.
+     */
+    enum RecordOverflowPolicy {
+        RecordDropNewest,
+        RecordDropOldest,
+        RecordBlock
+    };
+    class RecordStatistics {
+    public:
+        qint64 queuedPackets = 0;
+        qint64 queuedBytes = 0;
+        qint64 maxQueuedPackets = 0; // peak queue depth
+        qint64 writtenPackets = 0;
+        qint64 droppedPackets = 0;
+        qint64 lastWriteLatency = 0; // us
+        qint64 averageWriteLatency = 0; // us, moving average
+        qint64 maxWriteLatency = 0; // us
+    };
+    class RecordOptions {
+    public:
+        int duration = -1; // s. <=0: until stopRecording()
+        int preRecord = 0; // s. see startRecording()
+        // start a new file at the first key frame after segmentDuration (ms) or segmentSize (bytes). 0: disabled
+        // segment files are named filePath_00000.ext, filePath_00001.ext...
+        qint64 segmentDuration = 0;
+        qint64 segmentSize = 0;
+        QString format; // muxer/file extension, e.g. "mkv". empty: the first of mkv, mp4, avi, mov, flv which works
+        bool fragmented = false; // fragmented mp4, a fragment per key frame. format is mp4 if empty
+    };
+    /*!
+     * \brief startRecording
+     * Record (or restream if filePath is an udp url) the current video and audio stream.
+     * Packets are queued and muxed in a dedicated writer thread per destination, so slow storage
+     * or a stalled socket never blocks demuxing.
+     * \param duration in seconds. <=0: until stopRecording()
+     * \param preRecord include packets read in the last preRecord seconds (rounded to whole gops, limited by
+     * setPreRecordBuffer()). 0: only complete the current gop if recording does not start at a key frame
+     */
+    bool startRecording(const QString& filePath, int duration = -1, int preRecord = 0);
+    /*!
+     * Several recordings can run at the same time, all of them share the payload of demuxed packets.
+     */
+    bool startRecording(const QString& filePath, const RecordOptions& options);
     bool stopRecording(const QString &filePath = "");
+    QStringList recordings() const;
+    RecordStatistics recordStatistics(const QString& filePath) const;
+    /*!
+     * \brief setRecordQueueLimit
+     * Limit of queued packets per recording destination. Applies to new and running recordings.
+     * \param packets max queued packets. <=0: no limit
+     * \param bytes max queued bytes. <=0: no limit
+     */
+    void setRecordQueueLimit(int packets, qint64 bytes);
+    /*!
+     * \brief setPreRecordBuffer
+     * Keep whole gops of the last seconds read for pre-event recording. Packets are referenced, not copied.
+     * \param seconds 0 (default): only the current gop
+     * \param bytes max buffered payload bytes. <=0: no limit. default is 16MB
+     */
+    void setPreRecordBuffer(int seconds, qint64 bytes = 16*1024*1024);
+    int preRecordBufferDuration() const;
+    void setRecordOverflowPolicy(RecordOverflowPolicy policy);
+    RecordOverflowPolicy recordOverflowPolicy() const;
+    /*!
+     * \brief setRecordBlockTimeout
+     * Max time readFrame() waits for a full destination queue if RecordBlock policy is used. In ms.
+     */
+    void setRecordBlockTimeout(int ms);
+
+    // counters of packets read by readFrame(). bandwidth and frame sizes are in bytes
+    class TrafficStatistics {
+    public:
+        quint64 totalBandwidth = 0;
+        quint64 totalVideoBandwidth = 0;
+        quint64 totalAudioBandwidth = 0;
+        quint64 totalKeyFrameSize = 0;
+        quint64 totalPFrameSize = 0;
+        qint64 totalPackets = 0;
+        qint64 totalVideoPackets = 0;
+        qint64 totalAudioPackets = 0;
+        qint64 lostFrames = 0;
+    };
+    /*!
+     * \brief trafficStatistics
+     * A consistent snapshot of the traffic counters. Lock free, can be called in any thread.
+     * readFrame() never waits for readers.
+     */
+    TrafficStatistics trafficStatistics() const;
+    // input format name of the current stream, set when the first packet is read
+    QString containerFormat() const;
 
-    quint64 totalBandwidth = 0;
-    quint64 totalVideoBandwidth = 0;
-    quint64 totalAudioBandwidth = 0;
-    quint64 totalKeyFrameSize = 0;
-    quint64 totalPFrameSize = 0;
-    qint64 totalPackets = 0;
-    qint64 totalVideoPackets = 0;
-    qint64 totalAudioPackets = 0;
-    qint64 lostFrames = 0;
-    int audioStreamIndex = -1;
-    QString containerFormat;
-    QMutex mutex;
+    std::atomic<int> audioStreamIndex{-1};
     std::atomic<bool> resetValues{true};
 };
 
@@ -27,6 +27,7 @@
 #include <QtCore/QScopedPointer>
 #include <QtAV/AudioOutput.h>
 #include <QtAV/AVClock.h>
+#include <QtAV/AVDemuxer.h>
 #include <QtAV/Statistics.h>
 #include <QtAV/VideoDecoder.h>
 #include <QtAV/AVError.h>
@@ -65,6 +66,8 @@ class Q_AV_EXPORT AVPlayer : public QObject
     Q_PROPERTY(bool relativeTimeMode READ relativeTimeMode WRITE setRelativeTimeMode NOTIFY relativeTimeModeChanged)
     Q_PROPERTY(bool autoLoad READ isAutoLoad WRITE setAutoLoad NOTIFY autoLoadChanged)
     Q_PROPERTY(bool asyncLoad READ isAsyncLoad WRITE setAsyncLoad NOTIFY asyncLoadChanged)
+    Q_PROPERTY(bool keyFrameIndexEnabled READ isKeyFrameIndexEnabled WRITE setKeyFrameIndexEnabled NOTIFY keyFrameIndexEnabledChanged)
+    Q_PROPERTY(bool streamInfoCacheEnabled READ isStreamInfoCacheEnabled WRITE setStreamInfoCacheEnabled NOTIFY streamInfoCacheEnabledChanged)
     Q_PROPERTY(qreal bufferProgress READ bufferProgress NOTIFY bufferProgressChanged)
     Q_PROPERTY(bool seekable READ isSeekable NOTIFY seekableChanged)
     Q_PROPERTY(qint64 duration READ duration NOTIFY durationChanged)
@@ -140,6 +143,12 @@ public:
      */
     void setAsyncLoad(bool value = true);
     bool isAsyncLoad() const;
+    /// \sa AVDemuxer::setKeyFrameIndexEnabled()
+    void setKeyFrameIndexEnabled(bool value);
+    bool isKeyFrameIndexEnabled() const;
+    /// \sa AVDemuxer::setStreamInfoCacheEnabled()
+    void setStreamInfoCacheEnabled(bool value);
+    bool isStreamInfoCacheEnabled() const;
     /*!
      * \brief setAutoLoad
      * true: current media source changed immediatly and stop current playback if new media source is set.
@@ -341,6 +350,40 @@ public:
     qreal forcedFrameRate() const;
     void setRealtimeDecode(bool value);
     bool realtimeDecode() const;
+    /*!
+     * \brief setRealtimeTargetLatency
+     * Target duration of packets read but not decoded in realtime decode mode. Presentation is
+     * slightly (up to 5%) faster or slower to converge to it. Default is 150ms.
+     * Current value is Statistics::latency.
+     */
+    void setRealtimeTargetLatency(int ms);
+    int realtimeTargetLatency() const;
+    /*!
+     * \brief setSharedThreadPool
+     * Realtime decode mode only. If true, packets are decoded and presented by a task on a process wide
+     * pool with 1 thread per cpu core, instead of a dedicated thread per player. The demux thread only reads.
+     * Delivery to renderers and audio output may block, then a spare pool thread takes the place of the blocked
+     * one, so other players are not delayed.
+     * Use it for many players, e.g. a video wall. Default is false. Takes effect at the next playback.
+     */
+    void setSharedThreadPool(bool value);
+    bool sharedThreadPool() const;
+    /*!
+     * \brief setDecodedFrameQueueDepth
+     * Not used in realtime decode mode. If > 0, video frames are presented by another thread from a queue of
+     * at most value decoded frames, so decoding can run ahead of display and a slow frame (e.g. a key frame)
+     * does not delay presentation. 0: decode and present in the same thread. Default is 0.
+     * Takes effect at the next playback. Current size is Statistics::decodedFrames.
+     */
+    void setDecodedFrameQueueDepth(int value);
+    int decodedFrameQueueDepth() const;
+    /*!
+     * \brief setDecodeAhead
+     * How early a packet is decoded before its presentation time if decoded frame queue is enabled.
+     * Range is [0, 500]. Default is 100ms. Current value is Statistics::decodeAhead.
+     */
+    void setDecodeAhead(int ms);
+    int decodeAhead() const;
     //Statistics& statistics();
     const Statistics& statistics() const;
     /*!
@@ -409,6 +452,24 @@ public:
     QVariantHash optionsForAudioCodec() const;
     void setOptionsForVideoCodec(const QVariantHash& dict);
     QVariantHash optionsForVideoCodec() const;
+    /*!
+     * \brief setVideoDecoderThreadBudget
+     * Total number of threads of all FFmpeg software video decoders with automatic thread count ("threads" option is 0)
+     * in this process. Every decoder gets at least 1 thread, the rest is distributed by resolution, codec and importance,
+     * and is rebalanced when decoders are opened or closed, or the first frame gives the real size. A decoder applies a
+     * new allocation at the next key frame if it changes by 2 threads or more. The frames in flight are drained and
+     * output first, so no frame is dropped.
+     * The current allocation is in Statistics::video.decoder_detail.
+     * \param threads 0 (default): the number of cpu cores
+     */
+    static void setVideoDecoderThreadBudget(int threads);
+    static int videoDecoderThreadBudget();
+    /*!
+     * \brief setVideoDecoderImportance
+     * Weight of this player's video decoder in the thread budget, e.g. on-screen size or 0 if hidden. Default is 1.0
+     */
+    void setVideoDecoderImportance(qreal value);
+    qreal videoDecoderImportance() const;
 
     /*!
      * \brief mediaEndAction
@@ -431,8 +492,28 @@ public:
 
     void resetMediaData();
 
-    bool startRecording(const QString &filePath, int duration = -1);
+    /// \sa AVDemuxer::startRecording()
+    bool startRecording(const QString &filePath, int duration = -1, int preRecord = 0);
+    /*!
+     * \brief startRecording
+     * \param options keys are the same as AVDemuxer::RecordOptions members: duration, preRecord,
+     * segmentDuration, segmentSize, format, fragmented
+     */
+    bool startRecording(const QString &filePath, const QVariantMap& options);
     bool stopRecording();
+    /*!
+     * \brief recordStatistics
+     * Queue and writer statistics of a running recording. Keys: queuedPackets, queuedBytes, maxQueuedPackets,
+     * writtenPackets, droppedPackets, lastWriteLatency, averageWriteLatency, maxWriteLatency (latency in us)
+     */
+    QVariantMap recordStatistics(const QString& filePath) const;
+    /// \sa AVDemuxer::setRecordQueueLimit()
+    void setRecordQueueLimit(int packets, qint64 bytes);
+    /// \sa AVDemuxer::setPreRecordBuffer()
+    void setPreRecordBuffer(int seconds, qint64 bytes = 16*1024*1024);
+    /// \sa AVDemuxer::setRecordOverflowPolicy()
+    void setRecordOverflowPolicy(AVDemuxer::RecordOverflowPolicy policy);
+    AVDemuxer::RecordOverflowPolicy recordOverflowPolicy() const;
 
 public Q_SLOTS:
     /*!
@@ -578,6 +659,7 @@ Q_SIGNALS:
     void disconnectTimeoutChanged(int);
     void receivingFramesChanged(bool);
     void recordFinished(bool success, const QString& format);
+    void recordSegmentFinished(const QString& filePath, const QString& segmentFile);
     /*!
      * \brief durationChanged emit when media is loaded/unloaded
      */
@@ -608,6 +690,8 @@ Q_SIGNALS:
     void positionChanged(qint64 position);
     void interruptTimeoutChanged();
     void interruptOnTimeoutChanged();
+    void keyFrameIndexEnabledChanged();
+    void streamInfoCacheEnabledChanged();
     void notifyIntervalChanged();
     void brightnessChanged(int val);
     void contrastChanged(int val);
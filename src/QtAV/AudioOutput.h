@@ -113,6 +113,8 @@ public:
      * \return false if currently isPaused(), no backend is available or backend failed to play
      */
     bool play(const QByteArray& data, qreal pts = 0.0);
+    /// data is copied to the preallocated buffers, so nothing is allocated
+    bool play(const char* data, int size, qreal pts = 0.0);
     /*!
      * \brief pause
      * Pause audio rendering. play() will fail.
@@ -151,12 +153,11 @@ public:
     bool isMute() const;
     /*!
      * \brief setSpeed  set audio playing speed
-     * Currently only store the value and does nothing else in audio output. You may change sample rate to get the same effect.
+     * Only store the value in audio output. AVPlayer's audio thread time-stretches the data to this speed, so pitch is kept.
      * The speed affects the playing only if audio is available and clock type is
      * audio clock. For example, play a video contains audio without special configurations.
      * To change the playing speed in other cases, use AVPlayer::setSpeed(qreal)
      * \param speed linear. > 0
-     * TODO: resample internally
      */
     void setSpeed(qreal speed);
     qreal speed() const;
@@ -211,7 +212,7 @@ Q_SIGNALS:
     void backendsChanged();
 protected:
     // Store and fill data to audio buffers
-    bool receiveData(const QByteArray &data, qreal pts = 0.0);
+    bool receiveData(const char* data, int size, qreal pts = 0.0);
     /*!
      * \brief waitForNextBuffer
      * wait until you can feed more data
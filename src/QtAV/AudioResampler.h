@@ -63,7 +63,7 @@ public:
      */
     virtual bool prepare();
     virtual bool convert(const quint8** data);
-    //speed: >0, default is 1
+    //speed: >0, default is 1. pitch changes too. AVPlayer does not use it, audio speed is changed by time stretch
     void setSpeed(qreal speed); //out_sample_rate = out_sample_rate/speed
     qreal speed() const;
 
@@ -25,15 +25,40 @@
 #include <QtAV/QtAV_Global.h>
 #include <QtCore/QVariant>
 #include <QtCore/QSharedData>
+#include <QtCore/QSharedPointer>
 
 // TODO: fromAVFrame() asAVFrame()?
 namespace QtAV {
 
+/*!
+ * \brief The FrameSideData class
+ * Base class of typed data attached to a frame via Frame::setSideData(). Copies of a frame share it, so do not
+ * modify it after it's attached.
+ */
+class Q_AV_EXPORT FrameSideData
+{
+public:
+    virtual ~FrameSideData() {}
+};
+typedef QSharedPointer<FrameSideData> FrameSideDataPtr;
+
 class FramePrivate;
 class Q_AV_EXPORT Frame
 {
     Q_DECLARE_PRIVATE(Frame)
 public:
+    /*!
+     * Fixed side data slots. Unlike metadata, no key is hashed and nothing is allocated to attach data to a slot,
+     * so they are used for data attached to every frame in the decoding path.
+     */
+    enum SideDataType {
+        BufferOwnerSideData, ///< keeps the plane data alive, e.g. decoder or filter graph buffers
+        PaletteSideData, ///< VideoFramePalette of a paletted video frame
+        ColorInfoSideData, ///< color details other than color space and range, e.g. hdr metadata
+        UserSideData, ///< the 1st slot for extensions. UserSideData + 0...UserSideDataCount-1 are available
+        UserSideDataCount = 4,
+        SideDataCount = UserSideData + UserSideDataCount
+    };
     Frame(const Frame& other);
     virtual ~Frame() = 0;
     Frame& operator =(const Frame &other);
@@ -95,9 +120,25 @@ public:
     void setBytesPerLine(const QVector<int>& lineSize);
     void setBytesPerLine(int stride[]);
 
+    /*!
+     * Metadata is a slow path (a key is hashed and a QVariant is allocated for each call).
+     * Use side data for data attached to every frame.
+     */
     QVariantMap availableMetaData() const;
     QVariant metaData(const QString& key) const;
     void setMetaData(const QString &key, const QVariant &value);
+    /*!
+     * \brief sideData
+     * \return data in the slot, or null if not set or type is invalid
+     */
+    FrameSideDataPtr sideData(SideDataType type) const;
+    // returns null if not set or not a T
+    template<class T> QSharedPointer<T> sideData(SideDataType type) const { return sideData(type).template dynamicCast<T>();}
+    /*!
+     * \brief setSideData
+     * Replace the data in the slot. A null \a data clears the slot
+     */
+    void setSideData(SideDataType type, const FrameSideDataPtr& data);
     void setTimestamp(qreal ts);
     qreal timestamp() const;
     inline void swap(Frame &other) { qSwap(d_ptr, other.d_ptr); }
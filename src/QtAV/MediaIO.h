@@ -37,6 +37,19 @@ namespace QtAV {
  *   properties:
  *     device - read only. example: io->device()
  *   protocols: "", "qrc"
+ * "MMap"
+ *   read only memory mapped local file.
+ *   properties:
+ *     prefaultSize - read/write. bytes to page in ahead of the read position, 0 to disable
+ *   protocols: "mmap". example: player->setFile("mmap:/path/to/file.mp4")
+ * "Prefetch"
+ *   reads another io ahead in a background thread. see setBufferSize() for the avio buffer only.
+ *   properties:
+ *     source - read/write. MediaIO* to read from. otherwise opened from url "prefetch:xxx"
+ *     capacity - read/write. ring buffer bytes
+ *     fillLevel - read only. bytes buffered after the read position
+ *     throughput - read only. bytes per second the source delivers
+ *   protocols: "prefetch". example: player->setFile("prefetch:/mnt/nfs/cam1.mkv")
  */
 typedef int MediaIOId;
 class MediaIOPrivate;
@@ -52,7 +65,7 @@ public:
         Write
     };
 
-    /// Registered MediaIO::name(): "QIODevice", "QFile"
+    /// Registered MediaIO::name(): "QIODevice", "QFile", "MMap", "Prefetch"
     static QStringList builtInNames();
     /*!
      * \brief createForProtocol
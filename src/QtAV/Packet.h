@@ -35,6 +35,13 @@ class Q_AV_EXPORT Packet
 public:
     static Packet fromAVPacket(const AVPacket* avpkt, double time_base);
     static bool fromAVPacket(Packet *pkt, const AVPacket *avpkt, double time_base);
+    /*!
+     * \brief takeAVPacket
+     * The same as fromAVPacket() but the payload and side data references are moved from avpkt instead of
+     * adding new references, and avpkt is reset. Use it for packets owned by the caller, e.g. from av_read_frame().
+     */
+    static Packet takeAVPacket(AVPacket* avpkt, double time_base);
+    /// a packet to flush decoders. only isEOF() is meaningful
     static Packet createEOF();
 
     Packet();
@@ -43,6 +50,8 @@ public:
     // required if no defination of PacketPrivate
     Packet(const Packet& other);
     Packet& operator =(const Packet& other);
+    Packet(Packet&& other) noexcept;
+    Packet& operator =(Packet&& other) noexcept;
 
     bool isEOF()const;
     inline bool isValid() const;
@@ -69,6 +78,7 @@ public:
     qint64 position; // position in source file byte stream
 
 private:
+    bool eof;
     // we must define  default/copy ctor, dtor and operator= so that we can provide only forward declaration of PacketPrivate
     mutable QSharedDataPointer<PacketPrivate> d;
 };
@@ -131,6 +131,14 @@ public:
     qint64 totalKeyFrames = -3;
     QSize realResolution = QSize(0,0);
     int imageBufferSize = 0;
+    // realtime decode mode
+    double latency = 0; // ms, duration of packets read but not decoded
+    double targetLatency = 0; // ms
+    double latencyRate = 1.0; // presentation rate correction to reach targetLatency. >1: faster
+    qint64 latencyFlushes = 0; // times packets are skipped to the next key frame because latency is too large
+    // decoded frame queue, see AVPlayer::setDecodedFrameQueueDepth()
+    int decodedFrames = 0; // decoded but not presented
+    double decodeAhead = 0; // ms, last decoded pts - presented pts
     mutable QMutex mutex;
     std::atomic<bool> resetValues{true};
 };
@@ -28,7 +28,14 @@
 /// TODO: fromAVFrame(const AVFrame* f);
 namespace QtAV {
 
-/// metadata: pallete for pal8
+/// PaletteSideData of pal8 frames
+class Q_AV_EXPORT VideoFramePalette : public FrameSideData
+{
+public:
+    enum { Size = 256*4 };
+    quint32 colors[256]; ///< in AV_PIX_FMT_RGB32 layout
+};
+
 class VideoFramePrivate;
 class Q_AV_EXPORT VideoFrame : public Frame
 {
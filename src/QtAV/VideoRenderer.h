@@ -104,6 +104,12 @@ public:
     void forcePreferredPixelFormat(bool force = true);
     bool isPreferredPixelFormatForced() const;
     virtual bool isSupported(VideoFormat::PixelFormat pixfmt) const = 0;
+    /*!
+     * \brief conversionTime
+     * Time in ms to convert the last frame sent by the player to preferredPixelFormat(), or 0 if the decoded
+     * format is supported. Renderers receiving the same format share 1 conversion.
+     */
+    qreal conversionTime() const;
 
     /*!
      * \brief sourceAspectRatio
@@ -265,6 +271,8 @@ private:
     typedef VideoRenderer* (*VideoRendererCreator)();
     static bool Register(VideoRendererId id, VideoRendererCreator, const char *name);
     friend class VideoOutput;
+    friend class OutputSet;
+    void setConversionTime(qreal ms);
     //the size of decoded frame. get called in receiveFrame(). internal use only
     void setInSize(const QSize& s);
     void setInSize(int width, int height);
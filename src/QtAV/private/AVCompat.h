@@ -477,6 +477,10 @@ const char *get_codec_long_name(AVCodecID id);
 #define AV_INPUT_BUFFER_PADDING_SIZE FF_INPUT_BUFFER_PADDING_SIZE
 #endif
 
+#ifndef AV_CODEC_CAP_DR1
+#define AV_CODEC_CAP_DR1 CODEC_CAP_DR1
+#endif
+
 #ifndef ff_const59
 #if FF_API_AVIOFORMAT
 #define ff_const59
@@ -485,6 +489,5 @@ const char *get_codec_long_name(AVCodecID id);
 #endif
 #endif // !ff_const59
 
-int compat_decode(AVCodecContext* avctx, AVFrame* frame, int* got_frame, const AVPacket* pkt);
 int compat_encode(AVCodecContext* avctx, AVPacket* avpkt,
     int* got_packet, const AVFrame* frame);
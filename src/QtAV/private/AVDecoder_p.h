@@ -26,13 +26,15 @@
 #include <QtCore/QSharedPointer>
 #include <QtCore/QVector>
 #include "QtAV/QtAV_Global.h"
+#include "QtAV/Frame.h"
 #include "QtAV/private/AVCompat.h"
 #include "AVWrapper.h"
 
 namespace QtAV {
 
 // always define the class to avoid macro check when using it
-class AVFrameBuffers {
+// attached to frames as Frame::BufferOwnerSideData
+class AVFrameBuffers : public FrameSideData {
 #if QTAV_HAVE(AVBUFREF)
     QVector<AVBufferRef*> buf;
 #endif
@@ -63,6 +65,13 @@ public:
                 qWarning("av_buffer_ref(frame->extended_buf[%d]) error", i);
             }
         }
+#endif //QTAV_HAVE(AVBUFREF)
+    }
+    // takes the ownership of ref
+    AVFrameBuffers(AVBufferRef* ref) {
+        Q_UNUSED(ref);
+#if QTAV_HAVE(AVBUFREF)
+        buf.append(ref);
 #endif //QTAV_HAVE(AVBUFREF)
     }
     ~AVFrameBuffers() {
@@ -75,6 +84,7 @@ public:
 };
 typedef QSharedPointer<AVFrameBuffers> AVFrameBuffersRef;
 
+class Packet;
 class Q_AV_PRIVATE_EXPORT AVDecoderPrivate : public DPtrPrivate<AVDecoder>
 {
 public:
@@ -94,6 +104,8 @@ public:
        available(true)
       , is_open(false)
       , undecoded_size(0)
+      , frame_pending(false)
+      , eof_sent(false)
       , dict(0)
     {
         
@@ -108,11 +120,20 @@ public:
     virtual bool enableFrameRef() const { return true;}
     void applyOptionsForDict();
     void applyOptionsForContext();
-
+    /*!
+     * \brief decodeFrame
+     * avcodec_send_packet/avcodec_receive_frame step for 1 output frame. A frame left in the codec from
+     * the previous packet is returned first and the packet is not consumed, so the caller decodes it again.
+     * An eof packet drains the codec.
+     * \return bytes consumed (0 or packet size), or an AVERROR. AVERROR_EOF if drained
+     */
+    int decodeFrame(const Packet& packet, AVFrame* frame, bool* got_frame);
     Wrapper::AVCodecContextWrapper codec_ctx; //set once and not change
     bool available; //TODO: true only when context(and hw ctx) is ready
     bool is_open;
     int undecoded_size;
+    bool frame_pending; // the codec may have more output frames for the last packet
+    bool eof_sent; // reset by flush
     QString codec_name;
     QVariantHash options;
     AVDictionary *dict;
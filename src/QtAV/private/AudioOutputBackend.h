@@ -48,7 +48,13 @@ public:
     virtual QString name() const = 0;
     virtual bool open() = 0;
     virtual bool close() = 0;
-    virtual bool write(const QByteArray& data) = 0; //MUST
+    /*!
+     * \brief write
+     * Queue a buffer to play. MUST be implemented. size is not greater than buffer_size.
+     * data is in AudioOutput's PCM ring and is not overwritten before buffer_count more buffers are written,
+     * so a backend playing from the queued memory can keep the pointer instead of a copy.
+     */
+    virtual bool write(const char* data, int size) = 0;
     virtual bool play() = 0; //MUST
     virtual bool flush() { return false;}
     virtual bool clear() { return false;}
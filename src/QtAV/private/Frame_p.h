@@ -22,7 +22,7 @@
 #ifndef QTAV_FRAME_P_H
 #define QTAV_FRAME_P_H
 
-#include <QtAV/QtAV_Global.h>
+#include <QtAV/Frame.h>
 #include <QtCore/QVector>
 #include <QtCore/QVariant>
 #include <QtCore/QSharedData>
@@ -39,10 +39,19 @@ public:
         , data_align(1)
     {}
     virtual ~FramePrivate() {}
+    // copy metadata and side data to a frame with different data, so the buffer owner is not copied
+    void copyPropertiesTo(FramePrivate* d) const {
+        d->metadata = metadata;
+        for (int i = 0; i < Frame::SideDataCount; ++i) {
+            if (i != Frame::BufferOwnerSideData)
+                d->side_data[i] = side_data[i];
+        }
+    }
 
     QVector<uchar*> planes; //slice
     QVector<int> line_sizes; //stride
     QVariantMap metadata;
+    FrameSideDataPtr side_data[Frame::SideDataCount];
     QByteArray data;
     qreal timestamp;
     int data_align;
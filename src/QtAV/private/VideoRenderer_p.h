@@ -56,6 +56,7 @@ public:
       , quality(VideoRenderer::QualityBest)
       , preferred_format(VideoFormat::Format_RGB32)
       , force_preferred(false)
+      , conversion_time(0)
       , brightness(0)
       , contrast(0)
       , hue(0)
@@ -127,6 +128,7 @@ public:
     VideoFrame video_frame;
     VideoFormat::PixelFormat preferred_format;
     bool force_preferred;
+    qreal conversion_time; // ms
 
     qreal brightness, contrast, hue, saturation;
     QColor bg_color;
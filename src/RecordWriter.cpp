@@ -0,0 +1,475 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include "RecordWriter.h"
+#include <QtCore/QFile>
+#include <QtCore/QUrl>
+#include "QtAV/private/AVCompat.h"
+#include "utils/Logger.h"
+
+namespace QtAV {
+static QString nextRecordFormat(const QString& fmt)
+{
+    if (fmt == QLatin1String("mkv"))
+        return QStringLiteral("mp4");
+    if (fmt == QLatin1String("mp4"))
+        return QStringLiteral("avi");
+    if (fmt == QLatin1String("avi"))
+        return QStringLiteral("mov");
+    if (fmt == QLatin1String("mov"))
+        return QStringLiteral("flv");
+    return QString();
+}
+
+RecordWriter::RecordWriter(const QString &path, const AVDemuxer::RecordOptions &options, AVFormatContext *ic, int videoStream, int audioStream)
+    : url(path)
+    , duration(options.duration)
+    , restream(QUrl(path).scheme().toLower() == QLatin1String("udp"))
+    , format(options.format)
+    , fixed_format(!options.format.isEmpty())
+    , fragmented(options.fragmented)
+    , oc(nullptr)
+    , header_written(false)
+    , packet_count(0)
+    , segment_ms(options.segmentDuration)
+    , segment_bytes(options.segmentSize)
+    , segment_index(0)
+    , segment_start(-1)
+    , segment_written(0)
+    , preroll_gop_only(false)
+    , queued_bytes(0)
+    , max_packets(0)
+    , max_bytes(0)
+    , block_timeout(500)
+    , policy(AVDemuxer::RecordDropNewest)
+    , wait_key_frame(false)
+    , stopping(false)
+    , discarding(false)
+    , finished(false)
+{
+    if (format.isEmpty()) {
+        if (fragmented)
+            format = QStringLiteral("mp4");
+        else
+            format = videoStream >= 0 ? QStringLiteral("mkv") : QStringLiteral("wav");
+    }
+    if (restream) // segments make no sense for a stream
+        segment_ms = segment_bytes = 0;
+    StreamInfo* si[] = { &video, &audio };
+    const int index[] = { videoStream, audioStream };
+    for (int i = 0; i < 2; ++i) {
+        if (index[i] < 0 || !ic || index[i] >= (int)ic->nb_streams)
+            continue;
+        si[i]->index = index[i];
+        si[i]->time_base = ic->streams[index[i]]->time_base;
+        si[i]->par = avcodec_parameters_alloc();
+        avcodec_parameters_copy(si[i]->par, ic->streams[index[i]]->codecpar);
+    }
+}
+
+RecordWriter::~RecordWriter()
+{
+    stop(true);
+    if (thread.joinable())
+        thread.join();
+    for (AVPacket* p : queue)
+        av_packet_free(&p);
+    queue.clear();
+    for (AVPacket* p : preroll)
+        av_packet_free(&p);
+    preroll.clear();
+    close();
+    avcodec_parameters_free(&video.par);
+    avcodec_parameters_free(&audio.par);
+}
+
+void RecordWriter::setQueueLimit(int packets, qint64 bytes)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    max_packets = packets;
+    max_bytes = bytes;
+    cond_full.notify_all();
+}
+
+void RecordWriter::setOverflowPolicy(AVDemuxer::RecordOverflowPolicy value)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    policy = value;
+    cond_full.notify_all();
+}
+
+void RecordWriter::setBlockTimeout(int ms)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    block_timeout = ms;
+}
+
+void RecordWriter::setFinishedCallback(const FinishedCallback &cb)
+{
+    finished_cb = cb;
+}
+
+void RecordWriter::setSegmentCallback(const SegmentCallback &cb)
+{
+    segment_cb = cb;
+}
+
+void RecordWriter::addPreRoll(const AVPacket *pkt)
+{
+    if (thread.joinable() || !pkt || !accepts(pkt->stream_index))
+        return;
+    AVPacket *p = av_packet_clone(pkt); // refcounted, no payload copy
+    if (p)
+        preroll.push_back(p);
+}
+
+void RecordWriter::start()
+{
+    if (thread.joinable())
+        return;
+    thread = std::thread([this] { run(); });
+}
+
+bool RecordWriter::accepts(int streamIndex) const
+{
+    return streamIndex >= 0 && (streamIndex == video.index || streamIndex == audio.index);
+}
+
+bool RecordWriter::isFull() const
+{
+    if (max_packets > 0 && (int)queue.size() >= max_packets)
+        return true;
+    if (max_bytes > 0 && queued_bytes >= max_bytes)
+        return true;
+    return false;
+}
+
+void RecordWriter::dropFromHead()
+{
+    while (!queue.empty() && isFull()) {
+        AVPacket *p = queue.front();
+        queue.pop_front();
+        queued_bytes -= p->size;
+        ++stats.droppedPackets;
+        av_packet_free(&p);
+    }
+    // the writer must resume at a key frame, otherwise the rest of the dropped gop is garbage
+    while (video.index >= 0 && !queue.empty()
+           && queue.front()->stream_index == video.index
+           && !(queue.front()->flags & AV_PKT_FLAG_KEY)) {
+        AVPacket *p = queue.front();
+        queue.pop_front();
+        queued_bytes -= p->size;
+        ++stats.droppedPackets;
+        av_packet_free(&p);
+    }
+}
+
+bool RecordWriter::push(const AVPacket *pkt)
+{
+    if (!pkt || !accepts(pkt->stream_index))
+        return false;
+    const bool is_video = pkt->stream_index == video.index;
+    const bool is_key = !!(pkt->flags & AV_PKT_FLAG_KEY);
+    std::unique_lock<std::mutex> lock(mtx);
+    if (stopping || finished)
+        return false;
+    if (wait_key_frame && is_video) {
+        if (!is_key) {
+            ++stats.droppedPackets;
+            return false;
+        }
+        wait_key_frame = false;
+    }
+    if (isFull()) {
+        if (policy == AVDemuxer::RecordBlock) {
+            cond_full.wait_for(lock, std::chrono::milliseconds(block_timeout), [this] {
+                return !isFull() || stopping || policy != AVDemuxer::RecordBlock;
+            });
+            if (stopping)
+                return false;
+        }
+        if (isFull()) {
+            if (policy == AVDemuxer::RecordDropOldest) {
+                dropFromHead();
+            } else {
+                ++stats.droppedPackets;
+                wait_key_frame = is_video || video.index >= 0;
+                return false;
+            }
+        }
+    }
+    AVPacket *p = av_packet_clone(pkt); // refcounted, no payload copy
+    if (!p)
+        return false;
+    queue.push_back(p);
+    queued_bytes += p->size;
+    stats.maxQueuedPackets = qMax<qint64>(stats.maxQueuedPackets, queue.size());
+    lock.unlock();
+    cond_empty.notify_one();
+    return true;
+}
+
+void RecordWriter::stop(bool discard)
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+        if (discard)
+            discarding = true;
+    }
+    cond_empty.notify_all();
+    cond_full.notify_all();
+}
+
+AVDemuxer::RecordStatistics RecordWriter::statistics() const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    AVDemuxer::RecordStatistics st(stats);
+    st.queuedPackets = queue.size();
+    st.queuedBytes = queued_bytes;
+    return st;
+}
+
+void RecordWriter::updateLatency(qint64 us)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    ++stats.writtenPackets;
+    stats.lastWriteLatency = us;
+    stats.maxWriteLatency = qMax(stats.maxWriteLatency, us);
+    if (stats.writtenPackets == 1)
+        stats.averageWriteLatency = us;
+    else
+        stats.averageWriteLatency += (us - stats.averageWriteLatency)/16;
+}
+
+void RecordWriter::run()
+{
+    bool success = true;
+    while (true) {
+        AVPacket *pkt = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cond_empty.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty() || discarding)
+                break;
+            pkt = queue.front();
+            queue.pop_front();
+            queued_bytes -= pkt->size;
+        }
+        cond_full.notify_one();
+        if (!header_written && !open()) {
+            av_packet_free(&pkt);
+            if (format.isEmpty()) {
+                success = false;
+                break;
+            }
+            continue;
+        }
+        if (packet_count == 0)
+            writePreRoll(pkt);
+        if (isSegmentEnd(pkt)) { // cut before the key frame, every packet is in exactly one segment
+            close();
+            ++segment_index;
+            if (!open()) {
+                av_packet_free(&pkt);
+                success = false;
+                break;
+            }
+        }
+        write(pkt);
+        av_packet_free(&pkt);
+        if (duration > 0 && total_elapsed.elapsed()/1000 >= duration)
+            break;
+    }
+    close(success);
+    finished = true;
+    cond_full.notify_all();
+    if (finished_cb)
+        finished_cb(success, success ? format : QString());
+}
+
+bool RecordWriter::open()
+{
+    if (restream) // network may be not ready, retried for the next packet
+        return openFormat(QStringLiteral("mpegts"));
+    // codec parameters never change, so a format which failed once never works
+    while (!format.isEmpty()) {
+        if (openFormat(format)) {
+            fixed_format = true; // the next segments must use the same format
+            return true;
+        }
+        close(false);
+        format = fixed_format ? QString() : nextRecordFormat(format);
+    }
+    qWarning("RecordWriter: can not write header for %s", qPrintable(url));
+    return false;
+}
+
+bool RecordWriter::openFormat(const QString &fmt)
+{
+    if (!oc) {
+        file = fileName(fmt);
+        int ret = -1;
+        if (restream)
+            ret = avformat_alloc_output_context2(&oc, nullptr, "mpegts", nullptr);
+        else
+            ret = avformat_alloc_output_context2(&oc, nullptr, nullptr, file.toUtf8().constData());
+        if (ret < 0 || !oc) {
+            oc = nullptr;
+            return false;
+        }
+        StreamInfo* si[] = { &video, &audio };
+        for (StreamInfo* s : si) {
+            if (s->index < 0)
+                continue;
+            s->os = avformat_new_stream(oc, nullptr);
+            if (!s->os)
+                return false;
+            avcodec_parameters_copy(s->os->codecpar, s->par);
+            s->os->codecpar->codec_tag = 0;
+            s->os->start_time = 0;
+        }
+    }
+    if (!oc->pb && !(oc->oformat->flags & AVFMT_NOFILE)) {
+        if (avio_open(&oc->pb, file.toUtf8().constData(), AVIO_FLAG_WRITE) < 0) {
+            qWarning("RecordWriter: avio_open error: %s", qPrintable(file));
+            return false;
+        }
+    }
+    AVDictionary *opts = nullptr;
+    if (fragmented && fmt == QLatin1String("mp4")) {
+        // no moov rewriting on close. a crash loses at most the last fragment
+        av_dict_set(&opts, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+    }
+    const int ret = avformat_write_header(oc, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return false;
+    header_written = true;
+    segment_start = -1;
+    segment_written = 0;
+    elapsed.start();
+    if (!total_elapsed.isValid())
+        total_elapsed.start();
+    return true;
+}
+
+void RecordWriter::close(bool success)
+{
+    if (!oc)
+        return;
+    const bool written = header_written;
+    if (header_written)
+        av_write_trailer(oc);
+    if (oc->pb && !(oc->oformat->flags & AVFMT_NOFILE))
+        avio_closep(&oc->pb);
+    avformat_free_context(oc);
+    oc = nullptr;
+    video.os = audio.os = nullptr;
+    video.first_pts = audio.first_pts = -1;
+    header_written = false;
+    if (restream)
+        return;
+    if (!written && !success) // no header, remove the garbage file of a failed format
+        QFile::remove(file);
+    else if (written && isSegmented() && segment_cb)
+        segment_cb(file);
+}
+
+QString RecordWriter::fileName(const QString &fmt) const
+{
+    if (restream)
+        return url;
+    if (!isSegmented())
+        return url + QStringLiteral(".") + fmt;
+    return QStringLiteral("%1_%2.%3").arg(url).arg(segment_index, 5, 10, QLatin1Char('0')).arg(fmt);
+}
+
+qint64 RecordWriter::packetTime(const AVPacket *pkt) const
+{
+    const StreamInfo &s = pkt->stream_index == video.index ? video : audio;
+    if (pkt->pts != AV_NOPTS_VALUE)
+        return av_rescale_q(pkt->pts, s.time_base, av_get_time_base_q());
+    if (pkt->dts != AV_NOPTS_VALUE)
+        return av_rescale_q(pkt->dts, s.time_base, av_get_time_base_q());
+    return total_elapsed.nsecsElapsed()/1000LL;
+}
+
+bool RecordWriter::isSegmentEnd(const AVPacket *pkt) const
+{
+    if (!isSegmented() || !header_written || segment_start < 0)
+        return false;
+    // a segment must start with a key frame to be playable alone
+    if (video.index >= 0 && (pkt->stream_index != video.index || !(pkt->flags & AV_PKT_FLAG_KEY)))
+        return false;
+    if (segment_bytes > 0 && segment_written >= segment_bytes)
+        return true;
+    if (segment_ms > 0) {
+        const qint64 t = packetTime(pkt) - segment_start;
+        if (t >= segment_ms*1000LL || t < 0) // t < 0: timestamp discontinuity
+            return true;
+    }
+    return false;
+}
+
+void RecordWriter::writePreRoll(const AVPacket *first)
+{
+    bool skip = false;
+    if (preroll_gop_only) // the current gop is only required if the recording starts in the middle of it
+        skip = video.index < 0 || (first->stream_index == video.index && (first->flags & AV_PKT_FLAG_KEY));
+    for (AVPacket* p : preroll) {
+        if (!skip)
+            write(p);
+        av_packet_free(&p);
+    }
+    preroll.clear();
+}
+
+bool RecordWriter::write(AVPacket *p)
+{
+    StreamInfo &s = p->stream_index == video.index ? video : audio;
+    if (!s.os)
+        return false;
+    if (segment_start < 0)
+        segment_start = packetTime(p);
+    segment_written += p->size;
+    if (p->pts != AV_NOPTS_VALUE) {
+        av_packet_rescale_ts(p, s.time_base, s.os->time_base);
+        if (s.first_pts < 0)
+            s.first_pts = p->pts;
+        p->pts -= s.first_pts;
+    } else {
+        const qint64 t = elapsed.nsecsElapsed();
+        p->pts = av_rescale_q(t, {1, 1000000000}, s.os->time_base);
+        p->duration = 0;
+    }
+    p->dts = AV_NOPTS_VALUE;
+    p->stream_index = s.os->index;
+    QElapsedTimer t;
+    t.start();
+    const int ret = av_write_frame(oc, p);
+    updateLatency(t.nsecsElapsed()/1000LL);
+    ++packet_count;
+    return ret >= 0;
+}
+
+} //namespace QtAV
@@ -0,0 +1,150 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef QTAV_RECORDWRITER_H
+#define QTAV_RECORDWRITER_H
+
+#include "QtAV/AVDemuxer.h"
+#include <QtCore/QElapsedTimer>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+extern "C" {
+#include <libavutil/rational.h>
+}
+
+struct AVFormatContext;
+struct AVCodecParameters;
+struct AVStream;
+
+namespace QtAV {
+
+/*
+ * One recording (or restreaming) destination of a demuxer.
+ * The demuxer thread only push()es refcounted packets into a bounded queue, muxing and I/O
+ * are done in the writer's own thread. Stream parameters are copied when the writer is created,
+ * so the writer never touches the demuxer's AVFormatContext.
+ */
+class RecordWriter
+{
+public:
+    typedef std::function<void(bool success, const QString& format)> FinishedCallback;
+    typedef std::function<void(const QString& file)> SegmentCallback;
+
+    RecordWriter(const QString& path, const AVDemuxer::RecordOptions& options, AVFormatContext* ic, int videoStream, int audioStream);
+    ~RecordWriter();
+
+    void setQueueLimit(int packets, qint64 bytes);
+    void setOverflowPolicy(AVDemuxer::RecordOverflowPolicy policy);
+    void setBlockTimeout(int ms);
+    void setFinishedCallback(const FinishedCallback& cb);
+    // called in writer thread when a segment file is closed. only for segmented recordings
+    void setSegmentCallback(const SegmentCallback& cb);
+    /*!
+     * \brief addPreRoll
+     * Add a reference of a packet read before recording started. Must be called before start().
+     * Pre-roll packets are written first with their own timestamps and are not limited by the queue limit.
+     */
+    void addPreRoll(const AVPacket* pkt);
+    // if true, pre-roll packets are written only if the first recorded video packet is not a key frame
+    void setPreRollGopOnly(bool value) { preroll_gop_only = value; }
+    void start();
+    /*!
+     * \brief push
+     * Called in demuxer thread. Add a reference of pkt to the queue. Payload is not copied.
+     * \return false if the packet is dropped
+     */
+    bool push(const AVPacket* pkt);
+    /*!
+     * \brief stop
+     * Request the writer to finish. Non blocking. Queued packets are written unless discard is true.
+     */
+    void stop(bool discard = false);
+    bool isFinished() const { return finished; }
+    bool isStopping() const { return stopping; }
+    bool accepts(int streamIndex) const;
+    AVDemuxer::RecordStatistics statistics() const;
+    QString path() const { return url; }
+
+private:
+    struct StreamInfo {
+        int index = -1;
+        AVCodecParameters *par = nullptr;
+        AVRational time_base = {0, 1};
+        AVStream *os = nullptr;
+        int64_t first_pts = -1;
+    };
+    void run();
+    bool isFull() const;
+    void dropFromHead(); // queue lock must be held
+    bool open();
+    bool openFormat(const QString& fmt);
+    void close(bool success = true);
+    QString fileName(const QString& fmt) const;
+    bool isSegmented() const { return segment_ms > 0 || segment_bytes > 0; }
+    bool isSegmentEnd(const AVPacket* pkt) const;
+    qint64 packetTime(const AVPacket* pkt) const; // us
+    bool write(AVPacket* pkt);
+    void writePreRoll(const AVPacket* first);
+    void updateLatency(qint64 us);
+
+    QString url;
+    int duration;
+    bool restream;
+    QString format;
+    bool fixed_format; // no fallback if format is set by user or a header is already written
+    bool fragmented;
+    StreamInfo video, audio;
+    AVFormatContext *oc;
+    QString file; // current output file
+    bool header_written;
+    QElapsedTimer elapsed; // current file
+    QElapsedTimer total_elapsed;
+    quint64 packet_count;
+    qint64 segment_ms, segment_bytes;
+    int segment_index;
+    qint64 segment_start; // us, time of the first packet in current segment. <0: not set
+    qint64 segment_written; // bytes written in current segment
+    SegmentCallback segment_cb;
+    std::vector<AVPacket*> preroll;
+    bool preroll_gop_only;
+
+    std::thread thread;
+    mutable std::mutex mtx;
+    std::condition_variable cond_empty, cond_full;
+    std::deque<AVPacket*> queue;
+    qint64 queued_bytes;
+    int max_packets;
+    qint64 max_bytes;
+    int block_timeout;
+    AVDemuxer::RecordOverflowPolicy policy;
+    bool wait_key_frame;
+    std::atomic<bool> stopping, discarding, finished;
+    FinishedCallback finished_cb;
+    AVDemuxer::RecordStatistics stats; // protected by mtx
+};
+
+} //namespace QtAV
+#endif // QTAV_RECORDWRITER_H
@@ -146,6 +146,12 @@ Statistics &Statistics::operator=(const Statistics &other)
     totalKeyFrames = other.totalKeyFrames;
     realResolution = other.realResolution;
     imageBufferSize = other.imageBufferSize;
+    latency = other.latency;
+    targetLatency = other.targetLatency;
+    latencyRate = other.latencyRate;
+    latencyFlushes = other.latencyFlushes;
+    decodedFrames = other.decodedFrames;
+    decodeAhead = other.decodeAhead;
 
     video_only = other.video_only;
     audio_only = other.audio_only;
@@ -0,0 +1,163 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include "StreamInfoCache.h"
+#include "QtAV/private/AVCompat.h"
+#include <string.h>
+#include "utils/Logger.h"
+
+namespace QtAV {
+static const size_t kMaxEntries = 64;
+
+static bool sameData(const uint8_t* a, int na, const uint8_t* b, int nb)
+{
+    return na == nb && (na == 0 || memcmp(a, b, na) == 0);
+}
+
+StreamInfoCache::Stream::Stream()
+    : par(avcodec_parameters_alloc())
+{
+    time_base = r_frame_rate = avg_frame_rate = av_make_q(0, 1);
+}
+
+StreamInfoCache::Stream::~Stream()
+{
+    avcodec_parameters_free(&par);
+}
+
+StreamInfoCache& StreamInfoCache::instance()
+{
+    static StreamInfoCache cache;
+    return cache;
+}
+
+bool StreamInfoCache::apply(const QString &url, AVFormatContext *ic)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(url);
+    if (it == m_entries.end())
+        return false;
+    Entry &e = it->second;
+    // layout known after avformat_open_input (e.g. sdp of rtsp) must be the same
+    bool match = e.streams.size() == ic->nb_streams;
+    for (unsigned i = 0; match && i < ic->nb_streams; ++i) {
+        const AVCodecParameters *cur = ic->streams[i]->codecpar;
+        const AVCodecParameters *old = e.streams[i]->par;
+        const AVRational tb = ic->streams[i]->time_base;
+        // cached parameters (e.g. frame rates) assume the time base they are stored with
+        if (tb.num > 0 && tb.den > 0 && av_cmp_q(tb, e.streams[i]->time_base) != 0)
+            match = false;
+        else if (cur->codec_type != AVMEDIA_TYPE_UNKNOWN && cur->codec_type != old->codec_type)
+            match = false;
+        else if (cur->codec_id != AV_CODEC_ID_NONE && cur->codec_id != old->codec_id)
+            match = false;
+        else if (cur->extradata_size > 0 && !sameData(cur->extradata, cur->extradata_size, old->extradata, old->extradata_size))
+            match = false;
+        else if (cur->width > 0 && (cur->width != old->width || cur->height != old->height))
+            match = false;
+    }
+    if (!match) {
+        qDebug("StreamInfoCache: stream layout of %s changed", qPrintable(url));
+        m_entries.erase(it);
+        return false;
+    }
+    e.used = ++m_clock;
+    for (unsigned i = 0; i < ic->nb_streams; ++i) {
+        AVStream *st = ic->streams[i];
+        const Stream &s = *e.streams[i];
+        avcodec_parameters_copy(st->codecpar, s.par);
+        if (st->time_base.num <= 0 || st->time_base.den <= 0)
+            st->time_base = s.time_base;
+        if (!st->r_frame_rate.num)
+            st->r_frame_rate = s.r_frame_rate;
+        if (!st->avg_frame_rate.num)
+            st->avg_frame_rate = s.avg_frame_rate;
+    }
+    return true;
+}
+
+void StreamInfoCache::store(const QString &url, const AVFormatContext *ic)
+{
+    if (url.isEmpty() || !ic || ic->nb_streams == 0)
+        return;
+    Entry e;
+    for (unsigned i = 0; i < ic->nb_streams; ++i) {
+        const AVStream *st = ic->streams[i];
+        std::unique_ptr<Stream> s(new Stream());
+        if (!s->par || avcodec_parameters_copy(s->par, st->codecpar) < 0)
+            return;
+        s->time_base = st->time_base;
+        s->r_frame_rate = st->r_frame_rate;
+        s->avg_frame_rate = st->avg_frame_rate;
+        e.streams.push_back(std::move(s));
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    e.used = ++m_clock;
+    m_entries[url] = std::move(e);
+    while (m_entries.size() > kMaxEntries) {
+        auto lru = m_entries.begin();
+        for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+            if (it->second.used < lru->second.used)
+                lru = it;
+        }
+        m_entries.erase(lru);
+    }
+}
+
+bool StreamInfoCache::validate(const QString &url, const AVPacket *pkt)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(url);
+    if (it == m_entries.end())
+        return true;
+    const Entry &e = it->second;
+    bool match = pkt->stream_index >= 0 && pkt->stream_index < (int)e.streams.size();
+    if (match) {
+        const AVCodecParameters *par = e.streams[pkt->stream_index]->par;
+        // size type of av_packet_get_side_data() depends on FFmpeg version
+        for (int i = 0; match && i < pkt->side_data_elems; ++i) {
+            const AVPacketSideData &sd = pkt->side_data[i];
+            if (sd.type == AV_PKT_DATA_PARAM_CHANGE)
+                match = false;
+            else if (sd.type == AV_PKT_DATA_NEW_EXTRADATA && sd.size > 0)
+                match = sameData(sd.data, int(sd.size), par->extradata, par->extradata_size);
+        }
+    }
+    if (!match) {
+        qDebug("StreamInfoCache: parameters of %s changed", qPrintable(url));
+        m_entries.erase(it);
+    }
+    return match;
+}
+
+void StreamInfoCache::remove(const QString &url)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.erase(url);
+}
+
+void StreamInfoCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+}
+
+} //namespace QtAV
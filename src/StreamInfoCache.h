@@ -0,0 +1,80 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef QTAV_STREAMINFOCACHE_H
+#define QTAV_STREAMINFOCACHE_H
+
+#include <QtCore/QString>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+extern "C" {
+#include <libavutil/rational.h>
+}
+
+struct AVCodecParameters;
+struct AVFormatContext;
+struct AVPacket;
+
+namespace QtAV {
+
+/*
+ * Process wide cache of stream parameters probed by avformat_find_stream_info(), keyed by url.
+ * A reconnect to the same url seeds the streams with the cached parameters, so that the probe finishes
+ * as soon as the first packets are read instead of analyzing seconds of data.
+ * An entry is removed if the stream layout or time bases reported by the demuxer, or the parameters carried by the
+ * first packets, do not match. Thread safe.
+ */
+class StreamInfoCache
+{
+public:
+    static StreamInfoCache& instance();
+    /*!
+     * \brief apply
+     * Call after avformat_open_input() and before avformat_find_stream_info()
+     * \return false if no entry or the entry does not match. a mismatched entry is removed
+     */
+    bool apply(const QString& url, AVFormatContext* ic);
+    /// store the parameters of a probed context
+    void store(const QString& url, const AVFormatContext* ic);
+    /// check a packet read from a context seeded by apply(). return false and remove the entry on mismatch
+    bool validate(const QString& url, const AVPacket* pkt);
+    void remove(const QString& url);
+    void clear();
+private:
+    struct Stream {
+        Stream();
+        ~Stream();
+        AVCodecParameters *par;
+        AVRational time_base, r_frame_rate, avg_frame_rate;
+    };
+    typedef struct {
+        std::vector<std::unique_ptr<Stream>> streams;
+        quint64 used;
+    } Entry;
+    std::mutex m_mutex;
+    std::map<QString, Entry> m_entries;
+    quint64 m_clock = 0;
+};
+
+} //namespace QtAV
+#endif // QTAV_STREAMINFOCACHE_H
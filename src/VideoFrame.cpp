@@ -26,6 +26,8 @@
 #include <QtCore/QSharedPointer>
 #include <QtGui/QImage>
 #include "QtAV/private/AVCompat.h"
+#include "QtAV/private/AVDecoder_p.h"
+#include "utils/FrameBufferPool.h"
 #include "utils/GPUMemCopy.h"
 #include "utils/Logger.h"
 
@@ -66,11 +68,12 @@ VideoFrame VideoFrame::fromGPU(const VideoFormat& fmt, int width, int height, in
         for (int i = 0; i < nb_planes; ++i) {
             yuv_size += pitch[i]*h[i];
         }
-        // additional 15 bytes to ensure 16 bytes aligned
-        QByteArray buf(15 + yuv_size, 0);
-        const int offset_16 = (16 - ((uintptr_t)buf.constData() & 0x0f)) & 0x0f;
+        // pooled, at least 16 bytes aligned
+        AVBufferRef *buf = FrameBufferPool::instance().get(yuv_size);
+        if (!buf)
+            return VideoFrame();
         // plane 1, 2... is aligned?
-        uchar* plane_ptr = (uchar*)buf.constData() + offset_16;
+        uchar* plane_ptr = buf->data;
         QVector<uchar*> dst(nb_planes, 0);
         for (int i = 0; i < nb_planes; ++i) {
             dst[i] = plane_ptr;
@@ -80,9 +83,10 @@ VideoFrame VideoFrame::fromGPU(const VideoFormat& fmt, int width, int height, in
             gpu_memcpy(dst[i], src[i], pitch[i]*h[i]);
 
         }
-        frame = VideoFrame(width, height, fmt, buf);
+        frame = VideoFrame(width, height, fmt, QByteArray::fromRawData((const char*)buf->data, yuv_size), 16);
         frame.setBits(dst);
         frame.setBytesPerLine(pitch);
+        frame.setSideData(Frame::BufferOwnerSideData, AVFrameBuffersRef::create(buf));
     } else {
         frame = VideoFrame(width, height, fmt);
         frame.setBits(src);
@@ -215,27 +219,20 @@ VideoFrame VideoFrame::clone() const
         qDebug("frame data not valid. size: %d", d->data.size());
         VideoFrame f(width(), height(), d->format);
         f.d_ptr->metadata = d->metadata; // need metadata?
+        for (int i = 0; i < SideDataCount; ++i)
+            f.d_ptr->side_data[i] = d->side_data[i];
         f.setTimestamp(d->timestamp);
         f.setDisplayAspectRatio(d->displayAspectRatio);
         return f;
     }
-    int bytes = 0;
-    for (int i = 0; i < d->format.planeCount(); ++i) {
-        bytes += bytesPerLine(i)*planeHeight(i);
-    }
-
-    QByteArray buf(bytes, 0);
-    char *dst = buf.data(); //must before buf is shared, otherwise data will be detached.
-    VideoFrame f(width(), height(), d->format, buf);
+    VideoFrame f(FrameBufferPool::videoFrame(width(), height(), d->format));
+    if (!f.isValid())
+        return VideoFrame();
     const int nb_planes = d->format.planeCount();
     for (int i = 0; i < nb_planes; ++i) {
-        f.setBits((quint8*)dst, i);
-        f.setBytesPerLine(bytesPerLine(i), i);
-        const int plane_size = bytesPerLine(i)*planeHeight(i);
-        memcpy(dst, constBits(i), plane_size);
-        dst += plane_size;
+        copyPlane(f.bits(i), f.bytesPerLine(i), constBits(i), bytesPerLine(i), qMin(bytesPerLine(i), f.bytesPerLine(i)), planeHeight(i));
     }
-    f.d_ptr->metadata = d->metadata; // need metadata?
+    d->copyPropertiesTo(f.d_ptr.data()); // keeps the pooled buffer owner
     f.setTimestamp(d->timestamp);
     f.setDisplayAspectRatio(d->displayAspectRatio);
     f.setColorSpace(d->color_space);
@@ -392,13 +389,19 @@ VideoFrame VideoFrame::to(const VideoFormat &fmt, const QSize& dstSize, const QR
     conv.setInSize(width(), height());
     conv.setOutSize(w, h);
     conv.setInRange(colorRange());
-    if (!conv.convert(d->planes.constData(), d->line_sizes.constData())) {
+    VideoFrame f(FrameBufferPool::videoFrame(w, h, fmt));
+    if (!f.isValid())
+        return VideoFrame();
+    quint8 *dst[4] = {0};
+    int dst_stride[4] = {0};
+    for (int i = 0; i < qMin(f.planeCount(), 4); ++i) {
+        dst[i] = f.bits(i);
+        dst_stride[i] = f.bytesPerLine(i);
+    }
+    if (!conv.convert(d->planes.constData(), d->line_sizes.constData(), dst, dst_stride)) {
         qWarning() << "VideoFrame::to error: " << format() << "=>" << fmt;
         return VideoFrame();
     }
-    VideoFrame f(w, h, fmt, conv.outData(), ImageConverter::DataAlignment);
-    f.setBits(conv.outPlanes());
-    f.setBytesPerLine(conv.outLineSizes());
     if (fmt.isRGB()) {
         f.setColorSpace(fmt.isPlanar() ? ColorSpace_GBR : ColorSpace_RGB);
     } else {
@@ -407,7 +410,7 @@ VideoFrame VideoFrame::to(const VideoFormat &fmt, const QSize& dstSize, const QR
     // TODO: color range
     f.setTimestamp(timestamp());
     f.setDisplayAspectRatio(displayAspectRatio());
-    f.d_ptr->metadata = d->metadata; // need metadata?
+    d->copyPropertiesTo(f.d_ptr.data()); // keeps the pooled buffer owner
     return f;
 }
 
@@ -522,18 +525,25 @@ VideoFrame VideoFrameConverter::convert(const VideoFrame &frame, int fffmt) cons
         pitch[i] = frame.constBits(i);
         stride[i] = frame.bytesPerLine(i);
     }
-    const QByteArray paldata(frame.metaData(QStringLiteral("pallete")).toByteArray());
-    if (pal > 0) {
-        pitch[1] = (const uchar*)paldata.constData();
-        stride[1] = paldata.size();
+    const QSharedPointer<VideoFramePalette> paldata(frame.sideData<VideoFramePalette>(Frame::PaletteSideData));
+    if (pal > 0 && paldata) {
+        pitch[1] = (const uchar*)paldata->colors;
+        stride[1] = VideoFramePalette::Size;
     }
-    if (!m_cvt->convert(pitch.constData(), stride.constData())) {
+    // a new pooled buffer for each frame, the previous result may be still in use (renderer, frame queue)
+    const VideoFormat fmt(fffmt);
+    VideoFrame f(FrameBufferPool::videoFrame(frame.width(), frame.height(), fmt));
+    if (!f.isValid())
+        return VideoFrame();
+    quint8 *dst[4] = {0};
+    int dst_stride[4] = {0};
+    for (int i = 0; i < qMin(f.planeCount(), 4); ++i) {
+        dst[i] = f.bits(i);
+        dst_stride[i] = f.bytesPerLine(i);
+    }
+    if (!m_cvt->convert(pitch.constData(), stride.constData(), dst, dst_stride)) {
         return VideoFrame();
     }
-    const VideoFormat fmt(fffmt);
-    VideoFrame f(frame.width(), frame.height(), fmt, m_cvt->outData());
-    f.setBits(m_cvt->outPlanes());
-    f.setBytesPerLine(m_cvt->outLineSizes());
     f.setTimestamp(frame.timestamp());
     f.setDisplayAspectRatio(frame.displayAspectRatio());
     // metadata?
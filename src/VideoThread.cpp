@@ -30,11 +30,13 @@
 #include "QtAV/Filter.h"
 #include "QtAV/FilterContext.h"
 #include "output/OutputSet.h"
+#include "utils/WorkPool.h"
 #include "QtAV/private/AVCompat.h"
 #include <QtCore/QFileInfo>
 #include "utils/Logger.h"
 #include "AVPlayer.h"
 #include "codec/video/VideoDecoderFFmpegBase.h"
+#include <thread>
 
 namespace QtAV {
 
@@ -88,6 +90,38 @@ public:
         statistics->mutex.unlock();
     }
 
+    inline void reset_statistics_if_requested() {
+        if(!statistics->resetValues.load(std::memory_order_relaxed))
+            return;
+        statistics->mutex.lock();
+        statistics->totalFrames = 0;
+        statistics->droppedFrames = 0;
+        statistics->droppedPackets = 0;
+        statistics->totalKeyFrames = -3;
+        statistics->mutex.unlock();
+        statistics->resetValues.store(false);
+    }
+
+    // returns true if a frame is requested to be presented without waiting, e.g. seek target or step forward
+    bool takePresentNow() {
+        int n = present_now.load();
+        while (n > 0 && !present_now.compare_exchange_weak(n, n - 1)) {}
+        return n > 0;
+    }
+
+    struct QueuedFrame {
+        VideoFrame frame;
+        int gen;
+    };
+
+    void setDisplayedFrame(const VideoFrame& frame) {
+        QMutexLocker lock(&present_mutex);
+        Q_UNUSED(lock);
+        displayed_frame = frame;
+    }
+
+    // conv and displayed_frame are used by tasks in decoding thread and by delivery in presenter thread
+    mutable QMutex present_mutex;
     VideoFrameConverter conv;
     qreal force_fps; // <=0: try to use pts. if no pts in stream(guessed by 5 packets), use |force_fps|
     // not const.
@@ -98,6 +132,13 @@ public:
     VideoFilterContext *filter_context;//TODO: use own smart ptr. QSharedPointer "=" is ugly
     VideoFrame displayed_frame;
     bool wait_key_frame = false;
+    // decoded frame queue. filled by run() and taken by presentFrames() in presenter thread
+    BlockingQueue<QueuedFrame> frames;
+    std::atomic_int frames_gen{0}; // increased by flushFrames(), older queued frames are dropped
+    std::atomic_int present_now{0};
+    std::atomic<double> decoded_pts{0}; // pts of the last queued frame
+    std::atomic_bool presenter_exit{false}; // exit after the queue is empty
+    std::thread presenter;
     VideoThread* q_ptr;
 };
 
@@ -161,7 +202,10 @@ void VideoThread::clearRenderers()
 
 VideoFrame VideoThread::displayedFrame() const
 {
-    return d_func().displayed_frame;
+    DPTR_D(const VideoThread);
+    QMutexLocker lock(&d.present_mutex);
+    Q_UNUSED(lock);
+    return d.displayed_frame;
 }
 
 void VideoThread::setFrameRate(qreal value)
@@ -194,23 +238,27 @@ void VideoThread::setEQ(int b, int c, int s)
 {
     class EQTask : public QRunnable {
     public:
-        EQTask(VideoFrameConverter *c)
+        EQTask(VideoFrameConverter *c, QMutex *m)
             : brightness(0)
             , contrast(0)
             , saturation(0)
             , conv(c)
+            , mutex(m)
         {
             //qDebug("EQTask tid=%p", QThread::currentThread());
         }
         void run() {
+            QMutexLocker lock(mutex); // conv is used by presenter thread
+            Q_UNUSED(lock);
             conv->setEq(brightness, contrast, saturation);
         }
         int brightness, contrast, saturation;
     private:
         VideoFrameConverter *conv;
+        QMutex *mutex;
     };
     DPTR_D(VideoThread);
-    EQTask *task = new EQTask(&d.conv);
+    EQTask *task = new EQTask(&d.conv, &d.present_mutex);
     task->brightness = b;
     task->contrast = c;
     task->saturation = s;
@@ -225,6 +273,7 @@ void VideoThread::setEQ(int b, int c, int s)
 bool VideoThread::decodePacket(Packet &pkt)
 {
     DPTR_D(VideoThread);
+    d.reset_statistics_if_requested();
     if (!pkt.isValid()) {
         d.statistics->mutex.lock();
         d.statistics->droppedPackets++;
@@ -242,30 +291,45 @@ bool VideoThread::decodePacket(Packet &pkt)
     if(!d.dec)
         return false;
     VideoDecoder *dec = static_cast<VideoDecoder*>(d.dec);
-    if (!dec->decode(pkt))
-        return false;
-    if(pkt.hasKeyFrame)
-        d.update_video_info(dec->frame());
-    if (!pkt.isEOF())
-        pkt.skip(pkt.data.size() - dec->undecodedSize());
-    VideoFrame frame = dec->frame();
-
-    d.statistics->mutex.lock();
-    d.statistics->totalFrames++;
-    d.statistics->mutex.unlock();
-    if (!frame.isValid()) {
+    bool key_frame = pkt.hasKeyFrame;
+    bool delivered = false;
+    // a packet can be decoded to several frames. it's not consumed until the last frame is received
+    while (dec->decode(pkt)) {
+        if (key_frame) {
+            d.update_video_info(dec->frame());
+            key_frame = false;
+        }
+        if (!pkt.isEOF())
+            pkt.skip(pkt.data.size() - dec->undecodedSize());
+        VideoFrame frame = dec->frame();
+
         d.statistics->mutex.lock();
-        d.statistics->droppedFrames++;
+        d.statistics->totalFrames++;
         d.statistics->mutex.unlock();
-        qWarning("invalid video frame from decoder. undecoded data size: %d", pkt.data.size());
-        return false;
-    }
+        if (!frame.isValid()) {
+            d.statistics->mutex.lock();
+            d.statistics->droppedFrames++;
+            d.statistics->mutex.unlock();
+            qWarning("invalid video frame from decoder. undecoded data size: %d", pkt.data.size());
+            return delivered;
+        }
 
-    applyFilters(frame);
-    if(!deliverVideoFrame(frame))
-        return false;
-    d.displayed_frame = frame;
-    return true;
+        applyFilters(frame);
+        bool ok = false;
+        {
+            // renderers may block. a shared pool worker is replaced while blocked
+            WorkPool::Blocking blocking;
+            Q_UNUSED(blocking);
+            ok = deliverVideoFrame(frame);
+        }
+        if (ok) {
+            d.setDisplayedFrame(frame);
+            delivered = true;
+        }
+        if (!pkt.isEOF() && pkt.data.isEmpty())
+            break;
+    }
+    return delivered;
 }
 
 void VideoThread::applyFilters(VideoFrame &frame)
@@ -306,7 +370,9 @@ bool VideoThread::deliverVideoFrame(VideoFrame &frame)
             fmt = VideoFormat::Format_RGB32;
         else
             fmt = vo->preferredPixelFormat();
+        d.present_mutex.lock();
         VideoFrame outFrame(d.conv.convert(frame, fmt));
+        d.present_mutex.unlock();
         if (!outFrame.isValid()) {
             d.outputSet->unlock();
             return false;
@@ -320,6 +386,86 @@ bool VideoThread::deliverVideoFrame(VideoFrame &frame)
     return true;
 }
 
+void VideoThread::flushFrames()
+{
+    DPTR_D(VideoThread);
+    // clear first, so a frame taken by presenter before clear() has an old generation
+    d.frames.clear();
+    d.present_now = 0;
+    ++d.frames_gen;
+}
+
+void VideoThread::presentFrames()
+{
+    DPTR_D(VideoThread);
+    static const qint64 kWaitSlice = 20000; // us
+    const qint64 start_time = QDateTime::currentMSecsSinceEpoch();
+    qint64 last_deliver_time = 0;
+    while (!d.stop) {
+        bool valid = false;
+        VideoThreadPrivate::QueuedFrame item(d.frames.take(50, &valid));
+        if (!valid) {
+            if (d.presenter_exit)
+                break;
+            continue;
+        }
+        VideoFrame &frame = item.frame;
+        const qreal pts = frame.timestamp();
+        // in video clock mode the clock is updated by decoding, so frames are presented once decoded
+        const bool sync_video = d.clock->clockType() == AVClock::VideoClock;
+        bool now = false;
+        QElapsedTimer waited;
+        waited.start();
+        while (!d.stop && item.gen == d.frames_gen && !(now = d.takePresentNow())) {
+            // the clock may stop at eof
+            if (d.presenter_exit && waited.elapsed() > 1000)
+                break;
+            qint64 wait_us = 0;
+            if (isPaused())
+                wait_us = kWaitSlice;
+            else if (d.force_dt > 0)
+                wait_us = (last_deliver_time + d.force_dt - QDateTime::currentMSecsSinceEpoch())*1000LL;
+            else if (!sync_video)
+                wait_us = qint64((pts - d.clock->value())*1000000.0);
+            if (wait_us <= 0)
+                break;
+            std::this_thread::sleep_for(std::chrono::microseconds(qMin(wait_us, kWaitSlice)));
+        }
+        if (d.stop || item.gen != d.frames_gen)
+            continue;
+        if (!now && !sync_video && d.force_dt <= 0
+                && d.clock->value() - pts > kSyncThreshold && !d.frames.isEmpty()) {
+            // too late and newer frames are decoded. drop to catch up
+            d.statistics->mutex.lock();
+            d.statistics->droppedFrames++;
+            d.statistics->mutex.unlock();
+            continue;
+        }
+        if (!sync_video)
+            d.clock->updateVideoTime(pts);
+        d.statistics->mutex.lock();
+        d.statistics->video.current_time = QTime(0, 0, 0).addMSecs(int(pts * 1000.0));
+        d.statistics->mutex.unlock();
+        applyFilters(frame);
+        while (d.outputSet->canPauseThread() && !d.stop)
+            d.outputSet->pauseThread(100);
+        const qint64 now_ms = QDateTime::currentMSecsSinceEpoch();
+        if (d.force_dt > 0 && frame.timestamp() <= 0) {
+            frame.setTimestamp(qreal(now_ms - start_time)/1000.0);
+            clock()->updateValue(frame.timestamp()); //external clock?
+        }
+        if (!deliverVideoFrame(frame))
+            continue;
+        last_deliver_time = now_ms;
+        d.setDisplayedFrame(frame);
+        d.statistics->mutex.lock();
+        d.statistics->decodedFrames = d.frames.size();
+        d.statistics->decodeAhead = (d.decoded_pts - pts)*1000.0;
+        d.statistics->mutex.unlock();
+    }
+    qDebug("Video presenter stops running...");
+}
+
 //TODO: if output is null or dummy, the use duration to wait
 void VideoThread::run()
 {
@@ -357,25 +503,27 @@ void VideoThread::run()
     qreal v_a = 0;
     int nb_no_pts = 0;
     //bool wait_audio_drain
-    const char* pkt_data = NULL; // workaround for libav9 decode fail but error code >= 0
     qint64 last_deliver_time = 0;
     int sync_id = 0;
     auto realtimeDecode = player->realtimeDecode();
+    // decoded frame queue: frames are presented by d.presenter, so decoding can run ahead of presentation
+    const int queue_depth = realtimeDecode ? 0 : player->decodedFrameQueueDepth();
+    const bool queued = queue_depth > 0;
+    if (queued) {
+        d.frames.setCapacity(queue_depth);
+        d.frames.setThreshold(1);
+        d.frames.setBlocking(true);
+        flushFrames();
+        d.presenter_exit = false;
+        d.presenter = std::thread(&VideoThread::presentFrames, this);
+    }
     while (!d.stop) {
         processNextTask();
 
-        if(d.statistics->resetValues.load(std::memory_order_relaxed)) {
-            d.statistics->mutex.lock();
-            d.statistics->totalFrames = 0;
-            d.statistics->droppedFrames = 0;
-            d.statistics->droppedPackets = 0;
-            d.statistics->totalKeyFrames = -3;
-            d.statistics->mutex.unlock();
-            d.statistics->resetValues.store(false);
-        }
+        d.reset_statistics_if_requested();
 
-        if(realtimeDecode) {
-            QThread::msleep(50);
+        if(realtimeDecode) { // packets are decoded in demux thread by decodePacket()
+            waitForTask();
             continue;
         }
 
@@ -425,6 +573,8 @@ void VideoThread::run()
                 wait_key_frame = true;
                 qDebug("Invalid packet! flush video codec context!!!!!!!!!! video packet queue size: %d", d.packets.size());
                 d.dec->flush(); //d.dec instead of dec because d.dec maybe changed in processNextTask() but dec is not
+                if (queued)
+                    flushFrames();
                 d.render_pts0 = pkt.pts;
                 sync_id = pkt.position;
                 if (pkt.pts >= 0)
@@ -459,6 +609,8 @@ void VideoThread::run()
             sync_audio = false;
             sync_video = false;
         }
+        // video clock is updated by decoding, decode ahead is not possible
+        const qreal ahead = queued && !sync_video ? player->decodeAhead()/1000.0 : 0;
         const qreal dts = pkt.dts; //FIXME: pts and dts
         // TODO: delta ref time
         // if dts is invalid, diff can be very small (<0) and video will be decoded and rendered(display_wait is disabled for now) immediately
@@ -509,15 +661,20 @@ void VideoThread::run()
         */
         if (seeking)
             diff = 0; // TODO: here?
+        // queued frames are presented at their pts, so decoding only waits until it is decodeAhead() before the clock.
+        // diff is still the a/v difference used to skip and drop frames
+        qreal decode_wait = diff - ahead;
         if (!sync_audio && diff > 0) {
             // wait to dts reaches
             // d.force_fps>0: wait after decoded before deliver
-            if (d.force_fps <= 0)// || !qFuzzyCompare(d.clock->speed(), 1.0))
-                waitAndCheck(diff*1000UL, dts); // TODO: count decoding and filter time, or decode immediately but wait for display
+            if (d.force_fps <= 0 && decode_wait > 0)// || !qFuzzyCompare(d.clock->speed(), 1.0))
+                waitAndCheck(decode_wait*1000UL, dts); // TODO: count decoding and filter time, or decode immediately but wait for display
             diff = 0; // TODO: can not change delay!
+            decode_wait = 0;
         }
         // update here after wait. TODO: use decoded timestamp/guessed next pts?
-        d.clock->updateVideoTime(dts); // FIXME: dts or pts?
+        if (!queued || sync_video) // otherwise updated by presenter
+            d.clock->updateVideoTime(dts); // FIXME: dts or pts?
         bool skip_render = false;
         if (qAbs(diff) < 0.5) {
             if (diff < -kSyncThreshold) { //Speed up. drop frame?
@@ -530,17 +687,18 @@ void VideoThread::run()
                     skip_render = !pkt.hasKeyFrame && (nb_dec_slow %2);
                 }
             } else {
-                const double s = qMin<qreal>(0.01*(nb_dec_fast>>1), diff);
+                const double s = qMax<qreal>(0, qMin<qreal>(0.01*(nb_dec_fast>>1), decode_wait));
                 qWarning("video too fast!!! sleep %.2f s, nb fast: %d, v_a: %.4f", s, nb_dec_fast, v_a);
                 waitAndCheck(s*1000UL, dts);
                 diff = 0;
+                decode_wait = 0;
                 skip_render = false;
             }
         }
         //audio packet not cleaned up?
-        if (diff > 0 && diff < 1.0 && !seeking) {
+        if (decode_wait > 0 && diff < 1.0 && !seeking) {
             // can not change d.delay here! we need it to comapre to next loop
-            waitAndCheck(diff*1000UL, dts);
+            waitAndCheck(decode_wait*1000UL, dts);
         }
         if (wait_key_frame) {
             if (!pkt.hasKeyFrame) {
@@ -587,6 +745,13 @@ void VideoThread::run()
             }
             qDebug("decoder changed. decoding key frame");
         }
+        if (queued) {
+            // decode at most queue_depth frames ahead
+            while (!d.frames.waitNotFull(100) && !d.stop && !d.seek_requested)
+                processNextTask();
+            if (d.stop || d.seek_requested)
+                continue;
+        }
         if (dec_opt != dec_opt_old)
             dec->setOptions(*dec_opt);
         if (!dec->decode(pkt)) {
@@ -608,7 +773,11 @@ void VideoThread::run()
                 if (!pkt.position)
                     break;
             }
-            pkt = Packet();
+            // no frame yet, but the packet may be not sent, e.g. EAGAIN. decode the rest in the next loop
+            if (dec->undecodedSize() == 0)
+                pkt = Packet();
+            else
+                pkt.skip(pkt.data.size() - dec->undecodedSize());
             continue;
         }
 
@@ -635,26 +804,26 @@ void VideoThread::run()
             d.statistics->droppedFrames++;
             d.statistics->mutex.unlock();
             qWarning("invalid video frame from decoder. undecoded data size: %d", pkt.data.size());
-            if (pkt_data == pkt.data.constData()) //FIXME: for libav9. what about other versions?
+            // the decoder may return a pending frame or EAGAIN without taking the packet. keep it until it is sent
+            if (dec->undecodedSize() == 0)
                 pkt = Packet();
-            else
-                pkt_data = pkt.data.constData();
             continue;
         }
-        pkt_data = pkt.data.constData();
         if (frame.timestamp() < 0)
             frame.setTimestamp(pkt.pts); // pkt.pts is wrong. >= real timestamp
         const qreal pts = frame.timestamp();
         d.pts_history.push_back(pts);
         // seek finished because we can ensure no packet before seek decoded when render_pts0 is set
         //qDebug("pts0: %f, pts: %f, clock: %d", d.render_pts0, pts, d.clock->clockType());
+        bool seek_done = false;
         if (d.render_pts0 >= 0.0) {
             if (pts < d.render_pts0) {
-                if (!pkt.isEOF())
+                if (!pkt.isEOF() && dec->undecodedSize() == 0)
                     pkt = Packet();
                 v_a = 0;
                 continue;
             }
+            seek_done = true;
             d.render_pts0 = -1;
             qDebug("video seek finished @%f. id: %d", pts, sync_id);
             d.clock->syncEndOnce(sync_id);
@@ -666,12 +835,23 @@ void VideoThread::run()
         }
         if (skip_render) {
             qDebug("skip rendering @%.3f", pts);
-            pkt = Packet();
+            if (dec->undecodedSize() == 0)
+                pkt = Packet();
             v_a = 0;
             continue;
         }
+        if (queued) {
+            // no v_a correction, presenter waits for the exact pts
+            d.decoded_pts = pts;
+            if (seek_done || isPaused())
+                ++d.present_now;
+            d.frames.put(VideoThreadPrivate::QueuedFrame{frame, d.frames_gen});
+            continue;
+        }
         Q_ASSERT(d.statistics);
+        d.statistics->mutex.lock();
         d.statistics->video.current_time = QTime(0, 0, 0).addMSecs(int(pts * 1000.0)); //TODO: is it expensive?
+        d.statistics->mutex.unlock();
         applyFilters(frame);
 
         //while can pause, processNextTask, not call outset.puase which is deperecated
@@ -709,7 +889,7 @@ void VideoThread::run()
         if (d.force_dt > 0)
             last_deliver_time = QDateTime::currentMSecsSinceEpoch();
         // TODO: store original frame. now the frame is filtered and maybe converted to renderer perferred format
-        d.displayed_frame = frame;
+        d.setDisplayedFrame(frame);
         if (d.clock->clockType() == AVClock::AudioClock) {
             const qreal v_a_ = frame.timestamp() - d.clock->value();
             if (!qFuzzyIsNull(v_a_)) {
@@ -744,6 +924,11 @@ void VideoThread::run()
         while (d.dec && d.dec->decode(Packet::createEOF())) {d.dec->flush();}
     }
 #endif
+    if (queued) {
+        // present the rest frames, e.g. at eof
+        d.presenter_exit = true;
+        d.presenter.join();
+    }
     d.packets.clear();
     qDebug("Video thread stops running...");
 }
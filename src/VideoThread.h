@@ -58,6 +58,9 @@ protected:
     void applyFilters(VideoFrame& frame);
     // deliver video frame to video renderers. frame may be converted to a suitable format for renderer
     bool deliverVideoFrame(VideoFrame &frame);
+    // decoded frame queue mode. presentFrames() runs in its own thread and delivers queued frames at their pts
+    void presentFrames();
+    void flushFrames();
     virtual void run();
     // wait for value msec. every usleep is a small time, then process next task and get new delay
 
@@ -22,6 +22,7 @@
 #include <QtAV/AVDecoder.h>
 #include <QtAV/private/AVDecoder_p.h>
 #include <QtAV/version.h>
+#include <QtAV/Packet.h>
 #include "utils/internal.h"
 #include "utils/Logger.h"
 
@@ -117,6 +118,8 @@ bool AVDecoder::open()
     // dict is used for a specified AVCodec options (priv_class), av_opt_set_xxx(avctx) is only for avctx
     AV_ENSURE_OK(avcodec_open2(d.codec_ctx, codec, d.options.isEmpty() ? NULL : &d.dict), false);
     d.is_open = true;
+    d.frame_pending = false;
+    d.eof_sent = false;
     static const char* thread_name[] = { "Single", "Frame", "Slice"};
     qDebug("%s thread type: %s, count: %d", metaObject()->className(), thread_name[d.codec_ctx->active_thread_type], d.codec_ctx->thread_count);
     return true;
@@ -150,7 +153,10 @@ void AVDecoder::flush()
         return;
     if (!isOpen())
         return;
-    avcodec_flush_buffers(d_func().codec_ctx);
+    DPTR_D(AVDecoder);
+    avcodec_flush_buffers(d.codec_ctx);
+    d.frame_pending = false;
+    d.eof_sent = false;
 }
 
 /*
@@ -263,4 +269,44 @@ void AVDecoderPrivate::applyOptionsForContext()
     // TODO: wrong if opt is empty
     Internal::setOptionsToFFmpegObj(options.value(QStringLiteral("avcodec")), codec_ctx);
 }
+
+int AVDecoderPrivate::decodeFrame(const Packet &packet, AVFrame *frame, bool *got_frame)
+{
+    *got_frame = false;
+    int ret = 0;
+    if (frame_pending) {
+        ret = avcodec_receive_frame(codec_ctx, frame);
+        if (ret == 0) {
+            *got_frame = true;
+            return 0;
+        }
+        frame_pending = false;
+        if (ret != AVERROR(EAGAIN))
+            return ret;
+    }
+    const int size = packet.isEOF() ? 0 : packet.data.size();
+    if (packet.isEOF()) {
+        if (eof_sent)
+            return AVERROR_EOF;
+        eof_sent = true;
+        ret = avcodec_send_packet(codec_ctx, NULL);
+    } else {
+        // const AVPacket*: ffmpeg >= 1.0. no libav
+        ret = avcodec_send_packet(codec_ctx, packet.asAVPacket());
+    }
+    int consumed = size;
+    if (ret == AVERROR(EAGAIN)) // output is not drained. should not happen, take a frame and send again
+        consumed = 0;
+    else if (ret < 0 && ret != AVERROR_EOF)
+        return ret;
+    ret = avcodec_receive_frame(codec_ctx, frame);
+    if (ret == 0) {
+        *got_frame = true;
+        frame_pending = true;
+        return consumed;
+    }
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) // need more input or drained
+        return consumed;
+    return ret;
+}
 } //namespace QtAV
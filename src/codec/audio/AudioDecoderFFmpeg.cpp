@@ -90,27 +90,17 @@ bool AudioDecoderFFmpeg::decode(const Packet &packet)
         return false;
     DPTR_D(AudioDecoderFFmpeg);
     d.decoded.clear();
-    int got_frame_ptr = 0;
-    int ret = 0;
-    if (packet.isEOF()) {
-        Wrapper::AVPacketWrapper eofpkt;
-        ret = compat_decode(d.codec_ctx, &d.frame, &got_frame_ptr, &eofpkt);
-    } else {
-    // const AVPacket*: ffmpeg >= 1.0. no libav
-        ret = compat_decode(d.codec_ctx, &d.frame, &got_frame_ptr, (AVPacket*)packet.asAVPacket());
-    }
-    d.undecoded_size = qMin(packet.data.size() - ret, packet.data.size());
-    if (ret == AVERROR(EAGAIN)) {
-        return false;
-    }
+    bool got_frame = false;
+    const int ret = d.decodeFrame(packet, &d.frame, &got_frame);
     if (ret < 0) {
-        qWarning("[AudioDecoder] %s", av_err2str(ret));
+        d.undecoded_size = 0;
+        if (ret != AVERROR_EOF)
+            qWarning("[AudioDecoder] %s", av_err2str(ret));
         return false;
     }
-    if (!got_frame_ptr) {
-        qWarning("[AudioDecoder] got_frame_ptr=false. decoded: %d, un: %d %s", ret, d.undecoded_size, av_err2str(ret));
+    d.undecoded_size = packet.isEOF() ? 0 : packet.data.size() - ret;
+    if (!got_frame) // need more input, or drained if eof
         return !packet.isEOF();
-    }
 #if USE_AUDIO_FRAME
     return true;
 #endif
@@ -0,0 +1,175 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+
+#include "DecoderThreadBudget.h"
+#include <QtCore/QThread>
+#include "QtAV/private/AVCompat.h"
+
+namespace QtAV {
+// more threads do not scale in ffmpeg decoders
+static const int kMaxThreads = 16;
+
+// relative decoding cost per pixel
+static double codecCost(int codec_id)
+{
+    switch (codec_id) {
+    case AV_CODEC_ID_HEVC:
+    case AV_CODEC_ID_AV1:
+        return 1.5;
+    case AV_CODEC_ID_VP9:
+        return 1.3;
+    case AV_CODEC_ID_MPEG1VIDEO:
+    case AV_CODEC_ID_MPEG2VIDEO:
+    case AV_CODEC_ID_MPEG4:
+    case AV_CODEC_ID_MJPEG:
+        return 0.5;
+    default:
+        return 1.0;
+    }
+}
+
+DecoderThreadBudget& DecoderThreadBudget::instance()
+{
+    static DecoderThreadBudget budget;
+    return budget;
+}
+
+DecoderThreadBudget::DecoderThreadBudget()
+    : m_total(0)
+    , m_next_id(0)
+    , m_generation(0)
+{}
+
+void DecoderThreadBudget::setTotalThreads(int value)
+{
+    QMutexLocker lock(&m_mutex);
+    Q_UNUSED(lock);
+    if (m_total == qMax(value, 0))
+        return;
+    m_total = qMax(value, 0);
+    rebalance();
+}
+
+int DecoderThreadBudget::totalThreads() const
+{
+    QMutexLocker lock(&m_mutex);
+    Q_UNUSED(lock);
+    return m_total > 0 ? m_total : qMax(QThread::idealThreadCount(), 1);
+}
+
+int DecoderThreadBudget::add(int codec_id, int width, int height, double importance)
+{
+    QMutexLocker lock(&m_mutex);
+    Q_UNUSED(lock);
+    Client c;
+    c.cost = codecCost(codec_id);
+    // unknown size before the first frame: assume 1080p
+    c.weight = (width > 0 && height > 0 ? double(width)*double(height) : 1920.0*1080.0) * c.cost;
+    c.importance = qMax(importance, 0.0);
+    c.threads = 0;
+    const int id = m_next_id++;
+    m_clients.insert(id, c);
+    rebalance();
+    return id;
+}
+
+void DecoderThreadBudget::remove(int id)
+{
+    QMutexLocker lock(&m_mutex);
+    Q_UNUSED(lock);
+    if (m_clients.remove(id))
+        rebalance();
+}
+
+void DecoderThreadBudget::setImportance(int id, double importance)
+{
+    QMutexLocker lock(&m_mutex);
+    Q_UNUSED(lock);
+    QHash<int, Client>::iterator it = m_clients.find(id);
+    if (it == m_clients.end() || it->importance == qMax(importance, 0.0))
+        return;
+    it->importance = qMax(importance, 0.0);
+    rebalance();
+}
+
+void DecoderThreadBudget::setFrameSize(int id, int width, int height)
+{
+    if (width <= 0 || height <= 0)
+        return;
+    QMutexLocker lock(&m_mutex);
+    Q_UNUSED(lock);
+    QHash<int, Client>::iterator it = m_clients.find(id);
+    if (it == m_clients.end())
+        return;
+    const double weight = double(width)*double(height)*it->cost;
+    if (it->weight == weight)
+        return;
+    it->weight = weight;
+    rebalance();
+}
+
+int DecoderThreadBudget::threads(int id) const
+{
+    QMutexLocker lock(&m_mutex);
+    Q_UNUSED(lock);
+    return m_clients.value(id).threads;
+}
+
+int DecoderThreadBudget::decoders() const
+{
+    QMutexLocker lock(&m_mutex);
+    Q_UNUSED(lock);
+    return m_clients.size();
+}
+
+QString DecoderThreadBudget::describe(int id) const
+{
+    const int total = totalThreads();
+    QMutexLocker lock(&m_mutex);
+    Q_UNUSED(lock);
+    if (!m_clients.contains(id))
+        return QString();
+    return QStringLiteral("threads %1 of %2, %3 decoders").arg(m_clients.value(id).threads).arg(total).arg(m_clients.size());
+}
+
+void DecoderThreadBudget::rebalance()
+{
+    if (m_clients.isEmpty())
+        return;
+    const int total = m_total > 0 ? m_total : qMax(QThread::idealThreadCount(), 1);
+    // 1 thread for everyone, then the rest by weight
+    const int spare = qMax(total - m_clients.size(), 0);
+    double sum = 0;
+    for (QHash<int, Client>::const_iterator it = m_clients.constBegin(); it != m_clients.constEnd(); ++it)
+        sum += it->weight*it->importance;
+    bool changed = false;
+    for (QHash<int, Client>::iterator it = m_clients.begin(); it != m_clients.end(); ++it) {
+        const double share = sum > 0 ? double(spare)*it->weight*it->importance/sum : 0;
+        const int n = qBound(1, 1 + int(share + 0.5), qMin(kMaxThreads, total));
+        if (it->threads != n)
+            changed = true;
+        it->threads = n;
+    }
+    if (changed)
+        m_generation.fetch_add(1, std::memory_order_release);
+}
+} //namespace QtAV
@@ -0,0 +1,75 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+
+#ifndef QTAV_DECODERTHREADBUDGET_H
+#define QTAV_DECODERTHREADBUDGET_H
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <atomic>
+
+namespace QtAV {
+/*!
+ * \brief The DecoderThreadBudget class
+ * Process wide number of software video decoding threads shared by all decoders using automatic thread count.
+ * Every decoder gets at least 1 thread, the rest is distributed by weight: pixels per frame, codec complexity and
+ * importance (e.g. on-screen size or focus, 1.0 by default). Allocations are recomputed when a decoder is added,
+ * removed, or its frame size or importance changes, and generation() is increased if any allocation changed.
+ */
+class DecoderThreadBudget
+{
+public:
+    static DecoderThreadBudget& instance();
+    /// 0: the number of cpu cores
+    void setTotalThreads(int value);
+    int totalThreads() const;
+    /// return an id for other functions
+    int add(int codec_id, int width, int height, double importance);
+    void remove(int id);
+    void setImportance(int id, double importance);
+    /// the real size is known after the first frame is decoded. a stream without size is added as 1080p
+    void setFrameSize(int id, int width, int height);
+    /// allocated threads. 0 if id is invalid
+    int threads(int id) const;
+    int decoders() const;
+    int generation() const { return m_generation.load(std::memory_order_acquire);}
+    /// e.g. "threads 3 of 8, 4 decoders"
+    QString describe(int id) const;
+private:
+    DecoderThreadBudget();
+    void rebalance(); // with m_mutex locked
+
+    struct Client {
+        double cost; // per pixel, by codec
+        double weight; // without importance
+        double importance;
+        int threads;
+    };
+    mutable QMutex m_mutex;
+    int m_total;
+    int m_next_id;
+    QHash<int, Client> m_clients;
+    std::atomic<int> m_generation;
+};
+} //namespace QtAV
+#endif //QTAV_DECODERTHREADBUDGET_H
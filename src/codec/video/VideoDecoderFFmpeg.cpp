@@ -19,10 +19,13 @@
     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 ******************************************************************************/
 #include "VideoDecoderFFmpegBase.h"
+#include "DecoderThreadBudget.h"
 #include "QtAV/private/AVCompat.h"
 #include "QtAV/private/factory.h"
 #include "QtAV/version.h"
+#include "utils/FrameBufferPool.h"
 #include "utils/Logger.h"
+#include <deque>
 
 /*!
  * options (properties) are from libavcodec/options_table.h
@@ -45,6 +48,8 @@ class VideoDecoderFFmpeg : public VideoDecoderFFmpegBase
     //Q_PROPERTY(StrictType strict READ strict WRITE setStrict)
     Q_PROPERTY(DiscardType skip_frame READ skipFrame WRITE setSkipFrame)
     Q_PROPERTY(int threads READ threads WRITE setThreads) // 0 is auto
+    // weight in the process wide thread budget used if threads is 0, e.g. on-screen size. 1.0 by default
+    Q_PROPERTY(qreal importance READ importance WRITE setImportance)
     Q_PROPERTY(ThreadFlags thread_type READ threadFlags WRITE setThreadFlags)
     Q_PROPERTY(MotionVectorVisFlags vismv READ motionVectorVisFlags WRITE setMotionVectorVisFlags)
     //Q_PROPERTY(BugFlags bug READ bugFlags WRITE setBugFlags)
@@ -141,12 +146,9 @@ public:
     }
     VideoDecoderFFmpeg();
     VideoDecoderId id() const Q_DECL_OVERRIDE Q_DECL_FINAL;
-    QString description() const Q_DECL_OVERRIDE Q_DECL_FINAL {
-        const int patch = QTAV_VERSION_PATCH(avcodec_version());
-        return QStringLiteral("%1 avcodec %2.%3.%4")
-                .arg(patch>=100?QStringLiteral("FFmpeg"):QStringLiteral("Libav"))
-                .arg(QTAV_VERSION_MAJOR(avcodec_version())).arg(QTAV_VERSION_MINOR(avcodec_version())).arg(patch);
-    }
+    QString description() const Q_DECL_OVERRIDE Q_DECL_FINAL;
+    bool decode(const Packet& packet) Q_DECL_OVERRIDE;
+    void flush() Q_DECL_OVERRIDE;
 
     // TODO: av_opt_set in setter
     void setSkipLoopFilter(DiscardType value);
@@ -159,6 +161,8 @@ public:
     DiscardType skipFrame() const;
     void setThreads(int value);
     int threads() const;
+    void setImportance(qreal value);
+    qreal importance() const;
     void setThreadFlags(ThreadFlags value);
     ThreadFlags threadFlags() const;
     void setMotionVectorVisFlags(MotionVectorVisFlags value);
@@ -187,6 +191,9 @@ namespace {
     } sInit_FFmpegHWA;
 }
 
+// reopen for a new thread allocation only if it changes by at least this
+static const int kMinThreadsChange = 2;
+
 class VideoDecoderFFmpegPrivate Q_DECL_FINAL: public VideoDecoderFFmpegBasePrivate
 {
 public:
@@ -200,16 +207,71 @@ public:
       , threads(0)
       , debug_mv(VideoDecoderFFmpeg::No)
       , bug(VideoDecoderFFmpeg::autodetect)
+      , importance(1.0)
+      , budget_id(-1)
+      , budget_generation(-1)
+      , budget_threads(0)
+      , budget_width(0)
+      , budget_height(0)
+      , keep_budget(false)
     {}
+    ~VideoDecoderFFmpegPrivate() {
+        if (budget_id >= 0)
+            DecoderThreadBudget::instance().remove(budget_id);
+    }
+    void close() Q_DECL_OVERRIDE {
+        if (!keep_budget) {
+            drained.clear();
+            if (budget_id >= 0) {
+                DecoderThreadBudget::instance().remove(budget_id);
+                budget_id = -1;
+            }
+        }
+        VideoDecoderFFmpegBasePrivate::close();
+    }
+    // take all frames in flight (e.g. frame threads) before reopening, so that none is dropped
+    void drain() {
+        if (!eof_sent && avcodec_send_packet(codec_ctx, NULL) < 0)
+            return;
+        eof_sent = true;
+        for (;;) {
+            drained.emplace_back();
+            if (avcodec_receive_frame(codec_ctx, &drained.back()) < 0) {
+                drained.pop_back();
+                break;
+            }
+        }
+    }
+    // threads to use. software decoders with auto threads share the process wide budget
+    int threadCount() {
+        if (threads != 0 || !hwa.isEmpty())
+            return threads;
+        DecoderThreadBudget &budget = DecoderThreadBudget::instance();
+        if (budget_id < 0) {
+            budget_id = budget.add(codec_ctx->codec_id, codec_ctx->width, codec_ctx->height, importance);
+            budget_width = codec_ctx->width;
+            budget_height = codec_ctx->height;
+        }
+        budget_generation = budget.generation();
+        budget_threads = budget.threads(budget_id);
+        return budget_threads;
+    }
     bool open() Q_DECL_OVERRIDE {
         av_opt_set_int(codec_ctx, "skip_loop_filter", (int64_t)skip_loop_filter, 0);
         av_opt_set_int(codec_ctx, "skip_idct", (int64_t)skip_idct, 0);
         av_opt_set_int(codec_ctx, "strict", (int64_t)strict, 0);
         av_opt_set_int(codec_ctx, "skip_frame", (int64_t)skip_frame, 0);
-        av_opt_set_int(codec_ctx, "threads", (int64_t)threads, 0);
+        av_opt_set_int(codec_ctx, "threads", (int64_t)threadCount(), 0);
         av_opt_set_int(codec_ctx, "thread_type", (int64_t)thread_type, 0);
         av_opt_set_int(codec_ctx, "vismv", (int64_t)debug_mv, 0);
         av_opt_set_int(codec_ctx, "bug", (int64_t)bug, 0);
+        // decoded frames reuse the process wide pool. hw decoders (mmal, qsv...) use their own buffers
+        if (hwa.isEmpty()) {
+            codec_ctx->get_buffer2 = FrameBufferPool::getBuffer2;
+#if LIBAVCODEC_VERSION_MAJOR < 59
+            codec_ctx->thread_safe_callbacks = 1; // getBuffer2 is thread safe. required by frame threading
+#endif
+        }
         //CODEC_FLAG_EMU_EDGE: deprecated in ffmpeg >=? & libav>=10. always set by ffmpeg
 #if 0
         if (fast) {
@@ -252,6 +314,13 @@ public:
     int debug_mv;
     int bug;
     QString hwa;
+    qreal importance;
+    int budget_id; // DecoderThreadBudget id. <0: not in budget
+    int budget_generation; // budget generation of budget_threads
+    int budget_threads;
+    int budget_width, budget_height; // frame size the budget weight is computed from
+    bool keep_budget; // reopen for a new allocation
+    std::deque<Wrapper::AVFrameWapper> drained; // output before decoding new packets
 };
 
 VideoDecoderFFmpeg::VideoDecoderFFmpeg():
@@ -268,6 +337,84 @@ VideoDecoderFFmpeg::VideoDecoderFFmpeg():
                 .arg(tr("Number of decoding threads. Set before open. Maybe no effect for some decoders"))
                 .arg(tr("0: auto"))
                 .arg(tr("1: single thread decoding")));
+    setProperty("detail_importance", tr("Weight in the thread budget shared by all decoders with auto threads, e.g. on-screen size"));
+}
+
+QString VideoDecoderFFmpeg::description() const
+{
+    DPTR_D(const VideoDecoderFFmpeg);
+    const int patch = QTAV_VERSION_PATCH(avcodec_version());
+    QString s = QStringLiteral("%1 avcodec %2.%3.%4")
+            .arg(patch>=100?QStringLiteral("FFmpeg"):QStringLiteral("Libav"))
+            .arg(QTAV_VERSION_MAJOR(avcodec_version())).arg(QTAV_VERSION_MINOR(avcodec_version())).arg(patch);
+    if (!isOpen() || !d.codec_ctx)
+        return s;
+    if (d.budget_id >= 0)
+        s.append(QStringLiteral(", ")).append(DecoderThreadBudget::instance().describe(d.budget_id));
+    else
+        s.append(QStringLiteral(", threads %1").arg(d.codec_ctx->thread_count));
+    if (d.codec_ctx->active_thread_type & FF_THREAD_FRAME)
+        s.append(QStringLiteral(" (frame)"));
+    else if (d.codec_ctx->active_thread_type & FF_THREAD_SLICE)
+        s.append(QStringLiteral(" (slice)"));
+    return s;
+}
+
+bool VideoDecoderFFmpeg::decode(const Packet &packet)
+{
+    DPTR_D(VideoDecoderFFmpeg);
+    // thread count can only be changed by reopening. do it at a key frame, decoding can restart cleanly there
+    DecoderThreadBudget &budget = DecoderThreadBudget::instance();
+    if (d.budget_id >= 0 && packet.hasKeyFrame && d.budget_generation != budget.generation()) {
+        const int n = d.budget_threads;
+        d.budget_generation = budget.generation();
+        // a small change is not worth a reopen, e.g. every decoder changes by 1 when a player starts
+        if (qAbs(budget.threads(d.budget_id) - n) >= kMinThreadsChange) {
+            d.drain();
+            // avcodec_open2() on a closed context is deprecated. open a new one with the same parameters
+            AVCodecParameters *par = avcodec_parameters_alloc();
+            const bool copied = par && avcodec_parameters_from_context(par, d.codec_ctx) >= 0;
+            d.keep_budget = true;
+            close();
+            if (copied) {
+                d.codec_ctx = par;
+                d.applyOptionsForContext();
+            }
+            avcodec_parameters_free(&par);
+            const bool ok = copied && open();
+            d.keep_budget = false;
+            if (!ok)
+                return false;
+            qDebug("decoding threads changed: %d => %d", n, d.budget_threads);
+            Q_EMIT descriptionChanged(description());
+        }
+    }
+    // frames drained before reopening. the packet is not consumed
+    if (!d.drained.empty()) {
+        av_frame_unref(&d.frame);
+        av_frame_move_ref(&d.frame, &d.drained.front());
+        d.drained.pop_front();
+        d.undecoded_size = packet.isEOF() ? 0 : packet.data.size();
+        d.width = d.frame->width;
+        d.height = d.frame->height;
+        return true;
+    }
+    if (!VideoDecoderFFmpegBase::decode(packet))
+        return false;
+    if (d.budget_id >= 0 && (d.width != d.budget_width || d.height != d.budget_height)) {
+        d.budget_width = d.width;
+        d.budget_height = d.height;
+        budget.setFrameSize(d.budget_id, d.width, d.height);
+    }
+    return true;
+}
+
+void VideoDecoderFFmpeg::flush()
+{
+    DPTR_D(VideoDecoderFFmpeg);
+    if (!d.keep_budget) // not reopening for a new allocation, e.g. seek
+        d.drained.clear();
+    VideoDecoderFFmpegBase::flush();
 }
 
 VideoDecoderId VideoDecoderFFmpeg::id() const
@@ -347,6 +494,19 @@ int VideoDecoderFFmpeg::threads() const
     return d_func().threads;
 }
 
+void VideoDecoderFFmpeg::setImportance(qreal value)
+{
+    DPTR_D(VideoDecoderFFmpeg);
+    d.importance = value;
+    if (d.budget_id >= 0)
+        DecoderThreadBudget::instance().setImportance(d.budget_id, value);
+}
+
+qreal VideoDecoderFFmpeg::importance() const
+{
+    return d_func().importance;
+}
+
 void VideoDecoderFFmpeg::setThreadFlags(ThreadFlags value)
 {
     DPTR_D(VideoDecoderFFmpeg);
@@ -409,6 +569,7 @@ void i18n() {
     QObject::tr("skip_frame");
     QObject::tr("threads");
     QObject::tr("thread_type");
+    QObject::tr("importance");
     QObject::tr("vismv");
     QObject::tr("bug");
 }
@@ -103,27 +103,17 @@ bool VideoDecoderFFmpegBase::decode(const Packet &packet)
         return false;
     DPTR_D(VideoDecoderFFmpegBase);
     // some decoders might need other fields like flags&AV_PKT_FLAG_KEY
-    // const AVPacket*: ffmpeg >= 1.0. no libav
-    int got_frame_ptr = 0;
-    int ret = 0;
-    if (packet.isEOF()) {
-        Wrapper::AVPacketWrapper eofpkt;
-        ret = compat_decode(d.codec_ctx, &d.frame, &got_frame_ptr, &eofpkt);
-
-    } else {
-        ret = compat_decode(d.codec_ctx, &d.frame, &got_frame_ptr, (AVPacket*)packet.asAVPacket());
-    }
-
+    bool got_frame = false;
+    const int ret = d.decodeFrame(packet, &d.frame, &got_frame);
     //qDebug("pic_type=%c", av_get_picture_type_char(d.frame->pict_type));
-    d.undecoded_size = qMin(packet.data.size() - ret, packet.data.size());
     if (ret < 0) {
+        d.undecoded_size = 0;
         //qWarning("[VideoDecoderFFmpegBase] %s", av_err2str(ret));
         return false;
     }
-    if (!got_frame_ptr) {
-        qWarning("no frame could be decompressed: %s %d/%d", av_err2str(ret), d.undecoded_size, packet.data.size());
-        return !packet.isEOF();
-    }
+    d.undecoded_size = packet.isEOF() ? 0 : packet.data.size() - ret;
+    if (!got_frame) // delayed output (b-frames, frame threads) or drained
+        return false;
     if (!d.codec_ctx->width || !d.codec_ctx->height)
         return false;
     //qDebug("codec %dx%d, frame %dx%d", d.codec_ctx->width, d.codec_ctx->height, d.frame->width, d.frame->height);
@@ -145,10 +135,12 @@ VideoFrame VideoDecoderFFmpegBase::frame()
     frame.setBytesPerLine(d.frame->linesize);
     // in s. TODO: what about AVFrame.pts? av_frame_get_best_effort_timestamp? move to VideoFrame::from(AVFrame*)
     frame.setTimestamp((double)d.frame->pts/1000.0);
-    frame.setMetaData(QStringLiteral("avbuf"), QVariant::fromValue(AVFrameBuffersRef(new AVFrameBuffers(&d.frame))));
+    frame.setSideData(Frame::BufferOwnerSideData, AVFrameBuffersRef::create(&d.frame));
     d.updateColorDetails(&frame);
     if (frame.format().hasPalette()) {
-        frame.setMetaData(QStringLiteral("pallete"), QByteArray((const char*)d.frame->data[1], 256*4));
+        QSharedPointer<VideoFramePalette> pal(QSharedPointer<VideoFramePalette>::create());
+        memcpy(pal->colors, d.frame->data[1], VideoFramePalette::Size);
+        frame.setSideData(Frame::PaletteSideData, pal);
     }
     return frame;
 }
@@ -152,7 +152,7 @@ VideoFrame VideoDecoderMediaCodec::frame()
         frame.setBytesPerLine(d.frame->linesize);
         // in s. TODO: what about AVFrame.pts? av_frame_get_best_effort_timestamp? move to VideoFrame::from(AVFrame*)
         frame.setTimestamp((double)d.frame->pkt_pts/1000.0);
-        frame.setMetaData(QStringLiteral("avbuf"), QVariant::fromValue(AVFrameBuffersRef(new AVFrameBuffers(d.frame))));
+        frame.setSideData(Frame::BufferOwnerSideData, AVFrameBuffersRef::create(d.frame));
         d.updateColorDetails(&frame);
         return frame;
     }
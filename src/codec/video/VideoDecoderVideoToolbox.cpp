@@ -205,12 +205,12 @@ VideoFrame VideoDecoderVideoToolbox::frame()
         frame.setBytesPerLine(cpu_frame->linesize);
         // in s. TODO: what about AVFrame.pts? av_frame_get_best_effort_timestamp? move to VideoFrame::from(AVFrame*)
         frame.setTimestamp((double) cpu_frame->pts / 1000.0);
-        frame.setMetaData(QStringLiteral("avbuf"),
-                          QVariant::fromValue(AVFrameBuffersRef(new AVFrameBuffers(&cpu_frame))));
+        frame.setSideData(Frame::BufferOwnerSideData, AVFrameBuffersRef::create(&cpu_frame));
         d.updateColorDetails(&frame);
         if (frame.format().hasPalette()) {
-            frame.setMetaData(QStringLiteral("pallete"),
-                              QByteArray((const char *) cpu_frame->data[1], 256 * 4));
+            QSharedPointer<VideoFramePalette> pal(QSharedPointer<VideoFramePalette>::create());
+            memcpy(pal->colors, cpu_frame->data[1], VideoFramePalette::Size);
+            frame.setSideData(Frame::PaletteSideData, pal);
         }
         return frame;
     }
@@ -43,7 +43,7 @@ namespace QtAV {
 
 #if QTAV_HAVE(AVFILTER)
 // local types can not be used as template parameters
-class AVFrameHolder {
+class AVFrameHolder : public FrameSideData {
 public:
     AVFrameHolder() {
         m_frame = av_frame_alloc();
@@ -360,7 +360,7 @@ void LibAVFilterVideo::process(Statistics *statistics, VideoFrame *frame)
     VideoFrame vf(f->width, f->height, VideoFormat(f->format));
     vf.setBits((quint8**)f->data);
     vf.setBytesPerLine((int*)f->linesize);
-    vf.setMetaData(QStringLiteral("avframe_hoder_ref"), QVariant::fromValue(ref));
+    vf.setSideData(Frame::BufferOwnerSideData, ref);
     vf.setTimestamp(ref->frame()->pts/1000000.0); //pkt_pts?
     //vf.setMetaData(frame->availableMetaData());
     *frame = vf;
@@ -460,7 +460,7 @@ void LibAVFilterAudio::process(Statistics *statistics, AudioFrame *frame)
     af.setBits(f->extended_data); // TODO: ref
     af.setBytesPerLine(f->linesize[0], 0); // for correct alignment
     af.setSamplesPerChannel(f->nb_samples);
-    af.setMetaData(QStringLiteral("avframe_hoder_ref"), QVariant::fromValue(ref));
+    af.setSideData(Frame::BufferOwnerSideData, ref);
     af.setTimestamp(ref->frame()->pts/1000000.0); //pkt_pts?
     //af.setMetaData(frame->availableMetaData());
     *frame = af;
@@ -540,7 +540,3 @@ bool LibAVFilter::Private::pushAudioFrame(Frame *frame, bool changed, const QStr
 }
 
 } //namespace QtAV
-
-#if QTAV_HAVE(AVFILTER)
-Q_DECLARE_METATYPE(QtAV::AVFrameHolderRef)
-#endif
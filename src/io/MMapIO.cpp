@@ -0,0 +1,273 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include "QtAV/MediaIO.h"
+#include "QtAV/private/MediaIO_p.h"
+#include "QtAV/private/mkid.h"
+#include "QtAV/private/factory.h"
+#include <QtCore/QFile>
+#include <string.h>
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "utils/Logger.h"
+
+namespace QtAV {
+/*!
+ * \brief The MMapIO class
+ * Read only io for local files. The whole file is mapped and read() is a memcpy from the mapping.
+ * Access pattern hints (madvise) follow the reads: a far seek switches to random access, a long
+ * contiguous read switches back to sequential. If prefaultSize > 0, the next prefaultSize bytes
+ * after the read position are requested to be paged in.
+ * Falls back to plain file reading if the file can not be mapped (e.g. 32bit address space).
+ * protocol: "mmap", e.g. "mmap:/path/to/file.mp4"
+ */
+class MMapIOPrivate;
+class MMapIO Q_DECL_FINAL : public MediaIO
+{
+    Q_OBJECT
+    Q_PROPERTY(qint64 prefaultSize READ prefaultSize WRITE setPrefaultSize NOTIFY prefaultSizeChanged)
+    DPTR_DECLARE_PRIVATE(MMapIO)
+public:
+    MMapIO();
+    QString name() const Q_DECL_OVERRIDE;
+    const QStringList& protocols() const Q_DECL_OVERRIDE
+    {
+        static QStringList p = QStringList() << QStringLiteral("mmap");
+        return p;
+    }
+    bool isSeekable() const Q_DECL_OVERRIDE;
+    qint64 read(char *data, qint64 maxSize) Q_DECL_OVERRIDE;
+    bool seek(qint64 offset, int from) Q_DECL_OVERRIDE;
+    qint64 position() const Q_DECL_OVERRIDE;
+    qint64 size() const Q_DECL_OVERRIDE;
+
+    /// bytes to page in ahead of the read position. 0(default): disabled
+    void setPrefaultSize(qint64 value);
+    qint64 prefaultSize() const;
+Q_SIGNALS:
+    void prefaultSizeChanged();
+protected:
+    void onUrlChanged() Q_DECL_OVERRIDE;
+};
+typedef MMapIO MediaIOMMap;
+static const MediaIOId MediaIOId_MMap = mkid::id32base36_4<'M','M','a','p'>::value;
+static const char kMMapName[] = "MMap";
+FACTORY_REGISTER(MediaIO, MMap, kMMapName)
+
+// seek farther than it is random access. demuxers seek a little to parse headers/indexes
+static const qint64 kRandomSeekDistance = 1024*1024;
+// contiguous bytes read after a random seek to switch back to sequential access
+static const qint64 kSequentialRun = 4*1024*1024;
+
+class MMapIOPrivate Q_DECL_FINAL : public MediaIOPrivate
+{
+public:
+    MMapIOPrivate()
+        : MediaIOPrivate()
+        , data(0)
+        , size(0)
+        , pos(0)
+        , prefault(0)
+        , prefaulted(0)
+        , random(false)
+        , run_start(0)
+    {}
+    ~MMapIOPrivate() {
+        close();
+    }
+    void close() {
+        if (data)
+            file.unmap(data);
+        data = 0;
+        if (file.isOpen())
+            file.close();
+        size = pos = 0;
+        prefaulted = 0;
+        random = false;
+        run_start = 0;
+    }
+    void advise(qint64 offset, qint64 len, int hint) {
+#ifdef Q_OS_UNIX
+        static const qint64 page = sysconf(_SC_PAGESIZE) > 0 ? sysconf(_SC_PAGESIZE) : 4096;
+        if (!data || len <= 0)
+            return;
+        const qint64 begin = offset & ~(page - 1); // madvise requires page aligned address
+        len = qMin(offset + len, size) - begin;
+        if (len > 0)
+            madvise(data + begin, len, hint);
+#else
+        Q_UNUSED(offset);
+        Q_UNUSED(len);
+        Q_UNUSED(hint);
+#endif
+    }
+    void setRandom(bool value) {
+        if (random == value)
+            return;
+        random = value;
+#ifdef Q_OS_UNIX
+        advise(0, size, random ? MADV_RANDOM : MADV_SEQUENTIAL);
+#endif
+    }
+    void prefetch() {
+        if (prefault <= 0 || !data)
+            return;
+        if (prefaulted < pos)
+            prefaulted = pos;
+        const qint64 end = qMin(pos + prefault, size);
+        // request in big steps, not for every avio read
+        if (end - prefaulted < prefault/2)
+            return;
+#ifdef Q_OS_UNIX
+        advise(prefaulted, end - prefaulted, MADV_WILLNEED);
+#else
+        // touch one byte per page
+        volatile uchar sum = 0;
+        for (qint64 i = prefaulted; i < end; i += 4096)
+            sum += data[i];
+        Q_UNUSED(sum);
+#endif
+        prefaulted = end;
+    }
+
+    QFile file;
+    uchar *data; // null if not mapped, then read from file
+    qint64 size;
+    qint64 pos;
+    qint64 prefault;
+    qint64 prefaulted; // [pos, prefaulted) is requested
+    bool random;
+    qint64 run_start; // start of the current contiguous read
+};
+
+MMapIO::MMapIO() : MediaIO(*new MMapIOPrivate()) {}
+QString MMapIO::name() const { return QLatin1String(kMMapName);}
+
+bool MMapIO::isSeekable() const
+{
+    DPTR_D(const MMapIO);
+    return d.file.isOpen();
+}
+
+qint64 MMapIO::read(char *data, qint64 maxSize)
+{
+    DPTR_D(MMapIO);
+    if (!d.data) {
+        if (!d.file.isOpen())
+            return 0;
+        const qint64 n = d.file.read(data, maxSize);
+        return n < 0 ? 0 : n;
+    }
+    const qint64 n = qMin(maxSize, d.size - d.pos);
+    if (n <= 0)
+        return 0;
+    memcpy(data, d.data + d.pos, n);
+    d.pos += n;
+    if (d.random && d.pos - d.run_start >= kSequentialRun)
+        d.setRandom(false);
+    d.prefetch();
+    return n;
+}
+
+bool MMapIO::seek(qint64 offset, int from)
+{
+    DPTR_D(MMapIO);
+    if (!d.file.isOpen())
+        return false;
+    if (from == SEEK_END)
+        offset = d.size + offset;
+    else if (from == SEEK_CUR)
+        offset = position() + offset;
+    if (offset < 0 || offset > d.size)
+        return false;
+    if (!d.data)
+        return d.file.seek(offset);
+    if (qAbs(offset - d.pos) >= kRandomSeekDistance) {
+        d.setRandom(true);
+        d.prefaulted = 0;
+    }
+    if (offset != d.pos)
+        d.run_start = offset;
+    d.pos = offset;
+    d.prefetch();
+    return true;
+}
+
+qint64 MMapIO::position() const
+{
+    DPTR_D(const MMapIO);
+    if (!d.data)
+        return d.file.isOpen() ? d.file.pos() : 0;
+    return d.pos;
+}
+
+qint64 MMapIO::size() const
+{
+    return d_func().size;
+}
+
+void MMapIO::setPrefaultSize(qint64 value)
+{
+    DPTR_D(MMapIO);
+    if (d.prefault == value)
+        return;
+    d.prefault = value;
+    d.prefaulted = 0;
+    Q_EMIT prefaultSizeChanged();
+}
+
+qint64 MMapIO::prefaultSize() const
+{
+    return d_func().prefault;
+}
+
+void MMapIO::onUrlChanged()
+{
+    DPTR_D(MMapIO);
+    d.close();
+    QString path(url());
+    if (path.startsWith(QLatin1String("mmap:")))
+        path = path.mid(5);
+    if (path.isEmpty())
+        return;
+    d.file.setFileName(path);
+    if (!d.file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open [" << d.file.fileName() << "]: " << d.file.errorString();
+        return;
+    }
+    d.size = d.file.size();
+    if (d.size <= 0)
+        return;
+    d.data = d.file.map(0, d.size);
+    if (!d.data) {
+        qWarning() << "Failed to map [" << d.file.fileName() << "]: " << d.file.errorString() << ". read from file";
+        return;
+    }
+    // demuxing starts sequential reading
+    d.random = true;
+    d.setRandom(false);
+    d.prefetch();
+}
+
+} //namespace QtAV
+#include "MMapIO.moc"
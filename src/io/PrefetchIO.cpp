@@ -0,0 +1,456 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include "QtAV/MediaIO.h"
+#include "QtAV/private/MediaIO_p.h"
+#include "QtAV/private/mkid.h"
+#include "QtAV/private/factory.h"
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "utils/Logger.h"
+
+namespace QtAV {
+/*!
+ * \brief The PrefetchIO class
+ * Read-ahead decorator. A background thread reads the source into a ring buffer so that a slow or high
+ * latency read (NFS/SMB mounts, network) does not block the demuxer as long as the buffer is not drained.
+ * The ring keeps a window [start, end) of the source. Seeking inside the window (including a part of the
+ * already consumed data) only moves the read position, seeking outside restarts reading at the new offset.
+ * Source:
+ *  - property "source": any MediaIO, not owned. Set it before playback, url is ignored then.
+ *  - url "prefetch:xxx": xxx is opened by the MediaIO supporting its protocol, by "QFile" if it's a local
+ *    path, otherwise by FFmpeg avio.
+ * protocol: "prefetch", e.g. "prefetch:/mnt/nfs/cam1.mkv", "prefetch:http://host/a.mp4"
+ */
+class PrefetchIOPrivate;
+class PrefetchIO Q_DECL_FINAL : public MediaIO
+{
+    Q_OBJECT
+    Q_PROPERTY(QtAV::MediaIO* source READ source WRITE setSource NOTIFY sourceChanged)
+    Q_PROPERTY(qint64 capacity READ capacity WRITE setCapacity NOTIFY capacityChanged)
+    Q_PROPERTY(qint64 fillLevel READ fillLevel)
+    Q_PROPERTY(qint64 throughput READ throughput)
+    DPTR_DECLARE_PRIVATE(PrefetchIO)
+public:
+    PrefetchIO();
+    QString name() const Q_DECL_OVERRIDE;
+    const QStringList& protocols() const Q_DECL_OVERRIDE
+    {
+        static QStringList p = QStringList() << QStringLiteral("prefetch");
+        return p;
+    }
+    bool isSeekable() const Q_DECL_OVERRIDE;
+    qint64 read(char *data, qint64 maxSize) Q_DECL_OVERRIDE;
+    bool seek(qint64 offset, int from) Q_DECL_OVERRIDE;
+    qint64 position() const Q_DECL_OVERRIDE;
+    qint64 size() const Q_DECL_OVERRIDE;
+    bool isVariableSize() const Q_DECL_OVERRIDE;
+
+    void setSource(MediaIO* io);
+    MediaIO* source() const;
+    /// ring buffer size in bytes. default is 32MB. applied when the source is (re)opened
+    void setCapacity(qint64 value);
+    qint64 capacity() const;
+    /// buffered bytes after the read position
+    qint64 fillLevel() const;
+    /// bytes per second the source delivered recently. 0 if unknown
+    qint64 throughput() const;
+Q_SIGNALS:
+    void sourceChanged();
+    void capacityChanged();
+protected:
+    void onUrlChanged() Q_DECL_OVERRIDE;
+};
+typedef PrefetchIO MediaIOPrefetch;
+static const MediaIOId MediaIOId_Prefetch = mkid::id32base36_5<'P','r','e','f','t'>::value;
+static const char kPrefetchName[] = "Prefetch";
+FACTORY_REGISTER(MediaIO, Prefetch, kPrefetchName)
+
+static const int kReadChunk = 256*1024;
+
+// the io the ring buffer is filled from. all functions except size() are called in prefetch thread only
+class PrefetchSource
+{
+public:
+    virtual ~PrefetchSource() {}
+    virtual bool isSeekable() const = 0;
+    virtual qint64 read(char* data, qint64 maxSize) = 0; // <0: error, 0: eof
+    virtual bool seek(qint64 pos) = 0;
+    virtual qint64 size() const = 0;
+    virtual bool isVariableSize() const { return false;}
+};
+
+class MediaIOSource Q_DECL_FINAL : public PrefetchSource
+{
+public:
+    MediaIOSource(MediaIO* io, bool owns) : m_io(io), m_owns(owns) {}
+    ~MediaIOSource() {
+        if (m_owns)
+            delete m_io;
+    }
+    bool isSeekable() const Q_DECL_OVERRIDE { return m_io->isSeekable();}
+    qint64 read(char* data, qint64 maxSize) Q_DECL_OVERRIDE { return m_io->read(data, maxSize);}
+    bool seek(qint64 pos) Q_DECL_OVERRIDE { return m_io->seek(pos, SEEK_SET);}
+    qint64 size() const Q_DECL_OVERRIDE { return m_io->size();}
+    bool isVariableSize() const Q_DECL_OVERRIDE { return m_io->isVariableSize();}
+private:
+    MediaIO *m_io;
+    bool m_owns;
+};
+
+class AVIOSource Q_DECL_FINAL : public PrefetchSource
+{
+public:
+    AVIOSource() : m_ctx(0), m_size(0) {}
+    ~AVIOSource() {
+        if (m_ctx)
+            avio_closep(&m_ctx);
+    }
+    bool open(const QString& url, const AVIOInterruptCB* cb) {
+        const int ret = avio_open2(&m_ctx, url.toUtf8().constData(), AVIO_FLAG_READ, cb, NULL);
+        if (ret < 0) {
+            qWarning("PrefetchIO: avio_open2 error: %s", av_err2str(ret));
+            m_ctx = 0;
+            return false;
+        }
+        m_size = avio_size(m_ctx);
+        return true;
+    }
+    bool isSeekable() const Q_DECL_OVERRIDE { return m_ctx && m_ctx->seekable;}
+    qint64 read(char* data, qint64 maxSize) Q_DECL_OVERRIDE {
+        const int ret = avio_read_partial(m_ctx, (unsigned char*)data, (int)qMin<qint64>(maxSize, INT_MAX));
+        if (ret == AVERROR_EOF)
+            return 0;
+        return ret;
+    }
+    bool seek(qint64 pos) Q_DECL_OVERRIDE { return avio_seek(m_ctx, pos, SEEK_SET) >= 0;}
+    qint64 size() const Q_DECL_OVERRIDE { return m_size;}
+private:
+    AVIOContext *m_ctx;
+    qint64 m_size;
+};
+
+class PrefetchIOPrivate Q_DECL_FINAL : public MediaIOPrivate
+{
+public:
+    PrefetchIOPrivate()
+        : MediaIOPrivate()
+        , user_io(0)
+        , capacity(32*1024*1024)
+        , src(0)
+        , src_size(0)
+        , seekable(false)
+        , variable_size(false)
+        , start(0)
+        , end(0)
+        , pos(0)
+        , pending_seek(-1)
+        , generation(0)
+        , eof(false)
+        , error(false)
+        , stop(false)
+        , throughput(0)
+    {
+        interrupt_cb.callback = interrupted;
+        interrupt_cb.opaque = this;
+    }
+    ~PrefetchIOPrivate() {
+        close();
+    }
+    static int interrupted(void* opaque) {
+        return static_cast<PrefetchIOPrivate*>(opaque)->stop.load() ? 1 : 0;
+    }
+    void open(PrefetchSource* s) {
+        close();
+        if (!s)
+            return;
+        src = s;
+        seekable = src->isSeekable();
+        variable_size = src->isVariableSize();
+        src_size = src->size();
+        ring.resize(size_t(qMax<qint64>(capacity, 2*kReadChunk)));
+        start = end = pos = 0;
+        pending_seek = -1;
+        eof = error = false;
+        stop = false;
+        throughput = 0;
+        thread = std::thread(&PrefetchIOPrivate::run, this);
+    }
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+            ++generation;
+        }
+        cond_space.notify_all();
+        cond_data.notify_all();
+        if (thread.joinable())
+            thread.join();
+        delete src;
+        src = 0;
+        std::vector<char>().swap(ring);
+    }
+    qint64 ringSize() const { return qint64(ring.size());}
+    size_t index(qint64 offset) const { return size_t(offset % ringSize());}
+    // bytes before the read position kept for short backward seeks
+    qint64 backlog() const { return ringSize()/8;}
+
+    void run() {
+        std::vector<char> scratch; // source is read here if the free part of the ring wraps around
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stop) {
+            if (pending_seek >= 0) {
+                const qint64 target = pending_seek;
+                const quint64 gen = generation;
+                pending_seek = -1;
+                lock.unlock();
+                const bool ok = src->seek(target);
+                lock.lock();
+                if (gen != generation)
+                    continue;
+                if (!ok) {
+                    qWarning("PrefetchIO: source seek to %lld error", target);
+                    error = true;
+                    cond_data.notify_all();
+                }
+                continue;
+            }
+            // ring is full (keeping the backlog) or nothing to read
+            const qint64 free = ringSize() - (end - qMax(start, pos - backlog()));
+            if (eof || error || free <= 0) {
+                cond_space.wait(lock);
+                continue;
+            }
+            const qint64 offset = end;
+            const size_t i = index(offset);
+            qint64 n = qMin<qint64>(free, kReadChunk);
+            char *dst = &ring[i];
+            if (i + n > ring.size()) {
+                scratch.resize(size_t(n));
+                dst = scratch.data();
+            }
+            // data to be overwritten is no longer in the window, so a concurrent seek will not use it
+            start = qMax(start, offset + n - ringSize());
+            const quint64 gen = generation;
+            lock.unlock();
+            const auto t0 = std::chrono::steady_clock::now();
+            qint64 got = src->read(dst, n);
+            const auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+            if (got > 0 && dst == scratch.data()) {
+                const size_t head = ring.size() - i;
+                memcpy(&ring[i], dst, qMin<size_t>(head, size_t(got)));
+                if (size_t(got) > head)
+                    memcpy(&ring[0], dst + head, size_t(got) - head);
+            }
+            if (got > 0 && us > 0) {
+                const qint64 bps = got*1000000LL/us;
+                const qint64 old = throughput.load(std::memory_order_relaxed);
+                throughput.store(old > 0 ? (old*7 + bps)/8 : bps, std::memory_order_relaxed);
+            }
+            if (variable_size)
+                src_size = src->size();
+            lock.lock();
+            if (gen != generation) // seek out of the window while reading. discard
+                continue;
+            if (got > 0)
+                end += got;
+            else if (got == 0)
+                eof = true;
+            else
+                error = true;
+            cond_data.notify_all();
+        }
+    }
+
+    MediaIO *user_io;
+    qint64 capacity;
+    PrefetchSource *src;
+    std::atomic<qint64> src_size;
+    bool seekable;
+    bool variable_size;
+    AVIOInterruptCB interrupt_cb;
+
+    mutable std::mutex mutex;
+    std::condition_variable cond_data; // data available, eof or error
+    std::condition_variable cond_space; // data consumed, seek requested or stop
+    std::thread thread;
+    std::vector<char> ring; // ring[offset%size] is the byte at source offset
+    qint64 start, end; // window of valid source bytes in ring
+    qint64 pos; // read position
+    qint64 pending_seek; // >=0: source must seek there before reading
+    quint64 generation; // increased when the window is reset
+    bool eof, error;
+    std::atomic<bool> stop;
+    std::atomic<qint64> throughput;
+};
+
+PrefetchIO::PrefetchIO() : MediaIO(*new PrefetchIOPrivate()) {}
+QString PrefetchIO::name() const { return QLatin1String(kPrefetchName);}
+
+bool PrefetchIO::isSeekable() const
+{
+    DPTR_D(const PrefetchIO);
+    return d.src && d.seekable;
+}
+
+qint64 PrefetchIO::read(char *data, qint64 maxSize)
+{
+    DPTR_D(PrefetchIO);
+    if (!d.src || maxSize <= 0)
+        return 0;
+    std::unique_lock<std::mutex> lock(d.mutex);
+    while (d.pos >= d.end && !d.eof && !d.error && !d.stop)
+        d.cond_data.wait(lock);
+    const qint64 n = qMin(maxSize, d.end - d.pos);
+    if (n <= 0)
+        return 0;
+    // the writer never touches [start, end)
+    const size_t i = d.index(d.pos);
+    const size_t head = qMin<size_t>(d.ring.size() - i, size_t(n));
+    memcpy(data, &d.ring[i], head);
+    if (size_t(n) > head)
+        memcpy(data + head, &d.ring[0], size_t(n) - head);
+    d.pos += n;
+    lock.unlock();
+    d.cond_space.notify_one();
+    return n;
+}
+
+bool PrefetchIO::seek(qint64 offset, int from)
+{
+    DPTR_D(PrefetchIO);
+    if (!d.src || !d.seekable)
+        return false;
+    std::unique_lock<std::mutex> lock(d.mutex);
+    if (from == SEEK_END)
+        offset = d.src_size + offset;
+    else if (from == SEEK_CUR)
+        offset = d.pos + offset;
+    if (offset < 0 || (d.src_size > 0 && offset > d.src_size && !d.variable_size))
+        return false;
+    if (offset >= d.start && offset <= d.end) {
+        d.pos = offset;
+        return true;
+    }
+    d.start = d.end = d.pos = offset;
+    d.pending_seek = offset;
+    ++d.generation;
+    d.eof = d.error = false;
+    lock.unlock();
+    d.cond_space.notify_one();
+    return true;
+}
+
+qint64 PrefetchIO::position() const
+{
+    DPTR_D(const PrefetchIO);
+    std::lock_guard<std::mutex> lock(d.mutex);
+    return d.pos;
+}
+
+qint64 PrefetchIO::size() const
+{
+    return d_func().src_size;
+}
+
+bool PrefetchIO::isVariableSize() const
+{
+    return d_func().variable_size;
+}
+
+void PrefetchIO::setSource(MediaIO *io)
+{
+    DPTR_D(PrefetchIO);
+    if (d.user_io == io)
+        return;
+    d.user_io = io;
+    d.open(io ? new MediaIOSource(io, false) : 0);
+    Q_EMIT sourceChanged();
+}
+
+MediaIO* PrefetchIO::source() const
+{
+    return d_func().user_io;
+}
+
+void PrefetchIO::setCapacity(qint64 value)
+{
+    DPTR_D(PrefetchIO);
+    if (d.capacity == value)
+        return;
+    d.capacity = value;
+    Q_EMIT capacityChanged();
+}
+
+qint64 PrefetchIO::capacity() const
+{
+    return d_func().capacity;
+}
+
+qint64 PrefetchIO::fillLevel() const
+{
+    DPTR_D(const PrefetchIO);
+    std::lock_guard<std::mutex> lock(d.mutex);
+    return d.end - d.pos;
+}
+
+qint64 PrefetchIO::throughput() const
+{
+    return d_func().throughput.load(std::memory_order_relaxed);
+}
+
+void PrefetchIO::onUrlChanged()
+{
+    DPTR_D(PrefetchIO);
+    if (d.user_io)
+        return;
+    QString path(url());
+    if (path.startsWith(QLatin1String("prefetch:")))
+        path = path.mid(9);
+    d.close();
+    if (path.isEmpty())
+        return;
+    d.stop = false; // avio_open2 checks the interrupt callback
+    const int p = path.indexOf(QLatin1Char(':'));
+    MediaIO *io = 0;
+    if (p > 1) // 1: windows drive
+        io = MediaIO::createForUrl(path);
+    else
+        io = MediaIO::createForUrl(QStringLiteral("qfile:") + path);
+    if (io) {
+        d.open(new MediaIOSource(io, true));
+        return;
+    }
+    AVIOSource *avio = new AVIOSource();
+    if (!avio->open(path, &d.interrupt_cb)) {
+        delete avio;
+        return;
+    }
+    d.open(avio);
+}
+
+} //namespace QtAV
+#include "PrefetchIO.moc"
@@ -446,6 +446,7 @@ SOURCES += \
     subtitle/SubtitleProcessorFFmpeg.cpp \
     utils/GPUMemCopy.cpp \
     utils/Logger.cpp \
+    utils/WorkPool.cpp \
     AudioThread.cpp \
     utils/internal.cpp \
     AVThread.cpp \
@@ -594,6 +595,8 @@ HEADERS *= \
     utils/SharedPtr.h \
     utils/ring.h \
     utils/internal.h \
+    utils/WorkPool.h \
+    utils/RealtimeDecodeTask.h \
     output/OutputSet.h \
     ColorTransform.h
 # from mkspecs/features/qt_module.prf
@@ -20,10 +20,76 @@
 ******************************************************************************/
 
 #include "output/OutputSet.h"
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QVarLengthArray>
 #include "QtAV/AVPlayer.h"
 #include "QtAV/VideoRenderer.h"
+#include "utils/WorkPool.h"
 
 namespace QtAV {
+namespace {
+// converts a frame to 1 format on a WorkPool worker, or in the sending thread if no worker has taken it.
+// owned by the pool and the sender, deleted by the last release()
+class ConvertTask : public WorkPool::Task
+{
+public:
+    enum { Posted, Running, Done };
+    ConvertTask(const VideoFrame& frame, VideoFormat::PixelFormat format)
+        : time(0)
+        , m_frame(frame)
+        , m_format(format)
+        , m_state(Posted)
+        , m_refs(2)
+    {}
+    void run() Q_DECL_OVERRIDE {
+        if (claim())
+            convert();
+        release();
+    }
+    // returns true if the caller must convert
+    bool claim() {
+        int s = Posted;
+        return m_state.compare_exchange_strong(s, Running);
+    }
+    void convert() {
+        QElapsedTimer t;
+        t.start();
+        result = m_frame.to(m_format);
+        time = qreal(t.nsecsElapsed())/1000000.0;
+        m_frame = VideoFrame();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Q_UNUSED(lock);
+        m_state = Done;
+        m_cond.notify_all();
+    }
+    void wait() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_state != Done)
+            m_cond.wait(lock);
+    }
+    void release() {
+        if (m_refs.fetch_sub(1) == 1)
+            delete this;
+    }
+
+    VideoFrame result;
+    qreal time; // ms
+private:
+    VideoFrame m_frame;
+    VideoFormat::PixelFormat m_format;
+    std::atomic<int> m_state;
+    std::atomic<int> m_refs;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+};
+
+// renderers receiving the same converted frame
+struct FormatGroup {
+    VideoFormat::PixelFormat format;
+    QVarLengthArray<VideoRenderer*, 4> renderers;
+    ConvertTask *task;
+};
+} //namespace
 
 OutputSet::OutputSet(AVPlayer *player):
     QObject(player)
@@ -59,15 +125,63 @@ void OutputSet::sendVideoFrame(const VideoFrame &frame)
 {
     if (mOutputs.isEmpty())
         return;
-    VideoFrame f(frame);
+    // each format is converted once and the result is shared by renderers of that format
+    QVarLengthArray<VideoRenderer*, 4> direct;
+    QVarLengthArray<FormatGroup, 4> groups;
     foreach(AVOutput *output, mOutputs) {
         if (!output->isAvailable())
             continue;
         VideoRenderer *vo = static_cast<VideoRenderer*>(output);
-        // TODO: sort vo by supported formats when a new vo is added to reduce convertion
-        if (!vo->isSupported(frame.pixelFormat()))
-            f = frame.to(vo->preferredPixelFormat());
-        vo->receive(f);
+        if (vo->isSupported(frame.pixelFormat())) {
+            direct.append(vo);
+            continue;
+        }
+        const VideoFormat::PixelFormat fmt = vo->preferredPixelFormat();
+        int i = 0;
+        while (i < groups.size() && groups[i].format != fmt)
+            ++i;
+        if (i == groups.size()) {
+            groups.append(FormatGroup());
+            groups[i].format = fmt;
+            groups[i].task = 0;
+        }
+        groups[i].renderers.append(vo);
+    }
+    // formats other than the 1st are converted by pool workers while this thread delivers the decoded frame
+    // and converts the 1st. frames not in host memory are mapped in this thread
+    if (groups.size() > 1 && frame.constBits(0)) {
+        for (int i = 1; i < groups.size(); ++i) {
+            groups[i].task = new ConvertTask(frame, groups[i].format);
+            WorkPool::instance().post(groups[i].task);
+        }
+    }
+    for (int i = 0; i < direct.size(); ++i) {
+        direct[i]->setConversionTime(0);
+        direct[i]->receive(frame);
+    }
+    for (int i = 0; i < groups.size(); ++i) {
+        FormatGroup &g = groups[i];
+        VideoFrame f;
+        qreal time = 0;
+        if (g.task) {
+            // run it here if no worker has taken it yet, so a busy pool never blocks delivery
+            if (g.task->claim())
+                g.task->convert();
+            else
+                g.task->wait();
+            f = g.task->result;
+            time = g.task->time;
+            g.task->release();
+        } else {
+            QElapsedTimer t;
+            t.start();
+            f = frame.to(g.format);
+            time = qreal(t.nsecsElapsed())/1000000.0;
+        }
+        for (int j = 0; j < g.renderers.size(); ++j) {
+            g.renderers[j]->setConversionTime(time);
+            g.renderers[j]->receive(f);
+        }
     }
 }
 
@@ -23,13 +23,15 @@
 #include "QtAV/private/AVOutput_p.h"
 #include "QtAV/private/AudioOutputBackend.h"
 #include "QtAV/private/AVCompat.h"
+#include "output/audio/AudioPCMRing.h"
+#include "output/audio/AudioVolume.h"
 #if QT_VERSION >= QT_VERSION_CHECK(4, 7, 0)
 #include <QtCore/QElapsedTimer>
 #else
 #include <QtCore/QTime>
 typedef QTime QElapsedTimer;
 #endif
-#include "utils/ring.h"
+#include <string.h>
 #include "utils/Logger.h"
 
 #define AO_USE_TIMER 1
@@ -40,82 +42,6 @@ namespace QtAV {
 static const int kBufferSamples = 512;
 static const int kBufferCount = 8*2; // may wait too long at the beginning (oal) if too large. if buffer count is too small, can not play for high sample rate audio.
 
-typedef void (*scale_samples_func)(quint8 *dst, const quint8 *src, int nb_samples, int volume, float volumef);
-
-/// from libavfilter/af_volume begin
-static inline void scale_samples_u8(quint8 *dst, const quint8 *src, int nb_samples, int volume, float)
-{
-    for (int i = 0; i < nb_samples; i++)
-        dst[i] = av_clip_uint8(((((qint64)src[i] - 128) * volume + 128) >> 8) + 128);
-}
-
-static inline void scale_samples_u8_small(quint8 *dst, const quint8 *src, int nb_samples, int volume, float)
-{
-    for (int i = 0; i < nb_samples; i++)
-        dst[i] = av_clip_uint8((((src[i] - 128) * volume + 128) >> 8) + 128);
-}
-
-static inline void scale_samples_s16(quint8 *dst, const quint8 *src, int nb_samples, int volume, float)
-{
-    int16_t *smp_dst       = (int16_t *)dst;
-    const int16_t *smp_src = (const int16_t *)src;
-    for (int i = 0; i < nb_samples; i++)
-        smp_dst[i] = av_clip_int16(((qint64)smp_src[i] * volume + 128) >> 8);
-}
-
-static inline void scale_samples_s16_small(quint8 *dst, const quint8 *src, int nb_samples, int volume, float)
-{
-    int16_t *smp_dst       = (int16_t *)dst;
-    const int16_t *smp_src = (const int16_t *)src;
-    for (int i = 0; i < nb_samples; i++)
-        smp_dst[i] = av_clip_int16((smp_src[i] * volume + 128) >> 8);
-}
-
-static inline void scale_samples_s32(quint8 *dst, const quint8 *src, int nb_samples, int volume, float)
-{
-    qint32 *smp_dst       = (qint32 *)dst;
-    const qint32 *smp_src = (const qint32 *)src;
-    for (int i = 0; i < nb_samples; i++)
-        smp_dst[i] = av_clipl_int32((((qint64)smp_src[i] * volume + 128) >> 8));
-}
-/// from libavfilter/af_volume end
-
-//TODO: simd
-template<typename T>
-static inline void scale_samples(quint8 *dst, const quint8 *src, int nb_samples, int, float volume)
-{
-    T *smp_dst = (T *)dst;
-    const T *smp_src = (const T *)src;
-    for (int i = 0; i < nb_samples; ++i)
-        smp_dst[i] = smp_src[i] * (T)volume;
-}
-
-scale_samples_func get_scaler(AudioFormat::SampleFormat fmt, qreal vol, int* voli)
-{
-    int v = (int)(vol * 256.0 + 0.5);
-    if (voli)
-        *voli = v;
-    switch (fmt) {
-    case AudioFormat::SampleFormat_Unsigned8:
-    case AudioFormat::SampleFormat_Unsigned8Planar:
-        return v < 0x1000000 ? scale_samples_u8_small : scale_samples_u8;
-    case AudioFormat::SampleFormat_Signed16:
-    case AudioFormat::SampleFormat_Signed16Planar:
-        return v < 0x10000 ? scale_samples_s16_small : scale_samples_s16;
-    case AudioFormat::SampleFormat_Signed32:
-    case AudioFormat::SampleFormat_Signed32Planar:
-        return scale_samples_s32;
-    case AudioFormat::SampleFormat_Float:
-    case AudioFormat::SampleFormat_FloatPlanar:
-        return scale_samples<float>;
-    case AudioFormat::SampleFormat_Double:
-    case AudioFormat::SampleFormat_DoublePlanar:
-        return scale_samples<double>;
-    default:
-        return 0;
-    }
-}
-
 class AudioOutputPrivate : public AVOutputPrivate
 {
 public:
@@ -123,7 +49,6 @@ public:
         mute(false)
       , sw_volume(true)
       , sw_mute(true)
-      , volume_i(256)
       , vol(1)
       , speed(1.0)
       , nb_buffers(kBufferCount)
@@ -132,12 +57,10 @@ public:
       , play_pos(0)
       , processed_remain(0)
       , msecs_ahead(0)
-      , scale_samples(0)
       , backend(0)
       , update_backend(true)
       , index_enqueue(-1)
       , index_deuqueue(-1)
-      , frame_infos(ring<FrameInfo>(nb_buffers))
     {
         available = false;
     }
@@ -151,13 +74,6 @@ public:
         cond.wait(&mutex, (us+500LL)/1000LL);
     }
 
-    struct FrameInfo {
-        FrameInfo(const QByteArray& d = QByteArray(), qreal t = 0, int us = 0) : timestamp(t), duration(us), data(d) {}
-        qreal timestamp;
-        int duration; // in us
-        QByteArray data;
-    };
-
     void resetStatus() {
         play_pos = 0;
         processed_remain = 0;
@@ -165,16 +81,14 @@ public:
 #if AO_USE_TIMER
         timer.invalidate();
 #endif
-        frame_infos = ring<FrameInfo>(nb_buffers);
     }
-    /// call this if sample format or volume is changed
+    /// call this if sample format is changed
     void updateSampleScaleFunc();
     void tryVolume(qreal value);
     void tryMute(bool value);
 
     bool mute;
     bool sw_volume, sw_mute;
-    int volume_i;
     qreal vol;
     qreal speed;
     AudioFormat format;
@@ -189,19 +103,20 @@ public:
 #if AO_USE_TIMER
     QElapsedTimer timer;
 #endif
-    scale_samples_func scale_samples;
+    AudioVolume volume_scaler; // software volume and mute
     AudioOutputBackend *backend;
     bool update_backend;
     QStringList backends;
 //private:
     // the index of current enqueue/dequeue
     int index_enqueue, index_deuqueue;
-    ring<FrameInfo> frame_infos;
+    // queued buffers and timestamps. allocated in open()
+    AudioPCMRing pcm;
 };
 
 void AudioOutputPrivate::updateSampleScaleFunc()
 {
-    scale_samples = get_scaler(format.sampleFormat(), vol, &volume_i);
+    volume_scaler.setFormat(format);
 }
 
 AudioOutputPrivate::~AudioOutputPrivate()
@@ -218,9 +133,10 @@ void AudioOutputPrivate::playInitialData()
                     || format.sampleFormat() == AudioFormat::SampleFormat_Unsigned8Planar)
             ? 0x80 : 0;
     for (quint32 i = 0; i < nb_buffers; ++i) {
-        const QByteArray data(backend->buffer_size, c);
-        backend->write(data); // fill silence byte, not always 0. AudioFormat.silenceByte
-        frame_infos.push_back(FrameInfo(data, 0, 0)); // initial data can be small (1 instead of buffer_samples)
+        quint8 *data = pcm.back();
+        memset(data, c, backend->buffer_size); // fill silence byte, not always 0. AudioFormat.silenceByte
+        pcm.push(backend->buffer_size, 0, 0); // initial data can be small (1 instead of buffer_samples)
+        backend->write((const char*)data, backend->buffer_size);
     }
     backend->play();
 }
@@ -294,6 +210,7 @@ void AudioOutput::setBackends(const QStringList &backendNames)
         d.backend->close();
         delete d.backend;
         d.backend = 0;
+        d.available = false;
     }
     // TODO: empty backends use dummy backend
     if (!d.backends.isEmpty()) {
@@ -334,7 +251,7 @@ QString AudioOutput::backend() const
 void AudioOutput::flush()
 {
     DPTR_D(AudioOutput);
-    while (!d.frame_infos.empty()) {
+    while (!d.pcm.empty()) {
         if (d.backend)
             d.backend->flush();
         waitForNextBuffer();
@@ -346,6 +263,8 @@ void AudioOutput::clear()
     DPTR_D(AudioOutput);
     if (!d.backend || !d.backend->clear())
         flush();
+    // queued buffers are played out or dropped by the backend, so no ring memory is in use
+    d.pcm.clear();
     d.resetStatus();
 }
 
@@ -354,6 +273,9 @@ bool AudioOutput::open()
     DPTR_D(AudioOutput);
     QMutexLocker lock(&d.mutex);
     Q_UNUSED(lock);
+    // reopened without close(), e.g. the format is changed. the backend may still read the ring, so stop it first
+    if (d.available && d.backend)
+        d.backend->close();
     d.available = false;
     d.paused = false;
     d.resetStatus();
@@ -363,6 +285,7 @@ bool AudioOutput::open()
     d.backend->buffer_size = bufferSize();
     d.backend->buffer_count = bufferCount();
     d.backend->format = audioFormat();
+    d.pcm.reset(bufferSize(), bufferCount());
     // TODO: open next backend if fail and emit backendChanged()
     if (!d.backend->open())
         return false;
@@ -385,7 +308,10 @@ bool AudioOutput::close()
         return false;
     // TODO: drain() before close
     d.backend->audio = 0;
-    return d.backend->close();
+    const bool ok = d.backend->close();
+    // the backend has released the queued buffers
+    d.pcm.clear();
+    return ok;
 }
 
 bool AudioOutput::isOpen() const
@@ -394,11 +320,16 @@ bool AudioOutput::isOpen() const
 }
 
 bool AudioOutput::play(const QByteArray &data, qreal pts)
+{
+    return play(data.constData(), data.size(), pts);
+}
+
+bool AudioOutput::play(const char *data, int size, qreal pts)
 {
     DPTR_D(AudioOutput);
     if (!d.backend)
         return false;
-    if (!receiveData(data, pts))
+    if (!receiveData(data, size, pts))
         return false;
     return d.backend->play();
 }
@@ -415,36 +346,46 @@ bool AudioOutput::isPaused() const
     return d_func().paused;
 }
 
-bool AudioOutput::receiveData(const QByteArray &data, qreal pts)
+bool AudioOutput::receiveData(const char *data, int size, qreal pts)
 {
     DPTR_D(AudioOutput);
     if (isPaused())
         return false;
-    QByteArray queue_data(data);
-    if (isMute() && d.sw_mute) {
-        char s = 0;
-        if (d.format.isUnsigned() && !d.format.isFloat())
-            s = 1<<((d.format.bytesPerSample() << 3)-1);
-        queue_data.fill(s);
-    } else {
-        if (!qFuzzyCompare(volume(), (qreal)1.0)
-                && d.sw_volume
-                && d.scale_samples
-                ) {
-            // TODO: af_volume needs samples_align to get nb_samples
-            const int nb_samples = queue_data.size()/d.format.bytesPerSample();
-            quint8 *dst = (quint8*)queue_data.constData();
-            d.scale_samples(dst, dst, nb_samples, d.volume_i, volume());
-        }
-    }
-    // wait after all data processing finished to reduce time error
-    if (!waitForNextBuffer()) { // TODO: wait or not parameter, set by user (async)
-        qWarning("ao backend maybe not open");
-        d.resetStatus();
+    if (d.pcm.slotBytes() <= 0) {
+        qWarning("ao is not open");
         return false;
     }
-    d.frame_infos.push_back(AudioOutputPrivate::FrameInfo(queue_data, pts, d.format.durationForBytes(queue_data.size())));
-    return d.backend->write(queue_data); // backend is not null here
+    // a change is ramped, so mute and volume changes do not click
+    if (isMute() && d.sw_mute)
+        d.volume_scaler.setGain(0);
+    else
+        d.volume_scaler.setGain(d.sw_volume ? volume() : 1.0);
+    // data is split if larger than a buffer. AudioThread never does that
+    const char *src = data;
+    int remain = size;
+    while (remain > 0) {
+        const int bytes = qMin(remain, d.pcm.slotBytes());
+        // back() is not in use by backend, so fill it before waiting, to reduce time error
+        quint8 *buf = d.pcm.back();
+        memcpy(buf, src, bytes);
+        if (!d.volume_scaler.isIdentity())
+            d.volume_scaler.process(buf, bytes);
+        if (!waitForNextBuffer()) { // TODO: wait or not parameter, set by user (async)
+            qWarning("ao backend maybe not open");
+            d.resetStatus();
+            return false;
+        }
+        if (d.pcm.full()) // not all played buffers are dequeued, e.g. bytes based control
+            d.pcm.pop();
+        const qint64 us = d.format.durationForBytes(bytes);
+        d.pcm.push(bytes, pts, us);
+        if (!d.backend->write((const char*)buf, bytes)) // backend is not null here
+            return false;
+        src += bytes;
+        remain -= bytes;
+        pts += qreal(us)/1000000.0;
+    }
+    return true;
 }
 
 AudioFormat AudioOutput::setAudioFormat(const AudioFormat& format)
@@ -456,7 +397,7 @@ AudioFormat AudioOutput::setAudioFormat(const AudioFormat& format)
     d.requested = format;
     if (!d.backend) {
         d.format = AudioFormat();
-        d.scale_samples = NULL;
+        d.volume_scaler.setFormat(AudioFormat());
         return AudioFormat();
     }
     if (d.backend->isSupported(format)) {
@@ -516,7 +457,6 @@ void AudioOutput::setVolume(qreal value)
         return;
     d.vol = value;
     Q_EMIT volumeChanged(value);
-    d.updateSampleScaleFunc();
     d.tryVolume(value);
 }
 
@@ -612,14 +552,14 @@ AudioOutput::DeviceFeatures AudioOutput::supportedDeviceFeatures() const
 bool AudioOutput::waitForNextBuffer() // parameter bool wait: if no wait and no next buffer, return false
 {
     DPTR_D(AudioOutput);
-    if (d.frame_infos.empty())
+    if (d.pcm.empty())
         return true;
     //don't return even if we can add buffer because we don't know when a buffer is processed and we have /to update dequeue index
     // openal need enqueue to a dequeued buffer! why sl crash
     bool no_wait = false;//d.canAddBuffer();
     const AudioOutputBackend::BufferControl f = d.backend->bufferControl();
     int remove = 0;
-    const AudioOutputPrivate::FrameInfo &fi(d.frame_infos.front());
+    const int front_bytes = d.pcm.frontBytes();
     if (f & AudioOutputBackend::Blocking) {
         remove = 1;
     } else if (f & AudioOutputBackend::CountCallback) {
@@ -633,10 +573,10 @@ bool AudioOutput::waitForNextBuffer() // parameter bool wait: if no wait and no
         d.processed_remain = d.backend->getWritableBytes();
         if (d.processed_remain < 0)
             return false;
-        const int next = fi.data.size();
+        const int next = front_bytes;
         //qDebug("remain: %d-%d, size: %d, next: %d", processed, d.processed_remain, d.data.size(), next);
         qint64 last_wait = 0LL;
-        while (d.processed_remain - processed < next || d.processed_remain < fi.data.size()) { //implies next > 0
+        while (d.processed_remain - processed < next || d.processed_remain < front_bytes) { //implies next > 0
             const qint64 us = d.format.durationForBytes(next - (d.processed_remain - processed));
             d.uwait(us);
             d.processed_remain = d.backend->getWritableBytes();
@@ -658,11 +598,11 @@ bool AudioOutput::waitForNextBuffer() // parameter bool wait: if no wait and no
             last_wait = us;
         }
         processed = d.processed_remain - processed;
-        d.processed_remain -= fi.data.size(); //ensure d.processed_remain later is greater
+        d.processed_remain -= front_bytes; //ensure d.processed_remain later is greater
         remove = -processed; // processed_this_period
     } else if (f & AudioOutputBackend::PlayedBytes) {
         d.processed_remain = d.backend->getPlayedBytes();
-        const int next = fi.data.size();
+        const int next = front_bytes;
         // TODO: avoid always 0
         // TODO: compare processed_remain with fi.data.size because input chuncks can be in different sizes
         while (!no_wait && d.processed_remain < next) {
@@ -686,7 +626,7 @@ bool AudioOutput::waitForNextBuffer() // parameter bool wait: if no wait and no
         qint64 us = 0;
         while (!no_wait && c < 1) {
             if (us <= 0)
-                us = fi.duration;
+                us = d.pcm.frontDuration();
 #if AO_USE_TIMER
             elapsed = d.timer.restart();
             if (elapsed > 0 && us > elapsed*1000LL)
@@ -706,9 +646,9 @@ bool AudioOutput::waitForNextBuffer() // parameter bool wait: if no wait and no
         if (processed < 0)
             processed += bufferSizeTotal();
         d.play_pos = s;
-        const int next = fi.data.size();
+        const int next = front_bytes;
         int writable_size = d.processed_remain + processed;
-        while (!no_wait && (/*processed < next ||*/ writable_size < fi.data.size()) && next > 0) {
+        while (!no_wait && (/*processed < next ||*/ writable_size < front_bytes) && next > 0) {
             const qint64 us = d.format.durationForBytes(next - writable_size);
             d.uwait(us);
             s = d.backend->getOffsetByBytes();
@@ -719,7 +659,7 @@ bool AudioOutput::waitForNextBuffer() // parameter bool wait: if no wait and no
             d.play_pos = s;
         }
         d.processed_remain += processed;
-        d.processed_remain -= fi.data.size(); //ensure d.processed_remain later is greater
+        d.processed_remain -= front_bytes; //ensure d.processed_remain later is greater
         remove = -processed;
     } else if (f & AudioOutputBackend::OffsetIndex) {
         int n = d.backend->getOffset();
@@ -730,7 +670,7 @@ bool AudioOutput::waitForNextBuffer() // parameter bool wait: if no wait and no
         // TODO: timer
         // TODO: avoid always 0
         while (!no_wait && processed < 1) {
-            d.uwait(fi.duration);
+            d.uwait(d.pcm.frontDuration());
             n = d.backend->getOffset();
             processed = n - d.play_pos;
             if (processed < 0)
@@ -743,27 +683,27 @@ bool AudioOutput::waitForNextBuffer() // parameter bool wait: if no wait and no
         return false;
     }
     if (remove < 0) {
-        int next = fi.data.size();
+        int next = front_bytes;
         int free_bytes = -remove;//d.processed_remain;
         while (free_bytes >= next && next > 0) {
             free_bytes -= next;
-            if (d.frame_infos.empty()) {
+            if (d.pcm.empty()) {
 //                qWarning("buffer queue empty");
                 break;
             }
-            d.frame_infos.pop_front();
-            next = d.frame_infos.front().data.size();
+            d.pcm.pop();
+            next = d.pcm.frontBytes();
         }
         //qDebug("remove: %d, unremoved bytes < %d, writable_bytes: %d", remove, free_bytes, d.processed_remain);
         return true;
     }
     //qDebug("remove count: %d", remove);
     while (remove-- > 0) {
-        if (d.frame_infos.empty()) {
+        if (d.pcm.empty()) {
 //            qWarning("empty. can not pop!");
             break;
         }
-        d.frame_infos.pop_front();
+        d.pcm.pop();
     }
     return true;
 }
@@ -772,7 +712,7 @@ bool AudioOutput::waitForNextBuffer() // parameter bool wait: if no wait and no
 qreal AudioOutput::timestamp() const
 {
     DPTR_D(const AudioOutput);
-    return d.frame_infos.front().timestamp;
+    return d.pcm.frontTimestamp();
 }
 
 void AudioOutput::reportVolume(qreal value)
@@ -43,7 +43,7 @@ public:
     //bool flush() Q_DECL_OVERRIDE;
     BufferControl bufferControl() const Q_DECL_OVERRIDE;
     void onCallback() Q_DECL_OVERRIDE;
-    bool write(const QByteArray& data) Q_DECL_OVERRIDE;
+    bool write(const char* data, int size) Q_DECL_OVERRIDE;
     bool play() Q_DECL_OVERRIDE;
     bool setVolume(qreal value) override;
 private:
@@ -185,7 +185,7 @@ bool AudioOutputAudioToolbox::close()
     return true;
 }
 
-bool AudioOutputAudioToolbox::write(const QByteArray& data)
+bool AudioOutputAudioToolbox::write(const char *data, int size)
 {
     // blocking queue.
     // if queue not full, fill buffer and enqueue buffer
@@ -206,9 +206,9 @@ bool AudioOutputAudioToolbox::write(const QByteArray& data)
         buf = m_buffer_fill.front();
         m_buffer_fill.pop_front();
     }
-    assert(buf->mAudioDataBytesCapacity >= (UInt32)data.size() && "too many data to write to audio queue buffer");
-    memcpy(buf->mAudioData, data.constData(), data.size());
-    buf->mAudioDataByteSize = data.size();
+    assert(buf->mAudioDataBytesCapacity >= (UInt32)size && "too many data to write to audio queue buffer");
+    memcpy(buf->mAudioData, data, size);
+    buf->mAudioDataByteSize = size;
     //buf->mUserData
     AT_ENSURE(AudioQueueEnqueueBuffer(m_queue, buf, 0, NULL), false);
     return true;
@@ -46,7 +46,7 @@ public:
     bool close() Q_DECL_OVERRIDE;
     bool isSupported(AudioFormat::SampleFormat sampleFormat) const Q_DECL_OVERRIDE;
     BufferControl bufferControl() const Q_DECL_OVERRIDE;
-    bool write(const QByteArray& data) Q_DECL_OVERRIDE;
+    bool write(const char* data, int size) Q_DECL_OVERRIDE;
     bool play() Q_DECL_OVERRIDE;
     int getOffsetByBytes() Q_DECL_OVERRIDE;
 
@@ -234,7 +234,7 @@ void AudioOutputDSound::onCallback()
     //}
 }
 
-bool AudioOutputDSound::write(const QByteArray &data)
+bool AudioOutputDSound::write(const char *data, int size)
 {
     //qDebug("sem %d %d", sem.available(), buffers_free.load());
     if (bufferControl() & CountCallback) {
@@ -251,15 +251,15 @@ bool AudioOutputDSound::write(const QByteArray &data)
     DWORD size1 = 0, size2 = 0;
     if (write_offset >= buffer_size*buffer_count) ///!!!>=
         write_offset = 0;
-    HRESULT res = stream_buf->Lock(write_offset, data.size(), &dst1, &size1, &dst2, &size2, 0); //DSBLOCK_ENTIREBUFFER
+    HRESULT res = stream_buf->Lock(write_offset, size, &dst1, &size1, &dst2, &size2, 0); //DSBLOCK_ENTIREBUFFER
     if (res == DSERR_BUFFERLOST) {
         qDebug("buffer lost");
         DX_ENSURE(stream_buf->Restore(), false);
-        DX_ENSURE(stream_buf->Lock(write_offset, data.size(), &dst1, &size1, &dst2, &size2, 0), false);
+        DX_ENSURE(stream_buf->Lock(write_offset, size, &dst1, &size1, &dst2, &size2, 0), false);
     }
-    memcpy(dst1, data.constData(), size1);
+    memcpy(dst1, data, size1);
     if (dst2)
-        memcpy(dst2, data.constData() + size1, size2);
+        memcpy(dst2, data + size1, size2);
     write_offset += size1 + size2;
     if (write_offset >= buffer_size*buffer_count)
         write_offset = size2;
@@ -35,7 +35,7 @@ public:
     bool close() Q_DECL_OVERRIDE { return true;}
     // TODO: check channel layout. Null supports channels>2
     BufferControl bufferControl() const Q_DECL_OVERRIDE { return Blocking;}
-    bool write(const QByteArray&) Q_DECL_OVERRIDE { return true;}
+    bool write(const char*, int) Q_DECL_OVERRIDE { return true;}
     bool play() Q_DECL_OVERRIDE { return true;}
 
 };
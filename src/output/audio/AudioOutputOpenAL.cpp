@@ -59,7 +59,7 @@ public:
     bool isSupported(AudioFormat::ChannelLayout channelLayout) const Q_DECL_FINAL;
 protected:
     BufferControl bufferControl() const Q_DECL_FINAL;
-    bool write(const QByteArray& data) Q_DECL_FINAL;
+    bool write(const char* data, int size) Q_DECL_FINAL;
     bool play() Q_DECL_FINAL;
     int getPlayedCount() Q_DECL_FINAL;
     bool setVolume(qreal value) Q_DECL_FINAL;
@@ -370,9 +370,9 @@ AudioOutputBackend::BufferControl AudioOutputOpenAL::bufferControl() const
 }
 
 // http://kcat.strangesoft.net/openal-tutorial.html
-bool AudioOutputOpenAL::write(const QByteArray& data)
+bool AudioOutputOpenAL::write(const char *data, int size)
 {
-    if (data.isEmpty())
+    if (size <= 0)
         return false;
     SCOPE_LOCK_CONTEXT();
     ALuint buf = 0;
@@ -382,7 +382,7 @@ bool AudioOutputOpenAL::write(const QByteArray& data)
     } else {
         AL_ENSURE(alSourceUnqueueBuffers(source, 1, &buf), false);
     }
-    AL_ENSURE(alBufferData(buf, format_al, data.constData(), data.size(), format.sampleRate()), false);
+    AL_ENSURE(alBufferData(buf, format_al, data, size, format.sampleRate()), false);
     AL_ENSURE(alSourceQueueBuffers(source, 1, &buf), false);
     return true;
 }
@@ -64,7 +64,7 @@ public:
     BufferControl bufferControl() const Q_DECL_OVERRIDE;
     void onCallback() Q_DECL_OVERRIDE;
     void acquireNextBuffer() Q_DECL_OVERRIDE;
-    bool write(const QByteArray& data) Q_DECL_OVERRIDE;
+    bool write(const char* data, int size) Q_DECL_OVERRIDE;
     bool play() Q_DECL_OVERRIDE;
     //default return -1. means not the control
     int getPlayedCount() Q_DECL_OVERRIDE;
@@ -97,10 +97,7 @@ private:
     SLint32 m_streamType;
     quint32 buffers_queued;
     QSemaphore sem;
-
-    // Enqueue does not copy data. We MUST keep the data until it is played out
-    int queue_data_write;
-    QByteArray queue_data;
+    // Enqueue does not copy data. The data in AudioOutput's ring is kept until it is played out
 };
 
 typedef AudioOutputOpenSL AudioOutputBackendOpenSL;
@@ -196,7 +193,6 @@ AudioOutputOpenSL::AudioOutputOpenSL(QObject *parent)
     , m_sl_step(0)
     , m_streamType(-1)
     , buffers_queued(0)
-    , queue_data_write(0)
 {
 #ifdef Q_OS_ANDROID
     char v[PROP_VALUE_MAX+1];
@@ -263,7 +259,6 @@ void AudioOutputOpenSL::acquireNextBuffer()
 
 bool AudioOutputOpenSL::open()
 {
-    queue_data.resize(buffer_size*buffer_count);
     SLDataLocator_BufferQueue bufferQueueLocator = { SL_DATALOCATOR_BUFFERQUEUE, (SLuint32)buffer_count };
     SLDataFormat_PCM_EX pcmFormat = audioFormatToSL(format);
     SLDataSource audioSrc = { &bufferQueueLocator, &pcmFormat };
@@ -360,30 +355,19 @@ bool AudioOutputOpenSL::close()
     m_playItf = NULL;
     m_volumeItf = NULL;
     m_bufferQueueItf = NULL;
-    queue_data.clear();
-    queue_data_write = 0;
     return true;
 }
 
-bool AudioOutputOpenSL::write(const QByteArray& data)
+bool AudioOutputOpenSL::write(const char *data, int size)
 {
-    // assume data.size() <= buffer_size. It's true in QtAV
-    const int s = qMin(queue_data.size() - queue_data_write, data.size());
-    // assume data.size() <= buffer_size. It's true in QtAV
-    if (s < data.size())
-        queue_data_write = 0;
-    memcpy((char*)queue_data.constData() + queue_data_write, data.constData(), data.size());
-    //qDebug("enqueue %p, queue_data_write: %d/%d available:%d", data.constData(), queue_data_write, queue_data.size(), sem.available());
+    //qDebug("enqueue %p, size: %d available:%d", data, size, sem.available());
 #ifdef Q_OS_ANDROID
     if (m_android)
-        SL_ENSURE((*m_bufferQueueItf_android)->Enqueue(m_bufferQueueItf_android, queue_data.constData() + queue_data_write, data.size()), false);
+        SL_ENSURE((*m_bufferQueueItf_android)->Enqueue(m_bufferQueueItf_android, data, size), false);
     else
 #endif
-    SL_ENSURE((*m_bufferQueueItf)->Enqueue(m_bufferQueueItf, queue_data.constData() + queue_data_write, data.size()), false);
+    SL_ENSURE((*m_bufferQueueItf)->Enqueue(m_bufferQueueItf, data, size), false);
     buffers_queued++;
-    queue_data_write += data.size();
-    if (queue_data_write == queue_data.size())
-        queue_data_write = 0;
     return true;
 }
 
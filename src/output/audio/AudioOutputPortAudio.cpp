@@ -38,7 +38,7 @@ public:
     bool open() Q_DECL_FINAL;
     bool close() Q_DECL_FINAL;
     virtual BufferControl bufferControl() const Q_DECL_FINAL;
-    virtual bool write(const QByteArray& data) Q_DECL_FINAL;
+    virtual bool write(const char* data, int size) Q_DECL_FINAL;
     virtual bool play() Q_DECL_FINAL { return true;}
 private:
     bool initialized;
@@ -100,11 +100,11 @@ AudioOutputBackend::BufferControl AudioOutputPortAudio::bufferControl() const
     return Blocking;
 }
 
-bool AudioOutputPortAudio::write(const QByteArray& data)
+bool AudioOutputPortAudio::write(const char *data, int size)
 {
     if (Pa_IsStreamStopped(stream))
         Pa_StartStream(stream);
-    PaError err = Pa_WriteStream(stream, data.constData(), data.size()/format.channels()/format.bytesPerSample());
+    PaError err = Pa_WriteStream(stream, data, size/format.channels()/format.bytesPerSample());
     if (err == paUnanticipatedHostError) {
         qWarning("Write portaudio stream error: %s", Pa_GetErrorText(err));
         return   false;
@@ -43,7 +43,7 @@ public:
     bool close() Q_DECL_FINAL;
 
 protected:
-    bool write(const QByteArray& data) Q_DECL_FINAL;
+    bool write(const char* data, int size) Q_DECL_FINAL;
     bool play() Q_DECL_FINAL;
     BufferControl bufferControl() const Q_DECL_FINAL;
     int getWritableBytes() Q_DECL_FINAL;
@@ -423,12 +423,12 @@ int AudioOutputPulse::getWritableBytes()
     return pa_stream_writable_size(stream);
 }
 
-bool AudioOutputPulse::write(const QByteArray &data)
+bool AudioOutputPulse::write(const char *data, int size)
 {
     ScopedPALocker palock(loop);
     Q_UNUSED(palock);
-    PA_ENSURE_TRUE(pa_stream_write(stream, data.constData(), data.size(), NULL, 0LL, PA_SEEK_RELATIVE) >= 0, false);
-    writable_size -= data.size();
+    PA_ENSURE_TRUE(pa_stream_write(stream, data, size, NULL, 0LL, PA_SEEK_RELATIVE) >= 0, false);
+    writable_size -= size;
     return true;
 }
 
@@ -48,7 +48,7 @@ public:
     bool isSupported(AudioFormat::ChannelLayout channelLayout) const Q_DECL_OVERRIDE;
     BufferControl bufferControl() const Q_DECL_OVERRIDE;
     void onCallback() Q_DECL_OVERRIDE;
-    bool write(const QByteArray& data) Q_DECL_OVERRIDE;
+    bool write(const char* data, int size) Q_DECL_OVERRIDE;
     bool play() Q_DECL_OVERRIDE;
 
     bool setVolume(qreal value) Q_DECL_OVERRIDE;
@@ -85,9 +85,7 @@ private:
             WinSDK::IXAudio2MasteringVoice* master;
         } winsdk;
     };
-    QSemaphore sem;
-    int queue_data_write;
-    QByteArray queue_data;
+    QSemaphore sem; // SubmitSourceBuffer does not copy data. The data in AudioOutput's ring is kept until it is played out
 
     QLibrary dll;
 };
@@ -101,7 +99,6 @@ AudioOutputXAudio2::AudioOutputXAudio2(QObject *parent)
     , xaudio2_winsdk(true)
     , uninit_com(false)
     , source_voice(NULL)
-    , queue_data_write(0)
 {
     memset(&dxsdk, 0, sizeof(dxsdk));
     available = false;
@@ -209,7 +206,6 @@ bool AudioOutputXAudio2::open()
     DX_ENSURE_OK(source_voice->Start(0, XAUDIO2_COMMIT_NOW), false);
     qDebug("source_voice:%p", source_voice);
 
-    queue_data.resize(buffer_size*buffer_count);
     sem.release(buffer_count - sem.available());
     return true;
 }
@@ -238,9 +234,6 @@ bool AudioOutputXAudio2::close()
         if (dxsdk.xaudio)
             dxsdk.xaudio->StopEngine();
     }
-
-    queue_data.clear();
-    queue_data_write = 0;
     return true;
 }
 
@@ -271,25 +264,17 @@ void AudioOutputXAudio2::onCallback()
         sem.release();
 }
 
-bool AudioOutputXAudio2::write(const QByteArray &data)
+bool AudioOutputXAudio2::write(const char *data, int size)
 {
-    //qDebug("sem: %d, write: %d/%d", sem.available(), queue_data_write, queue_data.size());
+    //qDebug("sem: %d, write: %d", sem.available(), size);
     if (bufferControl() & CountCallback)
         sem.acquire();
-    const int s = qMin(queue_data.size() - queue_data_write, data.size());
-    // assume data.size() <= buffer_size. It's true in QtAV
-    if (s < data.size())
-        queue_data_write = 0;
-    memcpy((char*)queue_data.constData() + queue_data_write, data.constData(), data.size());
     XAUDIO2_BUFFER xb; //IMPORTANT! wrong value(playbegin/length, loopbegin/length) will result in commit sourcebuffer fail
     memset(&xb, 0, sizeof(XAUDIO2_BUFFER));
-    xb.AudioBytes = data.size();
+    xb.AudioBytes = size;
     //xb.Flags = XAUDIO2_END_OF_STREAM;
     xb.pContext = this;
-    xb.pAudioData = (const BYTE*)(queue_data.constData() + queue_data_write);
-    queue_data_write += data.size();
-    if (queue_data_write == queue_data.size())
-        queue_data_write = 0;
+    xb.pAudioData = (const BYTE*)data;
     DX_ENSURE_OK(source_voice->SubmitSourceBuffer(&xb, NULL), false);
     // TODO: XAUDIO2_E_DEVICE_INVALIDATED
     return true;
@@ -0,0 +1,109 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef QTAV_AUDIOPCMRING_H
+#define QTAV_AUDIOPCMRING_H
+
+#include <atomic>
+#include <vector>
+#include <QtCore/QtGlobal>
+
+namespace QtAV {
+/*!
+ * \brief The AudioPCMRing class
+ * Preallocated PCM buffers between AudioOutput and its backend. A slot holds up to slotBytes() bytes, with the
+ * timestamp and duration in parallel arrays. At most count() slots are queued, but count() + 1 are allocated, so
+ * the slot returned by back() is never one of the last count() pushed. A backend can queue pointers into the
+ * ring instead of copying.
+ * Single producer and single consumer. No allocation except in reset().
+ */
+class AudioPCMRing
+{
+public:
+    AudioPCMRing() : m_slot_bytes(0), m_count(0), m_read(0), m_write(0) {}
+    /// storage is kept if it is large enough. Memory may move, so no backend can be open. not thread safe
+    void reset(int slotBytes, int count) {
+        m_slot_bytes = qMax(slotBytes, 0);
+        m_count = qMax(count, 0);
+        const size_t slots = m_count > 0 ? m_count + 1 : 0;
+        if (m_data.size() < slots*m_slot_bytes)
+            m_data.resize(slots*m_slot_bytes);
+        if (m_bytes.size() < slots) {
+            m_bytes.resize(slots);
+            m_timestamps.resize(slots);
+            m_durations.resize(slots);
+        }
+        m_read.store(0, std::memory_order_relaxed);
+        m_write.store(0, std::memory_order_release);
+    }
+    /*!
+     * drop queued slots. The write position is kept, but the dropped slots can be written again, so the backend
+     * must not hold them, i.e. they are played out or flushed. not thread safe
+     */
+    void clear() {
+        m_read.store(m_write.load(std::memory_order_relaxed), std::memory_order_release);
+    }
+    int slotBytes() const { return m_slot_bytes;}
+    int count() const { return m_count;}
+    int size() const {
+        const int n = int(m_write.load(std::memory_order_acquire)) - int(m_read.load(std::memory_order_acquire));
+        return n < 0 ? n + 2*(m_count + 1) : n;
+    }
+    bool empty() const { return size() == 0;}
+    bool full() const { return size() >= m_count;}
+    /// producer: memory of the next slot to push, slotBytes() bytes. null if reset() is not called
+    quint8* back() { return m_count > 0 ? &m_data[index(m_write.load(std::memory_order_relaxed))*m_slot_bytes] : 0;}
+    /// producer: queue back() with bytes written. the ring must not be full
+    void push(int bytes, qreal timestamp, int durationUs) {
+        const unsigned w = m_write.load(std::memory_order_relaxed);
+        const size_t i = index(w);
+        m_bytes[i] = bytes;
+        m_timestamps[i] = timestamp;
+        m_durations[i] = durationUs;
+        m_write.store(next(w), std::memory_order_release);
+    }
+    /// consumer: the front slot. null or 0 if empty
+    const quint8* front() const { return empty() ? 0 : &m_data[frontIndex()*m_slot_bytes];}
+    int frontBytes() const { return empty() ? 0 : m_bytes[frontIndex()];}
+    qreal frontTimestamp() const { return empty() ? 0 : m_timestamps[frontIndex()];}
+    int frontDuration() const { return empty() ? 0 : m_durations[frontIndex()];}
+    /// consumer
+    void pop() {
+        if (empty())
+            return;
+        m_read.store(next(m_read.load(std::memory_order_relaxed)), std::memory_order_release);
+    }
+private:
+    // counters are in [0, 2*(m_count + 1)), so full and empty are different
+    unsigned next(unsigned i) const { return i + 1 == unsigned(2*(m_count + 1)) ? 0 : i + 1;}
+    size_t index(unsigned i) const { return i % (m_count + 1);}
+    size_t frontIndex() const { return index(m_read.load(std::memory_order_acquire));}
+
+    int m_slot_bytes;
+    int m_count;
+    std::vector<quint8> m_data;
+    std::vector<int> m_bytes;
+    std::vector<qreal> m_timestamps;
+    std::vector<int> m_durations;
+    std::atomic<unsigned> m_read, m_write;
+};
+} //namespace QtAV
+#endif //QTAV_AUDIOPCMRING_H
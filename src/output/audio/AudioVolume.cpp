@@ -0,0 +1,515 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+
+#include "AudioVolume.h"
+#include "utils/AudioSample.h"
+#include <math.h>
+#include <string.h>
+extern "C" {
+#include <libavutil/cpu.h>
+}
+
+namespace QtAV {
+namespace {
+using AudioSample::kMaxS32f;
+using AudioSample::clampf;
+
+void scale_u8_c(quint8 *data, int n, float g, float step)
+{
+    for (int i = 0; i < n; ++i, g += step) {
+        const long v = lrintf(clampf(float(data[i] - 128)*g, -32768.0f, 32767.0f)) + 128;
+        data[i] = quint8(v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+}
+
+void scale_s16_c(quint8 *data, int n, float g, float step)
+{
+    qint16 *p = (qint16*)data;
+    for (int i = 0; i < n; ++i, g += step)
+        p[i] = qint16(lrintf(clampf(float(p[i])*g, -32768.0f, 32767.0f)));
+}
+
+void scale_s32_c(quint8 *data, int n, float g, float step)
+{
+    qint32 *p = (qint32*)data;
+    for (int i = 0; i < n; ++i, g += step)
+        p[i] = qint32(lrintf(clampf(float(p[i])*g, -2147483648.0f, kMaxS32f)));
+}
+
+void scale_float_c(quint8 *data, int n, float g, float step)
+{
+    float *p = (float*)data;
+    for (int i = 0; i < n; ++i, g += step)
+        p[i] *= g;
+}
+
+void scale_double_c(quint8 *data, int n, float g, float step)
+{
+    double *p = (double*)data;
+    for (int i = 0; i < n; ++i, g += step)
+        p[i] *= g;
+}
+
+#if AUDIO_SSE2
+static inline __m128 gain_sse2(float g, float step)
+{
+    return _mm_add_ps(_mm_set1_ps(g), _mm_mul_ps(_mm_set1_ps(step), _mm_setr_ps(0, 1, 2, 3)));
+}
+
+// 8 s16 scaled by gains g0 (low 4) and g1 (high 4)
+static inline __m128i scale_s16x8_sse2(__m128i v, __m128 g0, __m128 g1)
+{
+    const __m128 vmax = _mm_set1_ps(kMaxS32f);
+    __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+    __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+    lo = _mm_min_ps(_mm_mul_ps(lo, g0), vmax);
+    hi = _mm_min_ps(_mm_mul_ps(hi, g1), vmax);
+    return _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi));
+}
+
+void scale_u8_sse2(quint8 *data, int n, float gain, float step)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i k128 = _mm_set1_epi16(128);
+    const __m128 inc = _mm_set1_ps(16.0f*step);
+    __m128 g0 = gain_sse2(gain, step);
+    __m128 g1 = gain_sse2(gain + 4.0f*step, step);
+    __m128 g2 = gain_sse2(gain + 8.0f*step, step);
+    __m128 g3 = gain_sse2(gain + 12.0f*step, step);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i a = scale_s16x8_sse2(_mm_sub_epi16(_mm_unpacklo_epi8(v, zero), k128), g0, g1);
+        __m128i b = scale_s16x8_sse2(_mm_sub_epi16(_mm_unpackhi_epi8(v, zero), k128), g2, g3);
+        a = _mm_adds_epi16(a, k128);
+        b = _mm_adds_epi16(b, k128);
+        _mm_storeu_si128((__m128i*)(data + i), _mm_packus_epi16(a, b));
+        g0 = _mm_add_ps(g0, inc);
+        g1 = _mm_add_ps(g1, inc);
+        g2 = _mm_add_ps(g2, inc);
+        g3 = _mm_add_ps(g3, inc);
+    }
+    scale_u8_c(data + i, n - i, gain + float(i)*step, step);
+}
+
+void scale_s16_sse2(quint8 *data, int n, float gain, float step)
+{
+    qint16 *p = (qint16*)data;
+    const __m128 inc = _mm_set1_ps(8.0f*step);
+    __m128 g0 = gain_sse2(gain, step);
+    __m128 g1 = gain_sse2(gain + 4.0f*step, step);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        _mm_storeu_si128((__m128i*)(p + i), scale_s16x8_sse2(v, g0, g1));
+        g0 = _mm_add_ps(g0, inc);
+        g1 = _mm_add_ps(g1, inc);
+    }
+    scale_s16_c((quint8*)(p + i), n - i, gain + float(i)*step, step);
+}
+
+void scale_s32_sse2(quint8 *data, int n, float gain, float step)
+{
+    qint32 *p = (qint32*)data;
+    const __m128 vmax = _mm_set1_ps(kMaxS32f);
+    const __m128 inc = _mm_set1_ps(4.0f*step);
+    __m128 g = gain_sse2(gain, step);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128 x = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(p + i)));
+        _mm_storeu_si128((__m128i*)(p + i), _mm_cvtps_epi32(_mm_min_ps(_mm_mul_ps(x, g), vmax)));
+        g = _mm_add_ps(g, inc);
+    }
+    scale_s32_c((quint8*)(p + i), n - i, gain + float(i)*step, step);
+}
+
+void scale_float_sse2(quint8 *data, int n, float gain, float step)
+{
+    float *p = (float*)data;
+    const __m128 inc = _mm_set1_ps(4.0f*step);
+    __m128 g = gain_sse2(gain, step);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(p + i, _mm_mul_ps(_mm_loadu_ps(p + i), g));
+        g = _mm_add_ps(g, inc);
+    }
+    scale_float_c((quint8*)(p + i), n - i, gain + float(i)*step, step);
+}
+
+void scale_double_sse2(quint8 *data, int n, float gain, float step)
+{
+    double *p = (double*)data;
+    const __m128d inc = _mm_set1_pd(2.0*step);
+    __m128d g = _mm_setr_pd(gain, double(gain) + step);
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(p + i, _mm_mul_pd(_mm_loadu_pd(p + i), g));
+        g = _mm_add_pd(g, inc);
+    }
+    scale_double_c((quint8*)(p + i), n - i, gain + float(i)*step, step);
+}
+#endif //AUDIO_SSE2
+
+#if AUDIO_AVX2
+TARGET_AVX2 static inline __m256 gain_avx2(float g, float step)
+{
+    return _mm256_add_ps(_mm256_set1_ps(g), _mm256_mul_ps(_mm256_set1_ps(step), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)));
+}
+
+// 8 int32 scaled and converted to 8 s16
+TARGET_AVX2 static inline __m128i scale_s32x8_to_s16_avx2(__m256i v, __m256 g)
+{
+    const __m256 x = _mm256_min_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(v), g), _mm256_set1_ps(kMaxS32f));
+    const __m256i r = _mm256_cvtps_epi32(x);
+    return _mm_packs_epi32(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1));
+}
+
+TARGET_AVX2 void scale_u8_avx2(quint8 *data, int n, float gain, float step)
+{
+    const __m256i k128 = _mm256_set1_epi32(128);
+    const __m128i k128_16 = _mm_set1_epi16(128);
+    const __m256 inc = _mm256_set1_ps(16.0f*step);
+    __m256 g0 = gain_avx2(gain, step);
+    __m256 g1 = gain_avx2(gain + 8.0f*step, step);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        const __m256i lo = _mm256_sub_epi32(_mm256_cvtepu8_epi32(v), k128);
+        const __m256i hi = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_srli_si128(v, 8)), k128);
+        const __m128i a = _mm_adds_epi16(scale_s32x8_to_s16_avx2(lo, g0), k128_16);
+        const __m128i b = _mm_adds_epi16(scale_s32x8_to_s16_avx2(hi, g1), k128_16);
+        _mm_storeu_si128((__m128i*)(data + i), _mm_packus_epi16(a, b));
+        g0 = _mm256_add_ps(g0, inc);
+        g1 = _mm256_add_ps(g1, inc);
+    }
+    scale_u8_c(data + i, n - i, gain + float(i)*step, step);
+}
+
+TARGET_AVX2 void scale_s16_avx2(quint8 *data, int n, float gain, float step)
+{
+    qint16 *p = (qint16*)data;
+    const __m256 inc = _mm256_set1_ps(16.0f*step);
+    __m256 g0 = gain_avx2(gain, step);
+    __m256 g1 = gain_avx2(gain + 8.0f*step, step);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i a = _mm_loadu_si128((const __m128i*)(p + i));
+        const __m128i b = _mm_loadu_si128((const __m128i*)(p + i + 8));
+        _mm_storeu_si128((__m128i*)(p + i), scale_s32x8_to_s16_avx2(_mm256_cvtepi16_epi32(a), g0));
+        _mm_storeu_si128((__m128i*)(p + i + 8), scale_s32x8_to_s16_avx2(_mm256_cvtepi16_epi32(b), g1));
+        g0 = _mm256_add_ps(g0, inc);
+        g1 = _mm256_add_ps(g1, inc);
+    }
+    scale_s16_c((quint8*)(p + i), n - i, gain + float(i)*step, step);
+}
+
+TARGET_AVX2 void scale_s32_avx2(quint8 *data, int n, float gain, float step)
+{
+    qint32 *p = (qint32*)data;
+    const __m256 vmax = _mm256_set1_ps(kMaxS32f);
+    const __m256 inc = _mm256_set1_ps(8.0f*step);
+    __m256 g = gain_avx2(gain, step);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 x = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(p + i)));
+        _mm256_storeu_si256((__m256i*)(p + i), _mm256_cvtps_epi32(_mm256_min_ps(_mm256_mul_ps(x, g), vmax)));
+        g = _mm256_add_ps(g, inc);
+    }
+    scale_s32_c((quint8*)(p + i), n - i, gain + float(i)*step, step);
+}
+
+TARGET_AVX2 void scale_float_avx2(quint8 *data, int n, float gain, float step)
+{
+    float *p = (float*)data;
+    const __m256 inc = _mm256_set1_ps(8.0f*step);
+    __m256 g = gain_avx2(gain, step);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(p + i, _mm256_mul_ps(_mm256_loadu_ps(p + i), g));
+        g = _mm256_add_ps(g, inc);
+    }
+    scale_float_c((quint8*)(p + i), n - i, gain + float(i)*step, step);
+}
+
+TARGET_AVX2 void scale_double_avx2(quint8 *data, int n, float gain, float step)
+{
+    double *p = (double*)data;
+    const __m256d inc = _mm256_set1_pd(4.0*step);
+    __m256d g = _mm256_add_pd(_mm256_set1_pd(gain), _mm256_mul_pd(_mm256_set1_pd(step), _mm256_setr_pd(0, 1, 2, 3)));
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(p + i, _mm256_mul_pd(_mm256_loadu_pd(p + i), g));
+        g = _mm256_add_pd(g, inc);
+    }
+    scale_double_c((quint8*)(p + i), n - i, gain + float(i)*step, step);
+}
+#endif //AUDIO_AVX2
+
+#if AUDIO_NEON
+static inline float32x4_t gain_neon(float g, float step)
+{
+    static const float k0123[4] = {0, 1, 2, 3};
+    return vmlaq_n_f32(vdupq_n_f32(g), vld1q_f32(k0123), step);
+}
+
+// vcvtq truncates and saturates
+static inline int32x4_t round_neon(float32x4_t x)
+{
+#if defined(__aarch64__)
+    return vcvtnq_s32_f32(x);
+#else
+    const uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(x), vdupq_n_u32(0x80000000));
+    const float32x4_t half = vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(vdupq_n_f32(0.5f)), sign));
+    return vcvtq_s32_f32(vaddq_f32(x, half));
+#endif
+}
+
+static inline int16x8_t scale_s16x8_neon(int16x8_t v, float32x4_t g0, float32x4_t g1)
+{
+    const float32x4_t lo = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), g0);
+    const float32x4_t hi = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), g1);
+    return vcombine_s16(vqmovn_s32(round_neon(lo)), vqmovn_s32(round_neon(hi)));
+}
+
+void scale_u8_neon(quint8 *data, int n, float gain, float step)
+{
+    const int16x8_t k128 = vdupq_n_s16(128);
+    const float32x4_t inc = vdupq_n_f32(8.0f*step);
+    float32x4_t g0 = gain_neon(gain, step);
+    float32x4_t g1 = gain_neon(gain + 4.0f*step, step);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(data + i))), k128);
+        vst1_u8(data + i, vqmovun_s16(vqaddq_s16(scale_s16x8_neon(v, g0, g1), k128)));
+        g0 = vaddq_f32(g0, inc);
+        g1 = vaddq_f32(g1, inc);
+    }
+    scale_u8_c(data + i, n - i, gain + float(i)*step, step);
+}
+
+void scale_s16_neon(quint8 *data, int n, float gain, float step)
+{
+    qint16 *p = (qint16*)data;
+    const float32x4_t inc = vdupq_n_f32(8.0f*step);
+    float32x4_t g0 = gain_neon(gain, step);
+    float32x4_t g1 = gain_neon(gain + 4.0f*step, step);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        vst1q_s16(p + i, scale_s16x8_neon(vld1q_s16(p + i), g0, g1));
+        g0 = vaddq_f32(g0, inc);
+        g1 = vaddq_f32(g1, inc);
+    }
+    scale_s16_c((quint8*)(p + i), n - i, gain + float(i)*step, step);
+}
+
+void scale_s32_neon(quint8 *data, int n, float gain, float step)
+{
+    qint32 *p = (qint32*)data;
+    const float32x4_t inc = vdupq_n_f32(4.0f*step);
+    float32x4_t g = gain_neon(gain, step);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        vst1q_s32(p + i, round_neon(vmulq_f32(vcvtq_f32_s32(vld1q_s32(p + i)), g)));
+        g = vaddq_f32(g, inc);
+    }
+    scale_s32_c((quint8*)(p + i), n - i, gain + float(i)*step, step);
+}
+
+void scale_float_neon(quint8 *data, int n, float gain, float step)
+{
+    float *p = (float*)data;
+    const float32x4_t inc = vdupq_n_f32(4.0f*step);
+    float32x4_t g = gain_neon(gain, step);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        vst1q_f32(p + i, vmulq_f32(vld1q_f32(p + i), g));
+        g = vaddq_f32(g, inc);
+    }
+    scale_float_c((quint8*)(p + i), n - i, gain + float(i)*step, step);
+}
+
+#if defined(__aarch64__)
+void scale_double_neon(quint8 *data, int n, float gain, float step)
+{
+    double *p = (double*)data;
+    const double g01[2] = { gain, double(gain) + step };
+    const float64x2_t inc = vdupq_n_f64(2.0*step);
+    float64x2_t g = vld1q_f64(g01);
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        vst1q_f64(p + i, vmulq_f64(vld1q_f64(p + i), g));
+        g = vaddq_f64(g, inc);
+    }
+    scale_double_c((quint8*)(p + i), n - i, gain + float(i)*step, step);
+}
+#else
+#define scale_double_neon scale_double_c // no double vectors
+#endif
+#endif //AUDIO_NEON
+
+// u8, s16, s32, float, double
+static const AudioVolume::Kernel kKernels[AudioVolume::IsaCount][5] = {
+    { scale_u8_c, scale_s16_c, scale_s32_c, scale_float_c, scale_double_c },
+#if AUDIO_SSE2
+    { scale_u8_sse2, scale_s16_sse2, scale_s32_sse2, scale_float_sse2, scale_double_sse2 },
+#else
+    { 0, 0, 0, 0, 0 },
+#endif
+#if AUDIO_AVX2
+    { scale_u8_avx2, scale_s16_avx2, scale_s32_avx2, scale_float_avx2, scale_double_avx2 },
+#else
+    { 0, 0, 0, 0, 0 },
+#endif
+#if AUDIO_NEON
+    { scale_u8_neon, scale_s16_neon, scale_s32_neon, scale_float_neon, scale_double_neon },
+#else
+    { 0, 0, 0, 0, 0 },
+#endif
+};
+
+static bool isAvailable(AudioVolume::Isa isa)
+{
+    const int flags = av_get_cpu_flags();
+    Q_UNUSED(flags);
+    switch (isa) {
+    case AudioVolume::C:
+        return true;
+#if AUDIO_SSE2
+    case AudioVolume::SSE2:
+        return !!(flags & AV_CPU_FLAG_SSE2);
+#endif
+#if AUDIO_AVX2 && defined(AV_CPU_FLAG_AVX2)
+    case AudioVolume::AVX2:
+        return !!(flags & AV_CPU_FLAG_AVX2);
+#endif
+#if AUDIO_NEON
+    case AudioVolume::NEON:
+#ifdef AV_CPU_FLAG_NEON
+        return !!(flags & AV_CPU_FLAG_NEON);
+#else
+        return true; // built with neon enabled
+#endif
+#endif
+    default:
+        return false;
+    }
+}
+} //namespace
+
+AudioVolume::Isa AudioVolume::bestIsa()
+{
+    static const Isa isa = isAvailable(AVX2) ? AVX2 : isAvailable(SSE2) ? SSE2 : isAvailable(NEON) ? NEON : C;
+    return isa;
+}
+
+const char* AudioVolume::isaName(Isa isa)
+{
+    static const char* kNames[] = { "C", "SSE2", "AVX2", "NEON" };
+    if (isa < 0 || isa >= IsaCount)
+        return "";
+    return kNames[isa];
+}
+
+AudioVolume::Kernel AudioVolume::kernel(AudioFormat::SampleFormat fmt, Isa isa)
+{
+    const int k = AudioSample::typeIndex(fmt);
+    if (k < 0 || isa < 0 || isa >= IsaCount || !isAvailable(isa))
+        return 0;
+    return kKernels[isa][k];
+}
+
+AudioVolume::AudioVolume()
+    : m_kernel(0)
+    , m_gain(1.0f)
+    , m_target(1.0f)
+    , m_step(0)
+    , m_ramp(0)
+{
+}
+
+void AudioVolume::setFormat(const AudioFormat &format)
+{
+    if (m_format == format)
+        return;
+    m_format = format;
+    m_kernel = format.isValid() ? kernel(format.sampleFormat(), bestIsa()) : 0;
+    m_gain = m_target;
+    m_ramp = 0;
+}
+
+void AudioVolume::setGain(qreal value)
+{
+    const float g = float(qMax<qreal>(value, 0));
+    if (g == m_target)
+        return;
+    m_target = g;
+    const int frames = m_format.isValid() ? m_format.sampleRate()*RampMs/1000 : 0;
+    if (frames <= 0) {
+        m_gain = g;
+        m_ramp = 0;
+        return;
+    }
+    // from the current gain, also if a ramp is in progress
+    m_ramp = frames;
+    m_step = (m_target - m_gain)/float(frames);
+}
+
+bool AudioVolume::process(quint8 *data, int bytes)
+{
+    if (!m_kernel)
+        return false;
+    if (isIdentity())
+        return true;
+    const int bps = m_format.bytesPerSample();
+    const int channels = m_format.channels();
+    if (bps <= 0 || channels <= 0)
+        return false;
+    const int frames = bytes/(bps*channels);
+    if (m_ramp <= 0 && m_gain == 0.0f) {
+        memset(data, m_format.isUnsigned() ? 0x80 : 0, frames*bps*channels);
+        return true;
+    }
+    // a plane is a channel of a planar format, or all interleaved channels
+    const int planes = m_format.isPlanar() ? channels : 1;
+    const int plane_channels = channels/planes;
+    const int ramp = qMin(m_ramp, frames);
+    const float ramp_end = ramp == m_ramp ? m_target : m_gain + float(ramp)*m_step;
+    for (int i = 0; i < planes; ++i) {
+        quint8 *p = data + i*frames*bps*plane_channels;
+        if (ramp > 0) {
+            if (plane_channels == 1) {
+                m_kernel(p, ramp, m_gain, m_step);
+            } else {
+                // kernels step per sample. all channels of a frame get the same gain, so the stereo image does not move
+                const int frame_bytes = plane_channels*bps;
+                for (int f = 0; f < ramp; ++f)
+                    m_kernel(p + f*frame_bytes, plane_channels, m_gain + float(f)*m_step, 0);
+            }
+        }
+        if (frames > ramp)
+            m_kernel(p + ramp*plane_channels*bps, (frames - ramp)*plane_channels, ramp_end, 0);
+    }
+    m_ramp -= ramp;
+    m_gain = ramp_end;
+    return true;
+}
+} //namespace QtAV
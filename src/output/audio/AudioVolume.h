@@ -0,0 +1,75 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+
+#ifndef QTAV_AUDIOVOLUME_H
+#define QTAV_AUDIOVOLUME_H
+
+#include "QtAV/AudioFormat.h"
+
+namespace QtAV {
+/*
+ * Software volume and mute of AudioOutput. Samples are scaled in place by a kernel for the sample format and the
+ * best instruction set of the cpu (AVX2, SSE2 or NEON, otherwise C), which is chosen once. A gain change is
+ * ramped linearly in RampMs to avoid zipper noise. The gain steps once per frame, so the channels of a frame and the
+ * planes of a planar format get the same gain.
+ */
+class Q_AV_PRIVATE_EXPORT AudioVolume
+{
+public:
+    enum Isa { C, SSE2, AVX2, NEON, IsaCount };
+    enum { RampMs = 10 };
+    /*!
+     * gain of sample i is gain + i*step. integer samples are rounded to nearest and saturated. s32 is scaled in
+     * float, i.e. with 24 bits precision
+     */
+    typedef void (*Kernel)(quint8 *data, int nb_samples, float gain, float step);
+    /// the best instruction set supported by this cpu and the build
+    static Isa bestIsa();
+    static const char* isaName(Isa isa);
+    /// null if fmt or isa is not supported
+    static Kernel kernel(AudioFormat::SampleFormat fmt, Isa isa);
+
+    AudioVolume();
+    /// the gain is set without a ramp if format changes
+    void setFormat(const AudioFormat& format);
+    const AudioFormat& format() const { return m_format;}
+    /// 0 is mute
+    void setGain(qreal value);
+    qreal gain() const { return m_target;}
+    /// true if process() does nothing, i.e. gain is 1 and no ramp is in progress
+    bool isIdentity() const { return m_ramp <= 0 && m_gain == 1.0f;}
+    /*!
+     * \brief process
+     * Scale whole frames in data in place. Planes of a planar format are stored one after another.
+     * \return false if the format is not supported
+     */
+    bool process(quint8* data, int bytes);
+private:
+    AudioFormat m_format;
+    Kernel m_kernel;
+    float m_gain; // current
+    float m_target;
+    float m_step; // per frame
+    int m_ramp; // frames to reach m_target
+};
+} //namespace QtAV
+#endif //QTAV_AUDIOVOLUME_H
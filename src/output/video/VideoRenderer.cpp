@@ -115,6 +115,16 @@ bool VideoRenderer::isPreferredPixelFormatForced() const
     return d_func().force_preferred;
 }
 
+qreal VideoRenderer::conversionTime() const
+{
+    return d_func().conversion_time;
+}
+
+void VideoRenderer::setConversionTime(qreal ms)
+{
+    d_func().conversion_time = ms;
+}
+
 qreal VideoRenderer::sourceAspectRatio() const
 {
     return d_func().source_aspect_ratio;
@@ -0,0 +1,82 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef QTAV_AUDIOSAMPLE_H
+#define QTAV_AUDIOSAMPLE_H
+
+#include "QtAV/AudioFormat.h"
+
+// instruction sets of the audio sample kernels (software volume, time stretch). the best one is chosen at runtime
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AUDIO_SSE2 1
+#include <emmintrin.h>
+#endif
+// avx2 kernels are built with a function target attribute, so no special compiler flag is required
+#if AUDIO_SSE2 && (defined(_MSC_VER) || defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define AUDIO_AVX2 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define AUDIO_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace QtAV {
+namespace AudioSample {
+// the largest float less than 2^31. cvtps_epi32 returns INT_MIN for larger values
+static const float kMaxS32f = 2147483520.0f;
+
+inline float clampf(float x, float lo, float hi)
+{
+    return x < lo ? lo : (x > hi ? hi : x);
+}
+
+/// index in u8, s16, s32, float, double kernel tables. -1 if not supported
+inline int typeIndex(AudioFormat::SampleFormat fmt)
+{
+    switch (fmt) {
+    case AudioFormat::SampleFormat_Unsigned8:
+    case AudioFormat::SampleFormat_Unsigned8Planar:
+        return 0;
+    case AudioFormat::SampleFormat_Signed16:
+    case AudioFormat::SampleFormat_Signed16Planar:
+        return 1;
+    case AudioFormat::SampleFormat_Signed32:
+    case AudioFormat::SampleFormat_Signed32Planar:
+        return 2;
+    case AudioFormat::SampleFormat_Float:
+    case AudioFormat::SampleFormat_FloatPlanar:
+        return 3;
+    case AudioFormat::SampleFormat_Double:
+    case AudioFormat::SampleFormat_DoublePlanar:
+        return 4;
+    default:
+        return -1;
+    }
+}
+} //namespace AudioSample
+} //namespace QtAV
+#endif //QTAV_AUDIOSAMPLE_H
@@ -23,16 +23,25 @@
 #ifndef QTAV_BLOCKINGQUEUE_H
 #define QTAV_BLOCKINGQUEUE_H
 
-#include <QtCore/QReadWriteLock>
 #include <QtCore/QScopedPointer>
-#include <QtCore/QWaitCondition>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <mutex>
+#include <utility>
 
-//TODO: block full and empty condition separately
 QT_BEGIN_NAMESPACE
 template<typename T> class QQueue;
 QT_END_NAMESPACE
 namespace QtAV {
 
+/*
+ * put() waits on cond_full and take() waits on cond_empty. A side only notifies the other if it is waiting,
+ * so put/take without a waiter are a short critical section and no wake up. State queries (size, isEmpty,
+ * isEnough, isFull) read atomics and never lock.
+ * Callbacks are called without the lock held, so they can call blockFull()/blockEmpty() of any queue.
+ */
 template <typename T, template <typename> class Container = QQueue>
 class BlockingQueue
 {
@@ -59,6 +68,8 @@ public:
      *          Note that even a 'full' queue will accept new items and t WILL be placed in the queue regardless of return value.
      */
     bool put(const T& t, unsigned long wait_timeout_ms = ULONG_MAX);
+    /// the same as put(const T&) but t is moved into the queue
+    bool put(T&& t, unsigned long wait_timeout_ms = ULONG_MAX);
     /*! \brief take
      *   Dequeue 1 item from queue, optionally blocking.
      * \param wait_timeout_ms this parameter is used if blockEmpty == true (the default).
@@ -68,6 +79,11 @@ public:
      * \return the item taken.  It may not be valid if the queue was empty and timeout expired. Check optional isValid flag to determine if that is the case.
      */
     T take(unsigned long wait_timeout_ms = ULONG_MAX, bool *isValid = 0);
+    /*! \brief waitNotFull
+     *  Wait until the queue is not full, without putting anything. Wakes up on take() and clear().
+     * \return false if the queue is still full after wait_timeout_ms
+     */
+    bool waitNotFull(unsigned long wait_timeout_ms = ULONG_MAX);
     void setBlocking(bool block); //will wake if false. called when no more data can enqueue
     void blockEmpty(bool block);
     void blockFull(bool block);
@@ -96,22 +112,31 @@ protected:
      * \brief checkFull
      * Check whether the queue is full. Default implemention is compare queue size to capacity.
      * Full is now a more generic notion. You can implement it as checking queued bytes etc.
+     * Called with the queue locked.
      * \return true if queue is full
      */
     virtual bool checkFull() const;
     virtual bool checkEmpty() const;
     virtual bool checkEnough() const;
 
+    // called with the queue locked
     virtual void onPut(const T&) {}
     virtual void onTake(const T&) {}
 
-    bool block_empty, block_full;
-    int cap, thres;
+    std::atomic<bool> block_empty, block_full;
+    std::atomic<int> cap, thres;
     Container<T> queue;
 private:
-    mutable QReadWriteLock lock; //locker in const func
-    QReadWriteLock block_change_lock;
-    QWaitCondition cond_full, cond_empty;
+    template<typename U> bool putImpl(U&& t, unsigned long timeout_ms);
+    // unlock, call and lock again
+    void invoke(StateChangeCallback *cb, std::unique_lock<std::mutex>& locker);
+    // return false if timed out
+    static bool wait(std::condition_variable& cond, std::unique_lock<std::mutex>& locker, unsigned long timeout_ms);
+
+    mutable std::mutex lock;
+    std::condition_variable cond_full, cond_empty;
+    int wait_full, wait_empty; // waiting threads. guarded by lock
+    std::atomic<int> count; // queue.size() for lock free queries
     //upto_threshold_callback, downto_threshold_callback
     QScopedPointer<StateChangeCallback> empty_callback, threshold_callback, full_callback;
 };
@@ -122,6 +147,9 @@ private:
 template <typename T, template <typename> class Container>
 BlockingQueue<T, Container>::BlockingQueue()
     :block_empty(true),block_full(true),cap(48),thres(32)
+    , wait_full(0)
+    , wait_empty(0)
+    , count(0)
     , empty_callback(0)
     , threshold_callback(0)
     , full_callback(0)
@@ -132,18 +160,18 @@ template <typename T, template <typename> class Container>
 void BlockingQueue<T, Container>::setCapacity(int max)
 {
     //qDebug("queue capacity==>>%d", max);
-    QWriteLocker locker(&lock);
+    std::lock_guard<std::mutex> locker(lock);
     Q_UNUSED(locker);
     cap = max;
     if (thres > cap)
-        thres = cap;
+        thres = max;
 }
 
 template <typename T, template <typename> class Container>
 void BlockingQueue<T, Container>::setThreshold(int min)
 {
     //qDebug("queue threshold==>>%d", min);
-    QWriteLocker locker(&lock);
+    std::lock_guard<std::mutex> locker(lock);
     Q_UNUSED(locker);
     if (min > cap)
         return;
@@ -152,29 +180,44 @@ void BlockingQueue<T, Container>::setThreshold(int min)
 
 template <typename T, template <typename> class Container>
 bool BlockingQueue<T, Container>::put(const T& t, unsigned long timeout_ms)
+{
+    return putImpl(t, timeout_ms);
+}
+
+template <typename T, template <typename> class Container>
+bool BlockingQueue<T, Container>::put(T&& t, unsigned long timeout_ms)
+{
+    return putImpl(std::move(t), timeout_ms);
+}
+
+template <typename T, template <typename> class Container>
+template <typename U>
+bool BlockingQueue<T, Container>::putImpl(U&& t, unsigned long timeout_ms)
 {
     bool ret = true;
-    QWriteLocker locker(&lock);
-    Q_UNUSED(locker);
+    std::unique_lock<std::mutex> locker(lock);
     if (checkFull()) {
         ret = false;
         //qDebug("queue full"); //too frequent
         if (full_callback) {
-            full_callback->call();
+            invoke(full_callback.data(), locker);
+        }
+        if (block_full && checkFull()) {
+            ++wait_full;
+            ret = wait(cond_full, locker, timeout_ms);
+            --wait_full;
         }
-        if (block_full)
-            ret = cond_full.wait(&lock, timeout_ms);
         // uncomment here to reject placing items into a full queue -- update API docs if you do this.
         // if (!ret) return false;
     }
-    queue.enqueue(t);
-    onPut(t); // emit bufferProgressChanged here if buffering
-    if (checkEnough()) {
-        cond_empty.wakeOne(); //emit buffering finished here
-        //qDebug("queue is enough: %d/%d~%d", queue.size(), thres, cap);
-    } else {
-        //qDebug("buffering: %d/%d~%d", queue.size(), thres, cap);
-    }
+    queue.enqueue(std::forward<U>(t));
+    count.store(queue.size(), std::memory_order_release);
+    onPut(queue.last()); // emit bufferProgressChanged here if buffering
+    //emit buffering finished here
+    const bool wake = wait_empty > 0 && checkEnough();
+    locker.unlock();
+    if (wake)
+        cond_empty.notify_one();
     return ret;
 }
 
@@ -182,130 +225,141 @@ template <typename T, template <typename> class Container>
 T BlockingQueue<T, Container>::take(unsigned long timeout_ms, bool *isValid)
 {
     if (isValid) *isValid = false;
-    QWriteLocker locker(&lock);
-    Q_UNUSED(locker);
+    std::unique_lock<std::mutex> locker(lock);
     if (checkEmpty()) {//TODO:always block?
         //qDebug("queue empty!!");
         if (empty_callback) {
-            empty_callback->call();
+            invoke(empty_callback.data(), locker);
+        }
+        if (block_empty && checkEmpty()) { //block when empty only
+            ++wait_empty;
+            wait(cond_empty, locker, timeout_ms);
+            --wait_empty;
         }
-        if (block_empty)
-            cond_empty.wait(&lock,timeout_ms); //block when empty only
     }
     if (checkEmpty()) {
         //qWarning("Queue is still empty");
         if (empty_callback) {
-            empty_callback->call();
+            invoke(empty_callback.data(), locker);
         }
         return T();
     }
     T t(queue.dequeue());
+    count.store(queue.size(), std::memory_order_release);
     if (isValid) *isValid = true;
-    cond_full.wakeOne();
     onTake(t); // emit start buffering here if empty
+    const bool wake = wait_full > 0;
+    locker.unlock();
+    if (wake)
+        cond_full.notify_one();
     return t;
 }
 
+template <typename T, template <typename> class Container>
+bool BlockingQueue<T, Container>::waitNotFull(unsigned long timeout_ms)
+{
+    std::unique_lock<std::mutex> locker(lock);
+    if (!checkFull())
+        return true;
+    ++wait_full;
+    wait(cond_full, locker, timeout_ms);
+    --wait_full;
+    return !checkFull();
+}
+
 template <typename T, template <typename> class Container>
 void BlockingQueue<T, Container>::setBlocking(bool block)
 {
-    QWriteLocker locker(&lock);
+    std::lock_guard<std::mutex> locker(lock);
     Q_UNUSED(locker);
     block_empty = block_full = block;
     if (!block) {
-        cond_empty.wakeAll(); //empty still wait. setBlock=>setCapacity(-1)
-        cond_full.wakeAll();
+        cond_empty.notify_all(); //empty still wait. setBlock=>setCapacity(-1)
+        cond_full.notify_all();
     }
 }
 
 template <typename T, template <typename> class Container>
 void BlockingQueue<T, Container>::blockEmpty(bool block)
 {
-    if (!block) {
-        cond_empty.wakeAll();
-    }
-    QWriteLocker locker(&block_change_lock);
-    Q_UNUSED(locker);
     block_empty = block;
+    if (block)
+        return;
+    // a waiter checked block_empty with the lock held, so it is already waiting
+    std::lock_guard<std::mutex> locker(lock);
+    Q_UNUSED(locker);
+    if (wait_empty > 0)
+        cond_empty.notify_all();
 }
 
 template <typename T, template <typename> class Container>
 void BlockingQueue<T, Container>::blockFull(bool block)
 {
-    if (!block) {
-        cond_full.wakeAll();
-    }
-    //DO NOT use the same lock that put() get() use. it may be already locked
-    //this function usualy called in demux thread, so no lock is ok
-    QWriteLocker locker(&block_change_lock);
-    Q_UNUSED(locker);
+    //usualy called in demux thread for every packet, only lock if someone may be woken up
     block_full = block;
+    if (block)
+        return;
+    std::lock_guard<std::mutex> locker(lock);
+    Q_UNUSED(locker);
+    if (wait_full > 0)
+        cond_full.notify_all();
 }
 
 template <typename T, template <typename> class Container>
 void BlockingQueue<T, Container>::clear()
 {
-    QWriteLocker locker(&lock);
-    Q_UNUSED(locker);
-    //cond_empty.wakeAll();
-    cond_full.wakeAll();
+    std::unique_lock<std::mutex> locker(lock);
+    //cond_empty.notify_all();
     queue.clear();
+    count.store(0, std::memory_order_release);
     //TODO: assert not empty
     onTake(T());
+    const bool wake = wait_full > 0;
+    locker.unlock();
+    if (wake)
+        cond_full.notify_all();
 }
 
 template <typename T, template <typename> class Container>
 bool BlockingQueue<T, Container>::isEmpty() const
 {
-    QReadLocker locker(&lock);
-    Q_UNUSED(locker);
-    return queue.isEmpty();
+    return count.load(std::memory_order_acquire) == 0;
 }
 
 template <typename T, template <typename> class Container>
 bool BlockingQueue<T, Container>::isEnough() const
 {
-    QReadLocker locker(&lock);
-    Q_UNUSED(locker);
-    return queue.size() >= thres;
+    return count.load(std::memory_order_acquire) >= thres;
 }
 
 template <typename T, template <typename> class Container>
 bool BlockingQueue<T, Container>::isFull() const
 {
-    QReadLocker locker(&lock);
-    Q_UNUSED(locker);
-    return queue.size() >= cap;
+    return count.load(std::memory_order_acquire) >= cap;
 }
 
 template <typename T, template <typename> class Container>
 int BlockingQueue<T, Container>::size() const
 {
-    QReadLocker locker(&lock);
-    Q_UNUSED(locker);
-    return queue.size();
+    return count.load(std::memory_order_acquire);
 }
 
 template <typename T, template <typename> class Container>
 int BlockingQueue<T, Container>::threshold() const
 {
-    QReadLocker locker(&lock);
-    Q_UNUSED(locker);
     return thres;
 }
 
 template <typename T, template <typename> class Container>
 int BlockingQueue<T, Container>::capacity() const
 {
-    QReadLocker locker(&lock);
-    Q_UNUSED(locker);
     return cap;
 }
 
 template <typename T, template <typename> class Container>
 void BlockingQueue<T, Container>::setEmptyCallback(StateChangeCallback *call)
 {
-    QWriteLocker locker(&lock);
+    std::lock_guard<std::mutex> locker(lock);
     Q_UNUSED(locker);
     empty_callback.reset(call);
 }
@@ -313,7 +367,7 @@ void BlockingQueue<T, Container>::setEmptyCallback(StateChangeCallback *call)
 template <typename T, template <typename> class Container>
 void BlockingQueue<T, Container>::setThresholdCallback(StateChangeCallback *call)
 {
-    QWriteLocker locker(&lock);
+    std::lock_guard<std::mutex> locker(lock);
     Q_UNUSED(locker);
     threshold_callback.reset(call);
 }
@@ -321,7 +375,7 @@ void BlockingQueue<T, Container>::setThresholdCallback(StateChangeCallback *call
 template <typename T, template <typename> class Container>
 void BlockingQueue<T, Container>::setFullCallback(StateChangeCallback *call)
 {
-    QWriteLocker locker(&lock);
+    std::lock_guard<std::mutex> locker(lock);
     Q_UNUSED(locker);
     full_callback.reset(call);
 }
@@ -343,5 +397,23 @@ bool BlockingQueue<T, Container>::checkEnough() const
 {
     return queue.size() >= thres && !checkEmpty();
 }
+
+template <typename T, template <typename> class Container>
+void BlockingQueue<T, Container>::invoke(StateChangeCallback *cb, std::unique_lock<std::mutex> &locker)
+{
+    locker.unlock();
+    cb->call();
+    locker.lock();
+}
+
+template <typename T, template <typename> class Container>
+bool BlockingQueue<T, Container>::wait(std::condition_variable &cond, std::unique_lock<std::mutex> &locker, unsigned long timeout_ms)
+{
+    if (timeout_ms == ULONG_MAX) {
+        cond.wait(locker);
+        return true;
+    }
+    return cond.wait_for(locker, std::chrono::milliseconds(timeout_ms)) == std::cv_status::no_timeout;
+}
 } //namespace QtAV
 #endif // QTAV_BLOCKINGQUEUE_H
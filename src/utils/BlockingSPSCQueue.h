@@ -0,0 +1,124 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef QTAV_BLOCKINGSPSCQUEUE_H
+#define QTAV_BLOCKINGSPSCQUEUE_H
+
+#include "SPSCQueue.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace QtAV {
+/*
+ * rigtorp::SPSCQueue with blocking push()/front(). The fast path is lock free. A side only takes the
+ * mutex to sleep when the queue is full/empty, and the other side only takes it to wake a sleeping peer.
+ * close() wakes every waiter, and after that push() fails and front() returns null once the queue is empty.
+ */
+template<typename T>
+class BlockingSPSCQueue {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    explicit BlockingSPSCQueue(size_t capacity)
+        : m_queue(capacity)
+        , m_closed(false)
+        , m_wait_pop(false)
+        , m_wait_push(false)
+    {}
+    size_t capacity() const { return m_queue.capacity(); }
+    size_t size() const { return m_queue.size(); }
+    bool isClosed() const { return m_closed.load(std::memory_order_acquire); }
+    void close() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed.store(true, std::memory_order_release);
+        m_cond_pop.notify_all();
+        m_cond_push.notify_all();
+        m_cond_closed.notify_all();
+    }
+    // producer. blocks if full. return false if closed
+    bool push(const T& v) {
+        if (!m_queue.try_push(v)) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wait_push.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            while (!isClosed() && !m_queue.try_push(v))
+                m_cond_push.wait(lock);
+            m_wait_push.store(false, std::memory_order_relaxed);
+            if (isClosed())
+                return false;
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_wait_pop.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_cond_pop.notify_one();
+        }
+        return true;
+    }
+    // consumer. blocks if empty. return null if closed and empty
+    T* front() {
+        T* p = m_queue.front();
+        if (p)
+            return p;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wait_pop.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!(p = m_queue.front()) && !isClosed())
+            m_cond_pop.wait(lock);
+        m_wait_pop.store(false, std::memory_order_relaxed);
+        return p;
+    }
+    // consumer. null if empty, never blocks
+    T* tryFront() { return m_queue.front(); }
+    // consumer
+    void pop() {
+        m_queue.pop();
+        wakeProducer();
+    }
+    // consumer
+    void clear() {
+        while (m_queue.front())
+            m_queue.pop();
+        wakeProducer();
+    }
+    // sleep until t or close(). return false if closed
+    bool waitUntil(const Clock::time_point& t) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return !m_cond_closed.wait_until(lock, t, [this] { return isClosed(); });
+    }
+private:
+    void wakeProducer() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_wait_push.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_cond_push.notify_one();
+        }
+    }
+
+    rigtorp::SPSCQueue<T> m_queue;
+    std::atomic<bool> m_closed;
+    std::atomic<bool> m_wait_pop, m_wait_push;
+    std::mutex m_mutex;
+    std::condition_variable m_cond_pop, m_cond_push, m_cond_closed;
+};
+} //namespace QtAV
+#endif //QTAV_BLOCKINGSPSCQUEUE_H
@@ -0,0 +1,221 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+
+#include "FrameBufferPool.h"
+#include "QtAV/private/AVCompat.h"
+#include "QtAV/private/AVDecoder_p.h"
+#include "utils/Logger.h"
+
+namespace QtAV {
+
+FrameBufferPool& FrameBufferPool::instance()
+{
+    // frames may be released after static objects are destroyed
+    static FrameBufferPool *pool = new FrameBufferPool();
+    return *pool;
+}
+
+FrameBufferPool::FrameBufferPool()
+    : m_limit(512LL << 20)
+    , m_used(0)
+    , m_idle_bytes(0)
+{
+}
+
+int FrameBufferPool::getBuffer2(AVCodecContext *ctx, AVFrame *frame, int flags)
+{
+    const AVPixelFormat fmt = (AVPixelFormat)frame->format;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+    if (!ctx->codec || !(ctx->codec->capabilities & AV_CODEC_CAP_DR1) || !desc
+            || (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM))
+            || frame->width <= 0 || frame->height <= 0)
+        return avcodec_default_get_buffer2(ctx, frame, flags);
+    int w = frame->width;
+    int h = frame->height;
+    int stride_align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(ctx, &w, &h, stride_align);
+    // the same as avcodec_default_get_buffer2(): increase width until all line sizes are aligned
+    int linesize[4] = {0};
+    int unaligned = 0;
+    do {
+        if (av_image_fill_linesizes(linesize, fmt, w) < 0)
+            return avcodec_default_get_buffer2(ctx, frame, flags);
+        w += w & ~(w - 1);
+        unaligned = 0;
+        for (int i = 0; i < 4; ++i)
+            unaligned |= linesize[i] % Alignment;
+    } while (unaligned);
+    uint8_t *data[4] = {0};
+    const int size = av_image_fill_pointers(data, fmt, h, NULL, linesize);
+    if (size < 0)
+        return avcodec_default_get_buffer2(ctx, frame, flags);
+    // decoders may read 16 + STRIDE_ALIGN - 1 bytes after the last plane
+    AVBufferRef *buf = instance().get(size + 16 + Alignment - 1, false);
+    if (!buf)
+        return avcodec_default_get_buffer2(ctx, frame, flags);
+    av_image_fill_pointers(frame->data, fmt, h, buf->data, linesize);
+    for (int i = 0; i < 4; ++i)
+        frame->linesize[i] = linesize[i];
+    frame->buf[0] = buf;
+    frame->extended_data = frame->data;
+    return 0;
+}
+
+VideoFrame FrameBufferPool::videoFrame(int width, int height, const VideoFormat &format)
+{
+    const AVPixelFormat fmt = (AVPixelFormat)format.pixelFormatFFmpeg();
+    if (width <= 0 || height <= 0 || fmt == QTAV_PIX_FMT_C(NONE))
+        return VideoFrame();
+    int linesize[4] = {0};
+    if (av_image_fill_linesizes(linesize, fmt, FFALIGN(width, 8)) < 0)
+        return VideoFrame();
+    for (int i = 0; i < 4; ++i)
+        linesize[i] = FFALIGN(linesize[i], Alignment);
+    uint8_t *data[4] = {0};
+    const int size = av_image_fill_pointers(data, fmt, height, NULL, linesize);
+    if (size < 0)
+        return VideoFrame();
+    AVBufferRef *buf = instance().get(size);
+    if (!buf)
+        return VideoFrame();
+    av_image_fill_pointers(data, fmt, height, buf->data, linesize);
+    // av_malloc() is at least 16 bytes aligned
+    VideoFrame frame(width, height, format, QByteArray::fromRawData((const char*)buf->data, size), 16);
+    for (int i = 0; i < format.planeCount(); ++i) {
+        frame.setBits(data[i], i);
+        frame.setBytesPerLine(linesize[i], i);
+    }
+    frame.setSideData(Frame::BufferOwnerSideData, AVFrameBuffersRef::create(buf));
+    return frame;
+}
+
+AVBufferRef* FrameBufferPool::get(int size, bool fallback)
+{
+    if (size <= 0)
+        return NULL;
+    const int bucket = FFALIGN(size, BucketSize);
+    uint8_t *data = NULL;
+    bool pooled = true;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Q_UNUSED(lock);
+        QHash<int, QVector<uint8_t*> >::iterator it = m_idle.find(bucket);
+        if (it != m_idle.end() && !it->isEmpty()) {
+            data = it->takeLast();
+            m_idle_bytes -= bucket;
+        } else if (reserve(bucket)) {
+            m_used += bucket;
+        } else if (fallback) {
+            pooled = false;
+        } else {
+            return NULL;
+        }
+    }
+    if (!data) {
+        data = (uint8_t*)av_malloc(pooled ? bucket : size);
+        if (!data) {
+            if (pooled) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                Q_UNUSED(lock);
+                m_used -= bucket;
+            }
+            return NULL;
+        }
+    }
+    void *opaque = pooled ? (void*)(intptr_t)bucket : NULL;
+    AVBufferRef *buf = av_buffer_create(data, pooled ? bucket : size, release, opaque, 0);
+    if (!buf)
+        release(opaque, data);
+    return buf;
+}
+
+void FrameBufferPool::release(void *opaque, uint8_t *data)
+{
+    const int bucket = (int)(intptr_t)opaque;
+    if (!bucket) {
+        av_free(data);
+        return;
+    }
+    FrameBufferPool &pool = instance();
+    std::lock_guard<std::mutex> lock(pool.m_mutex);
+    Q_UNUSED(lock);
+    if (pool.m_used > pool.m_limit) { // limit is decreased
+        av_free(data);
+        pool.m_used -= bucket;
+        return;
+    }
+    pool.m_idle[bucket].append(data);
+    pool.m_idle_bytes += bucket;
+}
+
+bool FrameBufferPool::reserve(qint64 bytes)
+{
+    QHash<int, QVector<uint8_t*> >::iterator it = m_idle.begin();
+    while (m_used + bytes > m_limit && m_idle_bytes > 0 && it != m_idle.end()) {
+        if (it->isEmpty()) {
+            ++it;
+            continue;
+        }
+        av_free(it->takeLast());
+        m_used -= it.key();
+        m_idle_bytes -= it.key();
+    }
+    return m_used + bytes <= m_limit;
+}
+
+void FrameBufferPool::setMemoryLimit(qint64 bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Q_UNUSED(lock);
+    m_limit = qMax<qint64>(bytes, 0);
+    reserve(0);
+}
+
+qint64 FrameBufferPool::memoryLimit() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Q_UNUSED(lock);
+    return m_limit;
+}
+
+qint64 FrameBufferPool::memoryUsage() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Q_UNUSED(lock);
+    return m_used;
+}
+
+void FrameBufferPool::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Q_UNUSED(lock);
+    for (QHash<int, QVector<uint8_t*> >::iterator it = m_idle.begin(); it != m_idle.end(); ++it) {
+        foreach (uint8_t *data, *it) {
+            av_free(data);
+        }
+        m_used -= qint64(it.key())*it->size();
+        it->clear();
+    }
+    m_idle_bytes = 0;
+}
+
+} //namespace QtAV
@@ -0,0 +1,91 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+
+
+#ifndef QTAV_FRAMEBUFFERPOOL_H
+#define QTAV_FRAMEBUFFERPOOL_H
+
+#include <QtCore/QHash>
+#include <QtCore/QVector>
+#include <mutex>
+#include "QtAV/VideoFrame.h"
+
+struct AVBufferRef;
+struct AVCodecContext;
+struct AVFrame;
+
+namespace QtAV {
+/*
+ * Process wide pool of video frame buffers, shared by software decoders (get_buffer2) and frame
+ * conversion/copy. Buffers are bucketed by size, so frames of the same format and size reuse each other's
+ * memory, also across players and decoder reopen. A buffer goes back to its bucket when the last AVBufferRef
+ * is released. Pooled memory (idle and in use) is limited: idle buffers of other buckets are freed first,
+ * then buffers are allocated without pooling.
+ */
+class FrameBufferPool
+{
+public:
+    enum {
+        Alignment = 64, // line size alignment. buffers are av_malloc()ed, so aligned for FFmpeg SIMD
+        BucketSize = 4096 // sizes are rounded up to it
+    };
+    /// it is never destroyed
+    static FrameBufferPool& instance();
+    /*!
+     * \brief getBuffer2
+     * AVCodecContext.get_buffer2 for software decoders. Falls back to avcodec_default_get_buffer2() for codecs
+     * without AV_CODEC_CAP_DR1, hw and palette formats, or if the pool is full.
+     */
+    static int getBuffer2(AVCodecContext* ctx, AVFrame* frame, int flags);
+    /*!
+     * \brief videoFrame
+     * A frame with all planes in 1 pooled buffer and line sizes aligned to Alignment. Data is not initialized.
+     * The buffer is referenced by Frame::BufferOwnerSideData and released with the last copy of the frame. Frame data is
+     * a raw QByteArray, so writing via frameData() detaches (copy on write).
+     */
+    static VideoFrame videoFrame(int width, int height, const VideoFormat& format);
+
+    /*!
+     * \brief get
+     * \param size at least size bytes
+     * \param fallback if the pool is full, allocate a buffer which is freed when released. otherwise return null
+     */
+    AVBufferRef* get(int size, bool fallback = true);
+    /// default is 512MB
+    void setMemoryLimit(qint64 bytes);
+    qint64 memoryLimit() const;
+    /// pooled bytes, idle and in use
+    qint64 memoryUsage() const;
+    /// free idle buffers
+    void clear();
+private:
+    FrameBufferPool();
+    static void release(void* opaque, uint8_t* data);
+    // free idle buffers until bytes can be allocated within limit. called with lock
+    bool reserve(qint64 bytes);
+
+    mutable std::mutex m_mutex;
+    QHash<int, QVector<uint8_t*> > m_idle; // bucket size => free buffers
+    qint64 m_limit, m_used, m_idle_bytes;
+};
+} //namespace QtAV
+#endif // QTAV_FRAMEBUFFERPOOL_H
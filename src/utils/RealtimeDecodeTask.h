@@ -0,0 +1,97 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef QTAV_REALTIMEDECODETASK_H
+#define QTAV_REALTIMEDECODETASK_H
+
+#include "BlockingSPSCQueue.h"
+#include "WorkPool.h"
+
+namespace QtAV {
+/*
+ * realtime decode mode with AVPlayer::sharedThreadPool(): a decoder runs as a task of the shared WorkPool
+ * instead of in the demux thread. The task is posted by the reader if it is idle, or at the presentation deadline,
+ * and is never run by 2 workers at the same time.
+ * Decoder must provide:
+ *   bool decodeNext(bool *wait); // decode the front packet of the queue. false if queue is empty. wait: wait for deadline()
+ *   Clock::time_point deadline() const;
+ * Blocking parts of decoding (delivery to outputs) must be in a WorkPool::Blocking scope.
+ */
+template<class Decoder, typename T>
+class RealtimeDecodeTask : public WorkPool::Task {
+public:
+    enum State { Idle, Posted, Running, Finished };
+    RealtimeDecodeTask(Decoder *decoder, BlockingSPSCQueue<T> *packets)
+        : m_decoder(decoder)
+        , m_packets(packets)
+        , m_state(Idle)
+        , m_stop(false)
+    {}
+    // reader: a packet is pushed
+    void wake() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int s = Idle;
+        if (m_state.compare_exchange_strong(s, Posted))
+            WorkPool::instance().post(this);
+    }
+    // stop decoding and wait until the task is not in the pool
+    void finish() {
+        m_stop = true;
+        wake();
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this] { return m_state.load() == Finished; });
+    }
+    void run() override {
+        m_state = Running;
+        bool wait = false;
+        while (!m_stop) {
+            if (m_decoder->decodeNext(&wait)) {
+                if (!wait)
+                    continue;
+                m_state = Posted;
+                WorkPool::instance().postAt(this, m_decoder->deadline());
+                return;
+            }
+            if (m_packets->isClosed())
+                break;
+            m_state = Idle;
+            // a packet pushed before Idle is visible to the reader did not post this task. size() is safe to call from here
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (m_packets->size() == 0 && !m_stop && !m_packets->isClosed())
+                return;
+            int s = Idle;
+            if (!m_state.compare_exchange_strong(s, Running)) // posted by wake()
+                return;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_state = Finished;
+        m_cond.notify_all();
+    }
+private:
+    Decoder *m_decoder;
+    BlockingSPSCQueue<T> *m_packets;
+    std::atomic<int> m_state;
+    std::atomic<bool> m_stop;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+};
+} //namespace QtAV
+#endif //QTAV_REALTIMEDECODETASK_H
@@ -0,0 +1,168 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+
+#include "SwsContextCache.h"
+#include <string.h>
+#include "QtAV/private/AVCompat.h"
+#include "utils/Logger.h"
+
+namespace QtAV {
+
+bool SwsContextCache::Key::operator==(const Key &other) const
+{
+    return !memcmp(this, &other, sizeof(Key));
+}
+
+SwsContextCache& SwsContextCache::instance()
+{
+    // converters may be destroyed after static objects
+    static SwsContextCache *cache = new SwsContextCache();
+    return *cache;
+}
+
+SwsContextCache::SwsContextCache()
+    : m_capacity(32)
+    , m_reserved(0)
+    , m_hits(0)
+    , m_misses(0)
+{
+}
+
+SwsContext* SwsContextCache::checkout(const Key &key)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Q_UNUSED(lock);
+        for (std::list<Entry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+            if (it->key == key) {
+                SwsContext *ctx = it->ctx;
+                m_free.splice(m_free.begin(), m_entries, it);
+                m_hits.fetch_add(1, std::memory_order_relaxed);
+                return ctx;
+            }
+        }
+    }
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+    SwsContext *ctx = sws_getContext(key.w_in, key.h_in, (AVPixelFormat)key.fmt_in
+                                     , key.w_out, key.h_out, (AVPixelFormat)key.fmt_out
+                                     , key.flags, NULL, NULL, NULL);
+    if (!ctx)
+        return NULL;
+    if (sws_setColorspaceDetails(ctx, sws_getCoefficients(key.colorspace)
+                                 , key.range_in, sws_getCoefficients(key.colorspace)
+                                 , key.range_out
+                                 , ((key.brightness << 16) + 50)/100
+                                 , (((key.contrast + 100) << 16) + 50)/100
+                                 , (((key.saturation + 100) << 16) + 50)/100
+                                 ) < 0) {
+        qDebug("sws_setColorspaceDetails is not supported for %s => %s"
+               , av_get_pix_fmt_name((AVPixelFormat)key.fmt_in), av_get_pix_fmt_name((AVPixelFormat)key.fmt_out));
+    }
+    return ctx;
+}
+
+void SwsContextCache::checkin(const Key &key, SwsContext *ctx)
+{
+    if (!ctx)
+        return;
+    std::list<Entry> evicted;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Q_UNUSED(lock);
+        if (m_free.empty()) {
+            m_entries.push_front(Entry{key, ctx});
+        } else {
+            m_free.front() = Entry{key, ctx};
+            m_entries.splice(m_entries.begin(), m_free, m_free.begin());
+        }
+        trim(&evicted);
+    }
+    release(&evicted);
+}
+
+void SwsContextCache::trim(std::list<Entry>* evicted)
+{
+    const int capacity = qMax(m_capacity, m_reserved);
+    while ((int)m_entries.size() > capacity)
+        evicted->splice(evicted->begin(), m_entries, --m_entries.end());
+}
+
+void SwsContextCache::release(std::list<Entry>* evicted)
+{
+    if (evicted->empty())
+        return;
+    for (std::list<Entry>::iterator it = evicted->begin(); it != evicted->end(); ++it)
+        sws_freeContext(it->ctx);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Q_UNUSED(lock);
+    m_free.splice(m_free.begin(), *evicted);
+}
+
+void SwsContextCache::reserve(int delta)
+{
+    std::list<Entry> evicted;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Q_UNUSED(lock);
+        m_reserved = qMax(m_reserved + delta, 0);
+        trim(&evicted);
+    }
+    release(&evicted);
+}
+
+void SwsContextCache::setCapacity(int value)
+{
+    std::list<Entry> evicted;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Q_UNUSED(lock);
+        m_capacity = qMax(value, 0);
+        trim(&evicted);
+    }
+    release(&evicted);
+}
+
+int SwsContextCache::capacity() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Q_UNUSED(lock);
+    return m_capacity;
+}
+
+int SwsContextCache::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Q_UNUSED(lock);
+    return (int)m_entries.size();
+}
+
+void SwsContextCache::clear()
+{
+    std::list<Entry> evicted;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Q_UNUSED(lock);
+        evicted.splice(evicted.begin(), m_entries);
+    }
+    release(&evicted);
+}
+} //namespace QtAV
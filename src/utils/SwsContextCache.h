@@ -0,0 +1,100 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+
+#ifndef QTAV_SWSCONTEXTCACHE_H
+#define QTAV_SWSCONTEXTCACHE_H
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <QtCore/QtGlobal>
+
+struct SwsContext;
+
+namespace QtAV {
+/*
+ * Process wide LRU cache of SwsContexts shared by all ImageConverterFF instances, so converters alternating
+ * between sizes or formats, and short-lived converters (VideoFrame::to(), filters), reuse contexts instead of
+ * creating new ones. A context is checked out for exclusive use and checked in when done, so several contexts
+ * with the same parameters can be cached, e.g. for parallel bands. Converters reserve the contexts they use at once,
+ * and the cache grows to the sum. Nodes are reused and contexts are freed without the lock, so check-in on the
+ * per-frame path does not allocate.
+ */
+class SwsContextCache
+{
+public:
+    // everything that is applied when a context is created
+    struct Key {
+        int w_in, h_in, fmt_in;
+        int w_out, h_out, fmt_out;
+        int flags;
+        int range_in, range_out; // 0: limited, 1: full
+        int colorspace; // SWS_CS_*
+        int brightness, contrast, saturation; // -100~100
+        bool operator==(const Key& other) const;
+    };
+    /// it is never destroyed
+    static SwsContextCache& instance();
+    /*!
+     * \brief checkout
+     * Take the most recently used context for key, or create one if none is cached.
+     * \return null if the parameters are not supported
+     */
+    SwsContext* checkout(const Key& key);
+    /// return ctx from checkout(key) to the cache as the most recently used. the least recently used are freed if full
+    void checkin(const Key& key, SwsContext* ctx);
+    /*!
+     * \brief reserve
+     * Add the number of contexts a converter uses (e.g. its bands), negative to remove. The cache keeps at least
+     * the sum of all active converters, so they do not evict each other.
+     */
+    void reserve(int delta);
+    /// max cached (not checked out) contexts if fewer are reserved. default is 32
+    void setCapacity(int value);
+    int capacity() const;
+    int size() const;
+    /// checkouts with a cached context
+    qint64 hits() const { return m_hits;}
+    /// checkouts creating a context
+    qint64 misses() const { return m_misses;}
+    /// free all cached contexts
+    void clear();
+private:
+    struct Entry {
+        Key key;
+        SwsContext *ctx;
+    };
+    SwsContextCache();
+    // move the least recently used to evicted until size <= capacity. called with lock
+    void trim(std::list<Entry>* evicted);
+    // free the contexts of evicted without lock, and keep the nodes for reuse
+    void release(std::list<Entry>* evicted);
+
+    mutable std::mutex m_mutex;
+    std::list<Entry> m_entries; // most recently used first
+    std::list<Entry> m_free; // nodes of checked out contexts. reused by checkin(), so it does not allocate
+    int m_capacity;
+    int m_reserved;
+    std::atomic<qint64> m_hits, m_misses;
+};
+} //namespace QtAV
+#endif // QTAV_SWSCONTEXTCACHE_H
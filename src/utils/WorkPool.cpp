@@ -0,0 +1,357 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+
+#include "WorkPool.h"
+#include <algorithm>
+#include <limits>
+
+namespace QtAV {
+namespace {
+// the pool and the index of the worker running on current thread
+thread_local WorkPool *t_pool = nullptr;
+thread_local int t_index = -1;
+
+// jobs of parallelFor(). posted once per helper worker, deleted by the last of the helpers and the caller
+class ParallelJobs : public WorkPool::Task
+{
+public:
+    ParallelJobs(int count, const std::function<void(int)>& job, int owners)
+        : m_job(job)
+        , m_count(count)
+        , m_next(0)
+        , m_done(0)
+        , m_owners(owners)
+    {}
+    void run() override {
+        work();
+        release();
+    }
+    void work() {
+        int n = 0;
+        for (int i = m_next.fetch_add(1); i < m_count; i = m_next.fetch_add(1)) {
+            m_job(i);
+            ++n;
+        }
+        if (n > 0 && m_done.fetch_add(n) + n == m_count) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_cond.notify_all();
+        }
+    }
+    void wait() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_done.load() < m_count)
+            m_cond.wait(lock);
+    }
+    void release() {
+        if (m_owners.fetch_sub(1) == 1)
+            delete this;
+    }
+private:
+    const std::function<void(int)> m_job;
+    const int m_count;
+    std::atomic<int> m_next;
+    std::atomic<int> m_done;
+    std::atomic<int> m_owners;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+};
+}
+
+WorkPool& WorkPool::instance()
+{
+    // leaked: players may still be stopping during static destruction
+    static WorkPool *pool = new WorkPool(std::max<int>(2, std::thread::hardware_concurrency()));
+    return *pool;
+}
+
+WorkPool::WorkPool(int threads)
+    : m_next(0)
+    , m_ready(0)
+    , m_sleeping(0)
+    , m_next_timer(std::numeric_limits<Clock::rep>::max())
+    , m_stop(false)
+    , m_blocked(0)
+{
+    threads = std::max(threads, 1);
+    for (int i = 0; i < threads; ++i)
+        m_workers.push_back(new Worker());
+    for (int i = 0; i < threads; ++i)
+        m_workers[i]->thread = std::thread(&WorkPool::run, this, i);
+}
+
+WorkPool::~WorkPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_cond.notify_all();
+    }
+    for (Worker *w : m_workers)
+        w->thread.join();
+    std::vector<Spare*> spares;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        spares.swap(m_spares); // no new spare after m_stop
+        for (Spare *s : spares)
+            s->cond.notify_one();
+    }
+    for (Spare *s : spares) {
+        s->thread.join();
+        delete s;
+    }
+    // other threads steal from the queues until they are joined
+    for (Worker *w : m_workers)
+        delete w;
+}
+
+WorkPool::Blocking::Blocking()
+    : m_pool(t_pool)
+{
+    if (m_pool)
+        m_pool->beginBlocking();
+}
+
+WorkPool::Blocking::~Blocking()
+{
+    if (m_pool)
+        m_pool->endBlocking();
+}
+
+void WorkPool::beginBlocking()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stop)
+        return;
+    m_blocked.fetch_add(1);
+    // spares are only woken if no worker can take the ready tasks or timers, usually blocking is short
+    if (m_sleeping.load() == 0 && (m_ready.load() > 0 || !m_timers.empty()))
+        activateSpares();
+}
+
+void WorkPool::activateSpares()
+{
+    const int blocked = m_blocked.load();
+    for (int i = 0; i < blocked; ++i) {
+        if (i < int(m_spares.size())) {
+            m_spares[i]->cond.notify_one();
+            continue;
+        }
+        Spare *s = new Spare();
+        m_spares.push_back(s);
+        s->thread = std::thread(&WorkPool::runSpare, this, i);
+    }
+}
+
+void WorkPool::endBlocking()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stop)
+        return;
+    m_blocked.fetch_sub(1);
+}
+
+void WorkPool::post(Task *task)
+{
+    const bool local = t_pool == this && t_index >= 0;
+    const int index = local ? t_index : int(m_next.fetch_add(1, std::memory_order_relaxed) % m_workers.size());
+    Worker *w = m_workers[index];
+    size_t queued = 0;
+    {
+        std::lock_guard<std::mutex> lock(w->mutex);
+        w->tasks.push_back(task);
+        queued = w->tasks.size();
+    }
+    m_ready.fetch_add(1);
+    // the posting worker runs its own task next. only wake a thief if it has more
+    if (!local || queued > 1)
+        wakeOne();
+}
+
+void WorkPool::postAt(Task *task, const Clock::time_point &t)
+{
+    if (t <= Clock::now()) {
+        post(task);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const bool earliest = m_timers.empty() || t < m_timers.front().time;
+    m_timers.push_back(Timer{t, task});
+    std::push_heap(m_timers.begin(), m_timers.end());
+    if (earliest)
+        m_next_timer.store(t.time_since_epoch().count());
+    if (m_sleeping.load() == 0) {
+        // busy workers check the timers when a task is finished, blocked workers do not
+        if (m_blocked.load() > 0)
+            activateSpares();
+        return;
+    }
+    // a sleeping worker waits for the previous earliest timer
+    if (earliest)
+        m_cond.notify_one();
+}
+
+void WorkPool::parallelFor(int count, const std::function<void(int)> &job)
+{
+    if (count <= 0)
+        return;
+    if (count == 1) {
+        job(0);
+        return;
+    }
+    const int helpers = std::min(count - 1, threadCount());
+    ParallelJobs *jobs = new ParallelJobs(count, job, helpers + 1);
+    for (int i = 0; i < helpers; ++i)
+        post(jobs);
+    jobs->work();
+    jobs->wait();
+    jobs->release();
+}
+
+void WorkPool::wakeOne()
+{
+    // a worker increases m_sleeping before checking m_ready, so it either sees the new task or is woken here
+    if (m_sleeping.load() == 0) {
+        if (m_blocked.load() == 0)
+            return;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_sleeping.load() == 0) // all workers are busy and some are blocked
+            activateSpares();
+        else
+            m_cond.notify_one();
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cond.notify_one();
+}
+
+void WorkPool::takeExpired(const Clock::time_point &now, std::vector<Task*> *tasks)
+{
+    while (!m_timers.empty() && m_timers.front().time <= now) {
+        tasks->push_back(m_timers.front().task);
+        std::pop_heap(m_timers.begin(), m_timers.end());
+        m_timers.pop_back();
+    }
+    m_next_timer.store(m_timers.empty() ? std::numeric_limits<Clock::rep>::max() : m_timers.front().time.time_since_epoch().count());
+}
+
+WorkPool::Task* WorkPool::take(int index)
+{
+    Task *task = nullptr;
+    size_t first = 1;
+    if (index >= 0) {
+        Worker *w = m_workers[index];
+        std::lock_guard<std::mutex> lock(w->mutex);
+        if (!w->tasks.empty()) {
+            task = w->tasks.front();
+            w->tasks.pop_front();
+        }
+    } else {
+        index = int(m_next.fetch_add(1, std::memory_order_relaxed) % m_workers.size());
+        first = 0;
+    }
+    // steal the newest task of a busy worker
+    for (size_t i = first; !task && i < m_workers.size(); ++i) {
+        Worker *v = m_workers[(index + i) % m_workers.size()];
+        std::unique_lock<std::mutex> lock(v->mutex, std::try_to_lock);
+        if (!lock.owns_lock() || v->tasks.empty())
+            continue;
+        task = v->tasks.back();
+        v->tasks.pop_back();
+    }
+    if (task)
+        m_ready.fetch_sub(1);
+    return task;
+}
+
+void WorkPool::run(int index)
+{
+    t_pool = this;
+    t_index = index;
+    std::vector<Task*> expired;
+    for (;;) {
+        postExpired(&expired);
+        if (Task *task = take(index)) {
+            task->run();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_stop)
+            return;
+        m_sleeping.fetch_add(1);
+        if (m_ready.load() == 0) {
+            if (m_timers.empty())
+                m_cond.wait(lock);
+            else
+                m_cond.wait_until(lock, m_timers.front().time);
+        }
+        m_sleeping.fetch_sub(1);
+    }
+}
+
+void WorkPool::runSpare(int index)
+{
+    t_pool = this;
+    t_index = -1;
+    std::vector<Task*> expired;
+    for (;;) {
+        if (index < m_blocked.load()) {
+            postExpired(&expired);
+            if (Task *task = take(-1)) {
+                task->run();
+                continue;
+            }
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_stop)
+            return;
+        if (index >= m_blocked.load()) { // no blocked worker to replace
+            // it may be woken for a ready task while it was active. pass it on
+            if (m_ready.load() > 0)
+                m_cond.notify_one();
+            m_spares[index]->cond.wait(lock);
+            continue;
+        }
+        m_sleeping.fetch_add(1);
+        if (m_ready.load() == 0) {
+            if (m_timers.empty())
+                m_cond.wait(lock);
+            else
+                m_cond.wait_until(lock, m_timers.front().time);
+        }
+        m_sleeping.fetch_sub(1);
+    }
+}
+
+void WorkPool::postExpired(std::vector<Task*> *expired)
+{
+    const Clock::time_point now = Clock::now();
+    if (now.time_since_epoch().count() < m_next_timer.load(std::memory_order_relaxed))
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        takeExpired(now, expired);
+    }
+    for (Task *t : *expired)
+        post(t);
+    expired->clear();
+}
+} //namespace QtAV
@@ -0,0 +1,124 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+
+#ifndef QTAV_WORKPOOL_H
+#define QTAV_WORKPOOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "QtAV/QtAV_Global.h"
+
+namespace QtAV {
+/*
+ * A fixed number of worker threads running short tasks. Each worker has its own queue, a task posted from
+ * a worker goes to that worker's queue and idle workers steal from the others. Tasks can also be posted to
+ * run at a time point. Workers only sleep if there is no ready task, and are woken by post() or the earliest
+ * timer. A task is not owned by the pool and must not be destroyed while it is posted.
+ * Tasks should not block. A task which may block (e.g. delivery to outputs) marks it with a Blocking scope, then
+ * a spare thread runs the ready tasks while the worker is blocked. Spare threads are parked, not destroyed.
+ */
+class Q_AV_PRIVATE_EXPORT WorkPool
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+    class Task {
+    public:
+        virtual ~Task() {}
+        virtual void run() = 0;
+    };
+    /*
+     * Marks a section of a task which may block. While it is alive, a spare thread of the pool takes the place
+     * of the blocked worker. Scopes can be nested. No effect if current thread is not a thread of a pool.
+     */
+    class Q_AV_PRIVATE_EXPORT Blocking {
+    public:
+        Blocking();
+        ~Blocking();
+    private:
+        WorkPool *m_pool;
+    };
+    /// the process wide pool with 1 worker per cpu core. it is never destroyed
+    static WorkPool& instance();
+
+    explicit WorkPool(int threads);
+    ~WorkPool();
+    int threadCount() const { return int(m_workers.size());}
+    /// run task as soon as possible
+    void post(Task* task);
+    /// run task at time t, or as soon as possible if t is passed
+    void postAt(Task* task, const Clock::time_point& t);
+    /*!
+     * \brief parallelFor
+     * Run job(0)...job(count-1) on workers and the calling thread, and return when all are finished. Jobs not
+     * taken by a worker are run by the calling thread, so it never waits for a busy pool and can be called
+     * in a task.
+     */
+    void parallelFor(int count, const std::function<void(int)>& job);
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task*> tasks;
+        std::thread thread;
+    };
+    struct Timer {
+        Clock::time_point time;
+        Task *task;
+        bool operator<(const Timer& other) const { return time > other.time;} // earliest on top of the heap
+    };
+    void run(int index);
+    void runSpare(int index);
+    // index < 0: no own queue, steal only
+    Task* take(int index);
+    void postExpired(std::vector<Task*> *expired);
+    void beginBlocking();
+    void endBlocking();
+    // wake or create a spare for each blocked worker. called with m_mutex locked
+    void activateSpares();
+    // move tasks of expired timers to tasks. called with m_mutex locked
+    void takeExpired(const Clock::time_point& now, std::vector<Task*> *tasks);
+    void wakeOne();
+
+    std::vector<Worker*> m_workers;
+    std::atomic<unsigned> m_next; // round robin queue for tasks posted by non worker threads
+    std::atomic<int> m_ready; // posted but not taken
+    std::atomic<int> m_sleeping;
+    std::atomic<Clock::rep> m_next_timer; // time_since_epoch of the earliest timer, max if none
+    bool m_stop; // guarded by m_mutex
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::vector<Timer> m_timers; // heap. guarded by m_mutex
+    struct Spare {
+        std::thread thread;
+        std::condition_variable cond; // parked
+    };
+    // spare i runs tasks if i < m_blocked, otherwise it is parked
+    std::atomic<int> m_blocked; // written with m_mutex locked
+    std::vector<Spare*> m_spares; // guarded by m_mutex
+};
+} //namespace QtAV
+#endif //QTAV_WORKPOOL_H
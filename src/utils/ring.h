@@ -23,6 +23,7 @@
 #define QTAV_RING_H
 
 #include <cassert>
+#include <utility>
 #include <vector>
 
 namespace QtAV {
@@ -94,5 +95,52 @@ void ring_api<T,C>::pop_front() {
     m_0 = index(++m_0);
     --m_s;
 }
+
+/*!
+ * \brief The ring_queue class
+ * Unbounded FIFO with the QQueue api used by BlockingQueue. Elements are stored in a power of 2 ring
+ * which grows when full and is kept by clear(), so enqueue/dequeue do not allocate in steady state.
+ */
+template<typename T>
+class ring_queue {
+public:
+  ring_queue() : m_0(0), m_s(0) {}
+  void enqueue(const T &t) { grow(); m_data[index(m_0 + m_s)] = t; ++m_s;}
+  void enqueue(T &&t) { grow(); m_data[index(m_0 + m_s)] = std::move(t); ++m_s;}
+  T dequeue() {
+      assert(m_s > 0);
+      T t(std::move(m_data[m_0]));
+      m_data[m_0] = T(); //release the old data
+      m_0 = index(m_0 + 1);
+      --m_s;
+      return t;
+  }
+  void clear() {
+      for (size_t i = 0; i < m_s; ++i)
+          m_data[index(m_0 + i)] = T();
+      m_0 = m_s = 0;
+  }
+  T &head() { assert(m_s > 0); return m_data[m_0];}
+  const T &head() const { assert(m_s > 0); return m_data[m_0];}
+  T &last() { assert(m_s > 0); return m_data[index(m_0 + m_s - 1)];}
+  const T &last() const { assert(m_s > 0); return m_data[index(m_0 + m_s - 1)];}
+  const T &operator[](int i) const { assert(size_t(i) < m_s); return m_data[index(m_0 + i)];}
+  T &operator[](int i) { assert(size_t(i) < m_s); return m_data[index(m_0 + i)];}
+  int size() const { return int(m_s);}
+  bool isEmpty() const { return m_s == 0;}
+private:
+  size_t index(size_t i) const { return i & (m_data.size() - 1);}
+  void grow() {
+      if (m_s < m_data.size())
+          return;
+      std::vector<T> d(m_data.empty() ? 16 : m_data.size()*2);
+      for (size_t i = 0; i < m_s; ++i)
+          d[i] = std::move(m_data[index(m_0 + i)]);
+      m_data.swap(d);
+      m_0 = 0;
+  }
+  std::vector<T> m_data;
+  size_t m_0, m_s;
+};
 } //namespace QtAV
 #endif // QTAV_RING_H
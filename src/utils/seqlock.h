@@ -0,0 +1,76 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef QTAV_SEQLOCK_H
+#define QTAV_SEQLOCK_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace QtAV {
+/*
+ * Single writer, multiple readers value published with a sequence lock.
+ * store() never blocks and never waits for readers. load() retries until it gets a snapshot which
+ * was not modified while reading. The value is kept in its own cache lines so that frequent stores
+ * do not invalidate the lines of neighbour members.
+ */
+template<typename T>
+class alignas(64) seqlock {
+    static_assert(std::is_trivially_copyable<T>::value, "seqlock: T must be trivially copyable");
+    static const size_t kWords = (sizeof(T) + sizeof(uint64_t) - 1)/sizeof(uint64_t);
+public:
+    seqlock() : m_seq(0) {
+        for (size_t i = 0; i < kWords; ++i)
+            m_data[i].store(0, std::memory_order_relaxed);
+    }
+    // called by the only writer thread
+    void store(const T& v) {
+        uint64_t w[kWords] = {0};
+        memcpy(w, &v, sizeof(T));
+        const uint32_t s = m_seq.load(std::memory_order_relaxed);
+        m_seq.store(s + 1, std::memory_order_relaxed); // odd: writing
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < kWords; ++i)
+            m_data[i].store(w[i], std::memory_order_relaxed);
+        m_seq.store(s + 2, std::memory_order_release);
+    }
+    T load() const {
+        uint64_t w[kWords];
+        uint32_t s0, s1;
+        do {
+            s0 = m_seq.load(std::memory_order_acquire);
+            for (size_t i = 0; i < kWords; ++i)
+                w[i] = m_data[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            s1 = m_seq.load(std::memory_order_relaxed);
+        } while ((s0 & 1) || s0 != s1);
+        T v;
+        memcpy(&v, w, sizeof(T));
+        return v;
+    }
+private:
+    std::atomic<uint32_t> m_seq;
+    std::atomic<uint64_t> m_data[kWords];
+};
+} //namespace QtAV
+#endif //QTAV_SEQLOCK_H
@@ -0,0 +1,128 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+/*
+ * Checks AudioTimeStretch (WSOLA) used by AudioThread for playback speed. A sine is stretched in chunks for some
+ * speeds, packed and planar. Output duration must be input duration/speed and the pitch must be kept. Switching
+ * back to speed 1 must flush the pending input, and then pass data through untouched.
+ * usage: audiotimestretch [-freq 440]
+ */
+#include <QCoreApplication>
+#include <QtDebug>
+#include <QtCore/QStringList>
+#include <math.h>
+#include <string.h>
+#include "AudioTimeStretch.h"
+
+using namespace QtAV;
+
+static const int kRate = 48000;
+static const int kChannels = 2;
+static const int kChunk = 1024; // frames
+
+// kChunk frames of a sine from frame pos, s16 packed or float planar
+static QByteArray sine(AudioFormat::SampleFormat fmt, double freq, qint64 pos)
+{
+    const bool planar = fmt == AudioFormat::SampleFormat_FloatPlanar;
+    QByteArray data(kChunk*kChannels*(planar ? 4 : 2), 0);
+    for (int i = 0; i < kChunk; ++i) {
+        const double x = 0.5*sin(2.0*M_PI*freq*double(pos + i)/kRate);
+        for (int c = 0; c < kChannels; ++c) {
+            if (planar)
+                ((float*)data.data())[c*kChunk + i] = float(x);
+            else
+                ((qint16*)data.data())[i*kChannels + c] = qint16(x*32767.0);
+        }
+    }
+    return data;
+}
+
+// value of channel 0 at frame i
+static double sampleAt(AudioFormat::SampleFormat fmt, const QByteArray& data, int i)
+{
+    if (fmt == AudioFormat::SampleFormat_FloatPlanar)
+        return ((const float*)data.constData())[i]; // frames of channel 0 are the 1st plane
+    return ((const qint16*)data.constData())[i*kChannels]/32767.0;
+}
+
+static int test(AudioFormat::SampleFormat fmt, const char* name, double freq)
+{
+    static const qreal kSpeeds[] = { 0.5, 0.75, 1.25, 2.0 };
+    AudioFormat af;
+    af.setSampleFormat(fmt);
+    af.setChannels(kChannels);
+    af.setSampleRate(kRate);
+    AudioTimeStretch ts;
+    ts.setFormat(af);
+    int failed = 0;
+    qint64 pos = 0;
+    for (size_t s = 0; s < sizeof(kSpeeds)/sizeof(kSpeeds[0]); ++s) {
+        const qreal speed = kSpeeds[s];
+        ts.setSpeed(speed);
+        const int pending0 = ts.pendingFrames();
+        qint64 in_frames = 0, out_frames = 0, crossings = 0;
+        double last = 0;
+        for (int n = 0; n < 2*kRate/kChunk; ++n) {
+            const QByteArray out(ts.process(sine(fmt, freq, pos)));
+            pos += kChunk;
+            in_frames += kChunk;
+            const int frames = out.size()/af.bytesPerFrame();
+            for (int i = 0; i < frames; ++i) {
+                const double v = sampleAt(fmt, out, i);
+                if (last < 0 && v >= 0)
+                    ++crossings;
+                last = v;
+            }
+            out_frames += frames;
+        }
+        const double ratio = double(in_frames + pending0 - ts.pendingFrames())/double(out_frames);
+        const double out_freq = double(crossings)*kRate/double(out_frames);
+        const bool ok = qAbs(ratio/speed - 1.0) < 0.01 && qAbs(out_freq/freq - 1.0) < 0.02;
+        qDebug("%-11s speed %.2f: in/out %.3f, frequency %.1f Hz %s", name, speed, ratio, out_freq, ok ? "ok" : "FAILED");
+        if (!ok)
+            ++failed;
+    }
+    // back to speed 1: the pending input is flushed at once, then data is not modified
+    const int pending = ts.pendingFrames();
+    ts.setSpeed(1.0);
+    const QByteArray flushed(ts.process(QByteArray()));
+    const QByteArray in(sine(fmt, freq, pos));
+    const QByteArray out(ts.process(in));
+    const bool ok = flushed.size() == pending*af.bytesPerFrame() && ts.pendingFrames() == 0 && !ts.isActive()
+            && out.size() == in.size() && memcmp(out.constData(), in.constData(), in.size()) == 0;
+    qDebug("%-11s speed 1.00: %d pending frames flushed, pass through %s", name, pending, ok ? "ok" : "FAILED");
+    if (!ok)
+        ++failed;
+    return failed;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    double freq = 440;
+    const int idx = a.arguments().indexOf(QLatin1String("-freq"));
+    if (idx > 0)
+        freq = qBound(20.0, a.arguments().at(idx + 1).toDouble(), kRate/4.0);
+    int failed = test(AudioFormat::SampleFormat_Signed16, "s16", freq);
+    failed += test(AudioFormat::SampleFormat_FloatPlanar, "fltp", freq);
+    qDebug("%s", failed ? "FAILED" : "PASSED");
+    return failed ? 1 : 0;
+}
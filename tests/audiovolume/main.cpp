@@ -0,0 +1,137 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+/*
+ * Throughput of the software volume kernels of AudioOutput, in samples/ns for each sample format and instruction
+ * set available on this cpu. Each kernel scales a buffer with a constant gain and with a ramp, and the largest
+ * difference to the C kernel is reported (in units of the last place for integers, s32 in 1/256).
+ * usage: audiovolume [-samples 4096] [-ms 200]
+ */
+#include <QCoreApplication>
+#include <QtDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+#include <math.h>
+#include <stdlib.h>
+#include "output/audio/AudioVolume.h"
+
+using namespace QtAV;
+
+struct Format {
+    AudioFormat::SampleFormat format;
+    const char* name;
+    int bytes;
+};
+
+static const Format kFormats[] = {
+    { AudioFormat::SampleFormat_Unsigned8, "u8", 1 },
+    { AudioFormat::SampleFormat_Signed16, "s16", 2 },
+    { AudioFormat::SampleFormat_Signed32, "s32", 4 },
+    { AudioFormat::SampleFormat_Float, "float", 4 },
+    { AudioFormat::SampleFormat_Double, "double", 8 },
+};
+
+static double sampleAt(const Format& f, const QByteArray& data, int i)
+{
+    const char *p = data.constData();
+    switch (f.format) {
+    case AudioFormat::SampleFormat_Unsigned8: return ((const quint8*)p)[i];
+    case AudioFormat::SampleFormat_Signed16: return ((const qint16*)p)[i];
+    case AudioFormat::SampleFormat_Signed32: return ((const qint32*)p)[i]/256.0;
+    case AudioFormat::SampleFormat_Float: return ((const float*)p)[i]*32768.0;
+    default: return ((const double*)p)[i]*32768.0;
+    }
+}
+
+static QByteArray noise(const Format& f, int samples)
+{
+    QByteArray data(samples*f.bytes, 0);
+    char *p = data.data();
+    for (int i = 0; i < samples; ++i) {
+        const double x = double(rand())/RAND_MAX*2.0 - 1.0;
+        switch (f.format) {
+        case AudioFormat::SampleFormat_Unsigned8: ((quint8*)p)[i] = quint8(128 + x*127); break;
+        case AudioFormat::SampleFormat_Signed16: ((qint16*)p)[i] = qint16(x*32767); break;
+        case AudioFormat::SampleFormat_Signed32: ((qint32*)p)[i] = qint32(x*2147483647.0); break;
+        case AudioFormat::SampleFormat_Float: ((float*)p)[i] = float(x); break;
+        default: ((double*)p)[i] = x; break;
+        }
+    }
+    return data;
+}
+
+// largest difference to the C kernel
+static double compare(const Format& f, AudioVolume::Kernel k, const QByteArray& src, float gain, float step)
+{
+    QByteArray ref(src);
+    QByteArray out(src);
+    AudioVolume::kernel(f.format, AudioVolume::C)((quint8*)ref.data(), src.size()/f.bytes, gain, step);
+    k((quint8*)out.data(), src.size()/f.bytes, gain, step);
+    double d = 0;
+    for (int i = 0; i < src.size()/f.bytes; ++i)
+        d = qMax(d, fabs(sampleAt(f, ref, i) - sampleAt(f, out, i)));
+    return d;
+}
+
+static double bench(const Format& f, AudioVolume::Kernel k, const QByteArray& src, float step, int ms)
+{
+    QByteArray data(src);
+    const int n = src.size()/f.bytes;
+    qint64 samples = 0;
+    QElapsedTimer t;
+    t.start();
+    do {
+        // gain around 0.5 so the data does not saturate or vanish
+        for (int i = 0; i < 64; ++i) {
+            k((quint8*)data.data(), n, i & 1 ? 2.0f : 0.5f, step);
+            samples += n;
+        }
+    } while (t.elapsed() < ms);
+    return double(samples)/t.nsecsElapsed();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    int samples = 4096, ms = 200;
+    int idx = a.arguments().indexOf(QLatin1String("-samples"));
+    if (idx > 0)
+        samples = qMax(1, a.arguments().at(idx + 1).toInt());
+    idx = a.arguments().indexOf(QLatin1String("-ms"));
+    if (idx > 0)
+        ms = qMax(1, a.arguments().at(idx + 1).toInt());
+    qDebug("%d samples per call, best: %s", samples, AudioVolume::isaName(AudioVolume::bestIsa()));
+    qDebug("format isa  constant samples/ns  ramp samples/ns  max diff");
+    for (size_t i = 0; i < sizeof(kFormats)/sizeof(kFormats[0]); ++i) {
+        const Format &f = kFormats[i];
+        const QByteArray src(noise(f, samples));
+        for (int isa = 0; isa < AudioVolume::IsaCount; ++isa) {
+            AudioVolume::Kernel k = AudioVolume::kernel(f.format, AudioVolume::Isa(isa));
+            if (!k)
+                continue;
+            const double diff = qMax(compare(f, k, src, 0.7f, 0), compare(f, k, src, 0.1f, 1.0f/float(samples)));
+            qDebug("%-6s %-4s %19.3f %16.3f %9.2f", f.name, AudioVolume::isaName(AudioVolume::Isa(isa))
+                   , bench(f, k, src, 0, ms), bench(f, k, src, 1e-6f, ms), diff);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+/*
+ * Heap allocations per packet on the demuxer -> queue -> decoder path.
+ * "ref": Packet::fromAVPacket() + copies, the path before pooled packets were added. It used to cost
+ * a PacketPrivate, an AVPacket shell, an AVBufferRef and a QByteArray header per packet, now only the AVBufferRef.
+ * "move": Packet::takeAVPacket() + moves as AVDemuxer does now. Expected 0 in steady state.
+ * With glibc every malloc is counted (FFmpeg and Qt included), otherwise only C++ operator new.
+ */
+#include <QtCore/QElapsedTimer>
+#include <QtAV/Packet.h>
+#include <cstdio>
+#include <cstdlib>
+#include <errno.h>
+#include <new>
+#include <vector>
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+using namespace QtAV;
+
+static bool g_count = false; // single threaded
+static long long g_allocs = 0;
+
+#ifdef __GLIBC__
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void* __libc_memalign(size_t, size_t);
+void __libc_free(void*);
+
+void* malloc(size_t n) {
+    if (g_count)
+        ++g_allocs;
+    return __libc_malloc(n);
+}
+void* calloc(size_t n, size_t s) {
+    if (g_count)
+        ++g_allocs;
+    return __libc_calloc(n, s);
+}
+void* realloc(void* p, size_t n) {
+    if (g_count && !p)
+        ++g_allocs;
+    return __libc_realloc(p, n);
+}
+int posix_memalign(void** p, size_t a, size_t n) {
+    if (g_count)
+        ++g_allocs;
+    *p = __libc_memalign(a, n);
+    return *p ? 0 : ENOMEM;
+}
+void free(void* p) {
+    __libc_free(p);
+}
+}
+#else
+void* operator new(size_t n) {
+    if (g_count)
+        ++g_allocs;
+    void *p = std::malloc(n);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+#endif
+
+static const int kQueue = 64; // packets in flight
+static const double kTimeBase = 1.0/90000.0;
+
+template<typename F>
+static void run(const char* name, F convert, bool move)
+{
+    AVPacket *src = av_packet_alloc();
+    av_new_packet(src, 4096);
+    src->flags |= AV_PKT_FLAG_KEY;
+    AVPacket *rd = av_packet_alloc();
+    std::vector<Packet> queue(kQueue);
+    const int warmup = 4*kQueue, n = 200000;
+    long long allocs = 0;
+    QElapsedTimer t;
+    qint64 ns = 0;
+    for (int i = 0; i < warmup + n; ++i) {
+        // av_read_frame() output. its allocation belongs to the demuxer
+        av_packet_ref(rd, src);
+        rd->pts = rd->dts = i*3600;
+        const bool measure = i >= warmup;
+        if (measure) {
+            t.start();
+            g_allocs = 0;
+            g_count = true;
+        }
+        Packet pkt(convert(rd));
+        av_packet_unref(rd);
+        // queue: the slot of the packet put kQueue packets ago is taken by the decoder
+        Packet &slot = queue[i % kQueue];
+        Packet out(move ? std::move(slot) : slot);
+        if (move)
+            slot = std::move(pkt);
+        else
+            slot = pkt;
+        if (out.data.size() > 0)
+            out.asAVPacket();
+        if (measure) {
+            out = Packet();
+            g_count = false;
+            allocs += g_allocs;
+            ns += t.nsecsElapsed();
+        }
+    }
+    printf("%-5s: %.3f allocations/packet, %.1f ns/packet\n", name, double(allocs)/n, double(ns)/n);
+    queue.clear();
+    av_packet_free(&rd);
+    av_packet_free(&src);
+}
+
+int main()
+{
+#ifndef __GLIBC__
+    printf("not glibc: only operator new is counted\n");
+#endif
+    run("ref", [](AVPacket* p) { return Packet::fromAVPacket(p, kTimeBase); }, false);
+    run("move", [](AVPacket* p) { return Packet::takeAVPacket(p, kTimeBase); }, true);
+    return 0;
+}
@@ -0,0 +1,117 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+/*
+ * Latency hiding of the "Prefetch" MediaIO. A local file is read through a throttled QFile which sleeps
+ * on every read like a slow network mount. The reader simulates demuxing: fixed size reads with some
+ * work in between, and a few seeks. Compare the time spent blocked in read() with and without prefetch.
+ * usage: prefetchio -f file [-latency ms] [-work ms]
+ */
+#include <QCoreApplication>
+#include <QtDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QThread>
+#include <QtAV/MediaIO.h>
+
+using namespace QtAV;
+
+class ThrottledFile : public QFile
+{
+public:
+    ThrottledFile(const QString& name, int latency) : QFile(name), m_latency(latency) {}
+protected:
+    qint64 readData(char *data, qint64 maxSize) Q_DECL_OVERRIDE {
+        QThread::msleep(m_latency);
+        return QFile::readData(data, qMin<qint64>(maxSize, 64*1024));
+    }
+private:
+    int m_latency;
+};
+
+static qint64 run(MediaIO *io, int work, qint64 *blocked)
+{
+    QByteArray buf(32*1024, 0);
+    QElapsedTimer t;
+    *blocked = 0;
+    qint64 total = 0;
+    int reads = 0;
+    for (;;) {
+        t.start();
+        const qint64 n = io->read(buf.data(), buf.size());
+        *blocked += t.nsecsElapsed();
+        if (n <= 0)
+            break;
+        total += n;
+        if (++reads % 200 == 0 && io->isSeekable()) {
+            // a short backward seek like demuxers do for probing, then continue
+            io->seek(-qMin<qint64>(total, 16*1024), SEEK_CUR);
+        }
+        QThread::msleep(work);
+    }
+    return total;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QString file;
+    int latency = 5, work = 1;
+    int idx = a.arguments().indexOf(QLatin1String("-f"));
+    if (idx > 0)
+        file = a.arguments().at(idx + 1);
+    idx = a.arguments().indexOf(QLatin1String("-latency"));
+    if (idx > 0)
+        latency = a.arguments().at(idx + 1).toInt();
+    idx = a.arguments().indexOf(QLatin1String("-work"));
+    if (idx > 0)
+        work = a.arguments().at(idx + 1).toInt();
+    if (file.isEmpty()) {
+        qDebug("usage: prefetchio -f file [-latency ms] [-work ms]");
+        return 1;
+    }
+
+    for (int prefetch = 0; prefetch < 2; ++prefetch) {
+        ThrottledFile f(file, latency);
+        if (!f.open(QIODevice::ReadOnly))
+            return 1;
+        MediaIO *dev = MediaIO::create("QIODevice");
+        dev->setProperty("device", QVariant::fromValue<QIODevice*>(&f));
+        MediaIO *io = dev;
+        if (prefetch) {
+            io = MediaIO::create("Prefetch");
+            io->setProperty("capacity", 8*1024*1024);
+            io->setProperty("source", QVariant::fromValue<MediaIO*>(dev));
+        }
+        QElapsedTimer t;
+        t.start();
+        qint64 blocked = 0;
+        const qint64 bytes = run(io, work, &blocked);
+        qDebug("%s: %lld bytes, %lld ms total, %lld ms blocked in read()"
+               , prefetch ? "prefetch" : "direct", bytes, t.elapsed(), blocked/1000000LL);
+        if (prefetch) {
+            qDebug("source throughput: %lld KB/s, fill level at end: %lld bytes"
+                   , io->property("throughput").toLongLong()/1024, io->property("fillLevel").toLongLong());
+            delete io;
+        }
+        delete dev;
+    }
+    return 0;
+}
@@ -0,0 +1,214 @@
+/******************************************************************************
+    QtAV:  Multimedia framework based on Qt and FFmpeg
+    Copyright (C) 2012-2022 Wang Bin <wbsecg1@gmail.com>
+
+*   This file is part of QtAV
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+/*
+ * Cost of the realtime decode execution modes with many streams. Every stream has a reader thread which
+ * receives a packet at the stream rate, like a camera. Packets are "decoded" by busy waiting for some time,
+ * and "delivered" by sleeping in a WorkPool::Blocking scope, like a renderer or an audio output with a full buffer.
+ * thread: a decode thread per stream waits for packets and sleeps until the presentation deadline, like
+ *         AVDemuxThread in realtime decode mode.
+ * pool: the decoder runs in RealtimeDecodeTask on the shared WorkPool, like AVPlayer::setSharedThreadPool(true).
+ * Context switches and cpu time of the process are reported per stream and second, and the average lateness
+ * of presentation, which grows if blocked tasks starve the others.
+ * Keep streams*fps*work below the cpu capacity, otherwise both modes only measure overload.
+ * usage: sharedpool [-streams 16,64,128] [-seconds 5] [-fps 25] [-work us, default 500] [-block us, default 0]
+ */
+#include <QCoreApplication>
+#include <QtDebug>
+#include <QtCore/QStringList>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+#include "utils/RealtimeDecodeTask.h"
+
+using namespace QtAV;
+typedef std::chrono::steady_clock Clock;
+
+struct Usage {
+    double cpu; // s
+    long switches;
+};
+
+static Usage usage()
+{
+    Usage u = { 0, 0 };
+#ifdef Q_OS_UNIX
+    struct rusage r;
+    getrusage(RUSAGE_SELF, &r);
+    u.cpu = r.ru_utime.tv_sec + r.ru_stime.tv_sec + (r.ru_utime.tv_usec + r.ru_stime.tv_usec)/1e6;
+    u.switches = r.ru_nvcsw + r.ru_nivcsw;
+#endif
+    return u;
+}
+
+// decodes and paces like RealtimeDecoder in AVDemuxThread.cpp
+class Decoder
+{
+public:
+    Decoder(BlockingSPSCQueue<int> *packets, int interval, int work, int block)
+        : m_packets(packets), m_interval(interval), m_work(work), m_block(block), m_deadline(Clock::now())
+        , m_late(0), m_count(0)
+    {}
+    bool decodeNext(bool *wait) {
+        *wait = false;
+        if (!m_packets->tryFront())
+            return false;
+        m_packets->pop();
+        const Clock::time_point now = Clock::now();
+        if (m_count > 0 && now > m_deadline)
+            m_late += std::chrono::duration_cast<std::chrono::microseconds>(now - m_deadline).count();
+        ++m_count;
+        const Clock::time_point end = now + std::chrono::microseconds(m_work);
+        while (Clock::now() < end) {}
+        if (m_block > 0) {
+            WorkPool::Blocking blocking;
+            std::this_thread::sleep_for(std::chrono::microseconds(m_block));
+        }
+        const Clock::time_point t = Clock::now();
+        if (m_deadline < t - std::chrono::microseconds(m_interval)) // too late, do not burst to catch up
+            m_deadline = t;
+        m_deadline += std::chrono::microseconds(m_interval);
+        *wait = true;
+        return true;
+    }
+    Clock::time_point deadline() const { return m_deadline; }
+    double lateness() const { return m_count > 1 ? double(m_late)/double(m_count - 1) : 0; } // us
+private:
+    BlockingSPSCQueue<int> *m_packets;
+    const int m_interval; // us
+    const int m_work, m_block; // us
+    Clock::time_point m_deadline;
+    qint64 m_late; // us
+    qint64 m_count;
+};
+
+class Stream
+{
+public:
+    Stream(bool pool, int fps, int work, int block)
+        : packets(30), interval(1000000/fps), decoder(&packets, interval, work, block), stop(false)
+    {
+        if (pool)
+            task.reset(new RealtimeDecodeTask<Decoder, int>(&decoder, &packets));
+    }
+    void start() {
+        reader = std::thread([this] { read();});
+        if (!task)
+            decodeThread = std::thread([this] { decodeLoop();});
+    }
+    void finish() {
+        stop = true;
+        packets.close();
+        reader.join();
+        if (task)
+            task->finish();
+        else
+            decodeThread.join();
+    }
+    double lateness() const { return decoder.lateness(); }
+private:
+    void read() {
+        Clock::time_point t = Clock::now();
+        while (!stop) {
+            t += std::chrono::microseconds(interval);
+            if (!packets.waitUntil(t))
+                break;
+            if (!packets.push(0))
+                break;
+            if (task)
+                task->wake();
+        }
+    }
+    // the decode loop of AVDemuxThread::run() in realtime decode mode
+    void decodeLoop() {
+        bool wait = false;
+        while (packets.front()) {
+            if (decoder.decodeNext(&wait) && wait)
+                packets.waitUntil(decoder.deadline());
+        }
+    }
+
+    BlockingSPSCQueue<int> packets;
+    const int interval; // us
+    Decoder decoder;
+    std::unique_ptr<RealtimeDecodeTask<Decoder, int> > task;
+    std::thread reader, decodeThread;
+    std::atomic<bool> stop;
+};
+
+static void bench(bool pool, int streams, int seconds, int fps, int work, int block)
+{
+    std::vector<std::unique_ptr<Stream> > s;
+    for (int i = 0; i < streams; ++i)
+        s.emplace_back(new Stream(pool, fps, work, block));
+    const Usage u0 = usage();
+    for (auto& st : s)
+        st->start();
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    for (auto& st : s)
+        st->finish();
+    const Usage u1 = usage();
+    double late = 0;
+    for (auto& st : s)
+        late += st->lateness();
+    // spare threads of the pool are not counted
+    const int threads = pool ? streams + WorkPool::instance().threadCount() : streams*2;
+    qDebug("%s %3d streams: %4d threads, %7.1f context switches/stream/s, cpu %5.2f%%/stream, late %7.1f us"
+           , pool ? "pool  " : "thread", streams, threads
+           , double(u1.switches - u0.switches)/streams/seconds
+           , (u1.cpu - u0.cpu)*100.0/streams/seconds
+           , late/streams);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QStringList streams = QStringList() << QStringLiteral("16") << QStringLiteral("64") << QStringLiteral("128");
+    int seconds = 5, fps = 25, work = 500, block = 0;
+    int idx = a.arguments().indexOf(QLatin1String("-streams"));
+    if (idx > 0)
+        streams = a.arguments().at(idx + 1).split(QLatin1Char(','));
+    idx = a.arguments().indexOf(QLatin1String("-seconds"));
+    if (idx > 0)
+        seconds = a.arguments().at(idx + 1).toInt();
+    idx = a.arguments().indexOf(QLatin1String("-fps"));
+    if (idx > 0)
+        fps = qMax(1, a.arguments().at(idx + 1).toInt());
+    idx = a.arguments().indexOf(QLatin1String("-work"));
+    if (idx > 0)
+        work = a.arguments().at(idx + 1).toInt();
+    idx = a.arguments().indexOf(QLatin1String("-block"));
+    if (idx > 0)
+        block = a.arguments().at(idx + 1).toInt();
+#ifndef Q_OS_UNIX
+    qDebug("context switches and cpu time are only measured on unix");
+#endif
+    qDebug("%d pool threads, %d fps, %d us decode and %d us blocked delivery per packet", WorkPool::instance().threadCount(), fps, work, block);
+    foreach (const QString& n, streams) {
+        bench(false, n.toInt(), seconds, fps, work, block);
+        bench(true, n.toInt(), seconds, fps, work, block);
+    }
+    return 0;
+}
@@ -0,0 +1,11 @@
+CONFIG -= app_bundle
+CONFIG += console
+TEMPLATE = app
+TARGET = sharedpool
+
+PROJECTROOT = $$PWD/../..
+include($$PROJECTROOT/src/libQtAV.pri)
+preparePaths($$OUT_PWD/../../out)
+
+INCLUDEPATH += $$PROJECTROOT/src
+SOURCES += main.cpp
@@ -2,7 +2,12 @@ TEMPLATE = subdirs
 
 SUBDIRS += \
     ao \
+    audiotimestretch \
+    audiovolume \
     decoder \
+    packetpool \
+    prefetchio \
+    sharedpool \
     subtitle \
     transcode
 